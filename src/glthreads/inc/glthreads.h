@@ -5,15 +5,19 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+/* links are self-relative: each one holds the distance from its own address to the target node, 0 meaning NULL, so
+ * a list stays valid when the memory holding it is mapped at a different address (shared or file-backed heaps) */
+typedef intptr_t glthread_rel_ptr_t;
+
 typedef struct glthread_node
 {
-    struct glthread_node *next;
-    struct glthread_node *prev;
+    glthread_rel_ptr_t next;
+    glthread_rel_ptr_t prev;
 } glthread_node_t;
 
 typedef struct glthread
 {
-    struct glthread_node *head;
+    glthread_rel_ptr_t head;
 } glthread_t;
 
 void glthread_init(glthread_t *list);
@@ -24,6 +28,18 @@ void glthread_delete(glthread_t *list);
 void glthread_priority_insert(glthread_t *list, glthread_node_t *glthread, int8_t (*comp_fn)(void *, void *),
                               size_t offset);
 
+#define GLTHREAD_REL_PTR_GET(rel_field)                                                                                \
+    ((rel_field) ? (glthread_node_t *)((uint8_t *)&(rel_field) + (rel_field)) : (glthread_node_t *)NULL)
+
+#define GLTHREAD_REL_PTR_SET(rel_field, node_ptr)                                                                      \
+    ((rel_field) = (node_ptr) ? (glthread_rel_ptr_t)((uint8_t *)(node_ptr) - (uint8_t *)&(rel_field)) : 0)
+
+#define GLTHREAD_HEAD(list_ptr) GLTHREAD_REL_PTR_GET((list_ptr)->head)
+
+#define GLTHREAD_NEXT(node_ptr) GLTHREAD_REL_PTR_GET((node_ptr)->next)
+
+#define GLTHREAD_PREV(node_ptr) GLTHREAD_REL_PTR_GET((node_ptr)->prev)
+
 #define GLTHREAD_OFFSETOF(struct_type, field_name) (size_t)(&((struct_type *)NULL)->field_name)
 
 #define GLTHREAD_BASEOF(glthread_node, offset) (void *)((uint8_t *)glthread_node - offset)
@@ -31,9 +47,9 @@ void glthread_priority_insert(glthread_t *list, glthread_node_t *glthread, int8_
 #define GLTHREAD_ITERATE_BEGIN(list_ptr, node)                                                                         \
     {                                                                                                                  \
         glthread_node_t *_glthread_ptr = NULL;                                                                         \
-        for (node = list_ptr->head; node != NULL; node = _glthread_ptr)                                                \
+        for (node = GLTHREAD_HEAD(list_ptr); node != NULL; node = _glthread_ptr)                                       \
         {                                                                                                              \
-            _glthread_ptr = node->next;
+            _glthread_ptr = GLTHREAD_NEXT(node);
 
 #define GLTHREAD_ITERATE_END                                                                                           \
     }                                                                                                                  \
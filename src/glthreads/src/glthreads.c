@@ -10,57 +10,61 @@
  */
 static bool _glthread_check_empty(glthread_t *list)
 {
-    return (list->head == NULL ? true : false);
+    return (list->head == 0 ? true : false);
 }
 
 /**
  * @brief Inserts a GLThread node into a GLThread list.
  *
  * This function inserts a GLThread node into a GLThread list. It inserts the new node before
- * the current node in the list. The function updates the next and prev pointers of the
- * involved nodes to maintain the correct linkage.
+ * the current node in the list. The function updates the next and prev links of the
+ * involved nodes to maintain the correct linkage, and the head of the list when the current
+ * node was the head.
  *
+ * @param list Pointer to the GLThread list.
  * @param current_node Pointer to the current GLThread node in the list.
  * @param new_node Pointer to the new GLThread node to insert.
  */
-static void _glthread_insert_node(glthread_node_t *current_node, glthread_node_t *new_node)
+static void _glthread_insert_node(glthread_t *list, glthread_node_t *current_node, glthread_node_t *new_node)
 {
-    if (current_node->prev != NULL)
+    glthread_node_t *prev_node = GLTHREAD_PREV(current_node);
+
+    if (prev_node != NULL)
+    {
+        GLTHREAD_REL_PTR_SET(prev_node->next, new_node);
+        GLTHREAD_REL_PTR_SET(new_node->prev, prev_node);
+    }
+    else
     {
-        current_node->prev->next = new_node;
-        new_node->prev = current_node->prev;
+        GLTHREAD_REL_PTR_SET(list->head, new_node);
     }
-    new_node->next = current_node;
-    current_node->prev = new_node;
+    GLTHREAD_REL_PTR_SET(new_node->next, current_node);
+    GLTHREAD_REL_PTR_SET(current_node->prev, new_node);
 }
 
 /**
  * @brief Removes a GLThread node from a GLThread list.
  *
  * This function removes a GLThread node from a GLThread list. It updates the next and prev
- * pointers of the adjacent nodes to maintain the correct linkage after removal.
+ * links of the adjacent nodes to maintain the correct linkage after removal.
  *
  * @param node Pointer to the GLThread node to remove from the list.
  */
 static void _glthread_remove(glthread_node_t *node)
 {
-    if (node->prev != NULL && node->next != NULL)
-    {
-        node->prev->next = node->next;
-        node->next->prev = node->prev;
-        node->next = NULL;
-        node->prev = NULL;
-    }
-    else if (node->prev == NULL && node->next != NULL)
+    glthread_node_t *prev_node = GLTHREAD_PREV(node);
+    glthread_node_t *next_node = GLTHREAD_NEXT(node);
+
+    if (prev_node != NULL)
     {
-        node->next->prev = NULL;
-        node->next = NULL;
+        GLTHREAD_REL_PTR_SET(prev_node->next, next_node);
     }
-    else if (node->next == NULL && node->prev != NULL)
+    if (next_node != NULL)
     {
-        node->prev->next = NULL;
-        node->prev = NULL;
+        GLTHREAD_REL_PTR_SET(next_node->prev, prev_node);
     }
+    node->next = 0;
+    node->prev = 0;
 }
 
 /**
@@ -72,20 +76,20 @@ static void _glthread_remove(glthread_node_t *node)
  */
 void glthread_init(glthread_t *list)
 {
-    list->head = NULL;
+    list->head = 0;
 }
 
 /**
  * @brief Initializes a GLThread node.
  *
- * This function initializes a GLThread node by setting the next and prev pointers of the node to NULL.
+ * This function initializes a GLThread node by clearing the next and prev links of the node.
  *
  * @param glthread_node Pointer to the GLThread node to initialize.
  */
 void glthread_init_node(glthread_node_t *glthread_node)
 {
-    glthread_node->next = NULL;
-    glthread_node->prev = NULL;
+    glthread_node->next = 0;
+    glthread_node->prev = 0;
 }
 
 /**
@@ -103,9 +107,12 @@ void glthread_add_node_at_head(glthread_t *list, glthread_node_t *node)
     glthread_init_node(node);
     if (!_glthread_check_empty(list))
     {
-        _glthread_insert_node(list->head, node);
+        _glthread_insert_node(list, GLTHREAD_HEAD(list), node);
+    }
+    else
+    {
+        GLTHREAD_REL_PTR_SET(list->head, node);
     }
-    list->head = node;
 }
 
 /**
@@ -120,9 +127,9 @@ void glthread_add_node_at_head(glthread_t *list, glthread_node_t *node)
  */
 void glthread_remove_node(glthread_t *list, glthread_node_t *node)
 {
-    if (list->head == node)
+    if (GLTHREAD_HEAD(list) == node)
     {
-        list->head = node->next;
+        GLTHREAD_REL_PTR_SET(list->head, GLTHREAD_NEXT(node));
     }
     _glthread_remove(node);
 }
@@ -166,7 +173,7 @@ void glthread_priority_insert(glthread_t *list, glthread_node_t *gl_node, int8_t
 
     if (_glthread_check_empty(list))
     {
-        list->head = gl_node;
+        GLTHREAD_REL_PTR_SET(list->head, gl_node);
     }
     else
     {
@@ -176,7 +183,7 @@ void glthread_priority_insert(glthread_t *list, glthread_node_t *gl_node, int8_t
         {
             if (comp_fn(GLTHREAD_BASEOF(gl_node, offset), GLTHREAD_BASEOF(curr, offset)) == -1)
             {
-                _glthread_insert_node(curr, gl_node);
+                _glthread_insert_node(list, curr, gl_node);
                 return;
             }
             prev = curr;
@@ -184,6 +191,7 @@ void glthread_priority_insert(glthread_t *list, glthread_node_t *gl_node, int8_t
         GLTHREAD_ITERATE_END;
 
         /* insert node at the end */
-        prev->next = gl_node;
+        GLTHREAD_REL_PTR_SET(prev->next, gl_node);
+        GLTHREAD_REL_PTR_SET(gl_node->prev, prev);
     }
 }
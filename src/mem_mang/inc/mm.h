@@ -2,27 +2,56 @@
 #define _MEM_MANG_
 
 #include "glthreads.h"
+#include "uapi_mm.h"
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>            /* for open() and fcntl() */
+#include <linux/mempolicy.h> /* for MPOL_* */
+#include <pthread.h>
+#include <sched.h>            /* for sched_yield() */
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/mman.h> /* for mmap() and munmap() */
-#include <unistd.h>   /* for sysconf(_SC_PAGESIZE) */
+#include <sys/file.h>    /* for flock() */
+#include <sys/mman.h>    /* for mmap() and munmap() */
+#include <sys/stat.h>    /* for fstat() */
+#include <sys/syscall.h> /* for SYS_mbind, SYS_get_mempolicy, SYS_move_pages and SYS_getcpu */
+#include <sys/uio.h>     /* for writev() and readv() */
+#include <time.h>        /* for clock_gettime() */
+#include <unistd.h>      /* for sysconf(_SC_PAGESIZE) and syscall() */
+
+/* links between allocator metadata are self-relative: a link stores the distance from its own address to the target,
+ * 0 meaning NULL, so the metadata stays valid wherever the memory holding it is mapped */
+typedef intptr_t mm_rel_ptr_t;
+
+#define MM_REL_PTR_GET(type, rel_field) ((rel_field) ? (type *)((uint8_t *)&(rel_field) + (rel_field)) : (type *)NULL)
+
+#define MM_REL_PTR_SET(rel_field, ptr) ((rel_field) = (ptr) ? ((uint8_t *)(ptr) - (uint8_t *)&(rel_field)) : 0)
 
 typedef enum
 {
     MM_FREE,
-    MM_ALLOCATED
+    MM_ALLOCATED,
+    /* allocated block holding a constructed object that was given back to the object cache of its record */
+    MM_CACHED,
+    /* header meta block of a colored data VM page, covering the bytes in front of the first object */
+    MM_PADDING
 } vm_bool_t;
 
 typedef struct meta_block
 {
     vm_bool_t is_free;
     uint32_t data_block_size;
-    struct meta_block *prev;
-    struct meta_block *next;
+    /* self-relative links to the neighbouring blocks, which always live in the same data VM page */
+    int32_t prev;
+    int32_t next;
     /* offset of a metablock from the start of a data VM page */
     uint32_t offset;
+    /* index + 1 of the handle table entry referring to an allocated block, 0 if it was not allocated by handle */
+    uint32_t handle;
+    /* references to an allocated block, updated atomically by mm_retain() and mm_release(); it takes the 8 bytes of
+     * padding that keep the block 48 bytes long, a multiple of MM_SIZE_CLASS_ALIGNMENT that size class objects rely on */
+    uint32_t refcount;
     /* node to maintain a priority queue of free data blocks */
     glthread_node_t glue_node;
 } meta_block_t;
@@ -32,32 +61,66 @@ typedef struct meta_block
 #define MM_GET_PAGE_FROM_META_BLOCK(meta_block_ptr)                                                                    \
     (void *)((uint8_t *)meta_block_ptr - ((meta_block_t *)meta_block_ptr)->offset)
 
-#define MM_NEXT_META_BLOCK(meta_block_ptr) (meta_block_t *)(((meta_block_t *)meta_block_ptr)->next)
+#define MM_NEXT_META_BLOCK(meta_block_ptr) MM_REL_PTR_GET(meta_block_t, ((meta_block_t *)meta_block_ptr)->next)
 
 #define MM_NEXT_META_BLOCK_BY_SIZE(meta_block_ptr)                                                                     \
     (meta_block_t *)((uint8_t *)meta_block_ptr + sizeof(meta_block_t) +                                                \
                      ((meta_block_t *)meta_block_ptr)->data_block_size)
 
-#define MM_PREV_META_BLOCK(meta_block_ptr) (meta_block_t *)(((meta_block_t *)meta_block_ptr)->prev)
+#define MM_PREV_META_BLOCK(meta_block_ptr) MM_REL_PTR_GET(meta_block_t, ((meta_block_t *)meta_block_ptr)->prev)
+
+typedef enum
+{
+    /* blocks carry their meta_block_t right in front of them */
+    MM_PAGE_LAYOUT_IN_BAND,
+    /* fixed size slots whose state lives in an out-of-band side table entry */
+    MM_PAGE_LAYOUT_OUT_OF_BAND,
+    /* one column per field, slots tracked by a side table entry like out-of-band pages */
+    MM_PAGE_LAYOUT_STRUCT_OF_ARRAYS,
+    /* first page of a buddy run holding a single in-band block larger than a data VM page */
+    MM_PAGE_LAYOUT_BUDDY
+} vm_page_layout_t;
 
 typedef struct vm_page_for_data
 {
-    struct vm_page_for_data *prev;
-    struct vm_page_for_data *next;
-    struct struct_record *record;
+    mm_rel_ptr_t prev;
+    mm_rel_ptr_t next;
+    mm_rel_ptr_t record;
+    vm_page_layout_t layout;
+    /* bytes taken by allocated blocks and their meta blocks, only maintained while the record is compacted */
+    uint32_t compaction_live_bytes;
+    /* set while compaction moves the blocks out of the page, so that none are moved into it */
+    uint32_t compaction_draining;
+    /* bytes the first object of the page is moved by, see MM_CACHE_COLOR_ALIGN */
+    uint32_t color_offset;
+    /* side table entry describing the slots of an out-of-band page */
+    mm_rel_ptr_t side_table_entry;
     meta_block_t meta_block_info;
     uint8_t page_memory[];
 } vm_page_for_data_t;
 
+#define MM_NEXT_DATA_VM_PAGE(vm_page_for_data_ptr)                                                                     \
+    MM_REL_PTR_GET(vm_page_for_data_t, ((vm_page_for_data_t *)vm_page_for_data_ptr)->next)
+
+#define MM_PREV_DATA_VM_PAGE(vm_page_for_data_ptr)                                                                     \
+    MM_REL_PTR_GET(vm_page_for_data_t, ((vm_page_for_data_t *)vm_page_for_data_ptr)->prev)
+
+#define MM_DATA_VM_PAGE_RECORD(vm_page_for_data_ptr)                                                                   \
+    MM_REL_PTR_GET(struct_record_t, ((vm_page_for_data_t *)vm_page_for_data_ptr)->record)
+
+/* every block of a data VM page starts inside that page, so the byte before the application data is in it too */
+#define MM_GET_PAGE_FROM_APP_DATA(app_data_ptr)                                                                        \
+    (vm_page_for_data_t *)(((uintptr_t)(app_data_ptr)-1) & ~((uintptr_t)SYSTEM_PAGE_SIZE - 1))
+
 #define MM_MARK_DATA_VM_PAGE_FREE(vm_page_for_data_ptr)                                                                \
-    ((vm_page_for_data_t *)vm_page_for_data_ptr)->meta_block_info.prev = NULL;                                         \
-    ((vm_page_for_data_t *)vm_page_for_data_ptr)->meta_block_info.next = NULL;                                         \
+    ((vm_page_for_data_t *)vm_page_for_data_ptr)->meta_block_info.prev = 0;                                            \
+    ((vm_page_for_data_t *)vm_page_for_data_ptr)->meta_block_info.next = 0;                                            \
     ((vm_page_for_data_t *)vm_page_for_data_ptr)->meta_block_info.is_free = MM_FREE;
 
 #define MM_ITERATE_DATA_VM_PAGES_BEGIN(struct_record_ptr, data_vm_page_ptr)                                            \
     {                                                                                                                  \
-        for (data_vm_page_ptr = (vm_page_for_data_t *)((struct_record_t *)struct_record_ptr)->first_page;              \
-             data_vm_page_ptr != NULL; data_vm_page_ptr = ((vm_page_for_data_t *)data_vm_page_ptr)->next)              \
+        for (data_vm_page_ptr = MM_FIRST_DATA_VM_PAGE(struct_record_ptr); data_vm_page_ptr != NULL;                   \
+             data_vm_page_ptr = MM_NEXT_DATA_VM_PAGE(data_vm_page_ptr))                                                \
         {
 
 #define MM_ITERATE_DATA_VM_PAGES_END                                                                                   \
@@ -67,28 +130,256 @@ typedef struct vm_page_for_data
 #define MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(data_vm_page_ptr, meta_block_ptr)                           \
     {                                                                                                                  \
         for (meta_block_ptr = (meta_block_t *)(&(((vm_page_for_data_t *)data_vm_page_ptr)->meta_block_info));          \
-             meta_block_ptr != NULL; meta_block_ptr = ((meta_block_t *)meta_block_ptr)->next)                          \
+             meta_block_ptr != NULL; meta_block_ptr = MM_NEXT_META_BLOCK(meta_block_ptr))                              \
         {
 
 #define MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END                                                               \
     }                                                                                                                  \
     }
 
+/* Data VM pages of a record start their first object at offsets rotating in steps of a cache line over the room a
+ * page leaves after its last object, as in the SLAB allocator, so that objects at the same index of many pages do not
+ * all map to the same cache sets. */
+#define MM_CACHE_COLOR_ALIGN 64
+
+/* NUMA nodes the private heap keeps an empty page cache for; nodes past the last one are treated as node 0. Node
+ * masks passed to the kernel are MM_NUMA_MASK_BITS wide, enough for any kernel configuration. */
+#define MM_NUMA_MAX_NODES 64
+#define MM_NUMA_MASK_BITS 1024
+#define MM_NUMA_MASK_WORDS (MM_NUMA_MASK_BITS / (8 * sizeof(unsigned long)))
+
+/* pages whose node is looked up by one move_pages() call of mm_print_numa_usage() */
+#define MM_NUMA_QUERY_BATCH 64
+
+/* Buddy runs of the private heap are carved out of chunks of MM_BUDDY_CHUNK_PAGES VM pages, mapped on a multiple of
+ * their size so that a run finds its chunk by masking its address and its buddy by flipping one bit of its offset. The
+ * first page of a chunk holds the mm_buddy_chunk_t, so the largest run is half a chunk. */
+#define MM_BUDDY_CHUNK_ORDER 10
+#define MM_BUDDY_CHUNK_PAGES (1U << MM_BUDDY_CHUNK_ORDER)
+#define MM_BUDDY_MAX_RUN_ORDER (MM_BUDDY_CHUNK_ORDER - 1)
+#define MM_BUDDY_CHUNK_SIZE ((size_t)SYSTEM_PAGE_SIZE << MM_BUDDY_CHUNK_ORDER)
+
+/* set in the run order of a free run */
+#define MM_BUDDY_RUN_FREE 0x80
+
+typedef struct mm_buddy_chunk
+{
+    /* pages of the chunk in free runs */
+    uint32_t free_pages;
+    /* order + 1 of the run starting at each page, with MM_BUDDY_RUN_FREE while it is free, 0 inside a run */
+    uint8_t run_order[MM_BUDDY_CHUNK_PAGES];
+} mm_buddy_chunk_t;
+
+/* first page of a free run, linked into the free list of its order */
+typedef struct mm_buddy_free_run
+{
+    struct mm_buddy_free_run *prev;
+    struct mm_buddy_free_run *next;
+} mm_buddy_free_run_t;
+
+#define MM_BUDDY_CHUNK_OF(run_ptr) ((mm_buddy_chunk_t *)((uintptr_t)(run_ptr) & ~(uintptr_t)(MM_BUDDY_CHUNK_SIZE - 1)))
+
+#define MM_BUDDY_PAGE_INDEX(run_ptr)                                                                                   \
+    (uint32_t)(((uintptr_t)(run_ptr) & (uintptr_t)(MM_BUDDY_CHUNK_SIZE - 1)) / SYSTEM_PAGE_SIZE)
+
+#define MM_OOB_MAX_SLOTS_PER_VM_PAGE 512
+#define MM_OOB_SLOT_ALIGN 8
+
+/* Out-of-band metadata of one data VM page. Side table entries are packed into VM pages of their own, so allocating
+ * and freeing slots only writes to the side table (and to the object handed out) and never to the headers of other
+ * data VM pages. After a fork() this keeps copy-on-write faults to the pages whose objects are actually written. */
+typedef struct side_table_entry
+{
+    /* data VM page described by this entry, NULL while the entry is unused */
+    mm_rel_ptr_t data_page;
+    /* links of the list of entries whose page has free slots, or of the list of unused entries */
+    mm_rel_ptr_t prev;
+    mm_rel_ptr_t next;
+    uint16_t slot_count;
+    uint16_t used_slot_count;
+    uint32_t slot_size;
+    /* slots in use */
+    uint64_t used_bitmap[MM_OOB_MAX_SLOTS_PER_VM_PAGE / 64];
+    /* first slot of each allocation, so that multi-unit allocations can be freed by their first slot */
+    uint64_t head_bitmap[MM_OOB_MAX_SLOTS_PER_VM_PAGE / 64];
+} side_table_entry_t;
+
+typedef struct vm_page_for_side_table
+{
+    mm_rel_ptr_t next;
+    side_table_entry_t side_table_entry_list[];
+} vm_page_for_side_table_t;
+
+#define MM_MAX_SIDE_TABLE_ENTRIES_PER_VM_PAGE                                                                          \
+    ((SYSTEM_PAGE_SIZE - sizeof(vm_page_for_side_table_t)) / sizeof(side_table_entry_t))
+
+/* slots of an out-of-band data VM page start right after the part of the header that is used by such pages */
+#define MM_OOB_SLOT_AREA_OFFSET                                                                                        \
+    ((MM_BLOCK_OFFSETOF(vm_page_for_data_t, meta_block_info) + MM_OOB_SLOT_ALIGN - 1) & ~(MM_OOB_SLOT_ALIGN - 1))
+
+#define MM_OOB_SLOT_BIT_IS_SET(bitmap, slot) (((bitmap)[(slot) / 64] >> ((slot) % 64)) & 1)
+
+#define MM_OOB_SLOT_BIT_SET(bitmap, slot) ((bitmap)[(slot) / 64] |= (1ULL << ((slot) % 64)))
+
+#define MM_OOB_SLOT_BIT_CLEAR(bitmap, slot) ((bitmap)[(slot) / 64] &= ~(1ULL << ((slot) % 64)))
+
+/* first slot of an out-of-band data VM page, moved by the color of the page */
+#define MM_OOB_SLOT_AREA(vm_page_for_data_ptr)                                                                         \
+    ((uint8_t *)(vm_page_for_data_ptr) + MM_OOB_SLOT_AREA_OFFSET +                                                     \
+     ((vm_page_for_data_t *)(vm_page_for_data_ptr))->color_offset)
+
+#define MM_OOB_SLOT_ADDRESS(side_table_entry_ptr, slot)                                                                \
+    (void *)(MM_OOB_SLOT_AREA(MM_REL_PTR_GET(vm_page_for_data_t, (side_table_entry_ptr)->data_page)) +                 \
+             (size_t)(slot) * (side_table_entry_ptr)->slot_size)
+
+#define MM_ITERATE_SIDE_TABLE_ENTRIES_BEGIN(struct_record_ptr, side_table_entry_ptr)                                   \
+    {                                                                                                                  \
+        for (vm_page_for_side_table_t *_side_table_page =                                                             \
+                 MM_REL_PTR_GET(vm_page_for_side_table_t, ((struct_record_t *)struct_record_ptr)->side_table_pages);  \
+             _side_table_page != NULL;                                                                                 \
+             _side_table_page = MM_REL_PTR_GET(vm_page_for_side_table_t, _side_table_page->next))                      \
+        {                                                                                                              \
+            for (side_table_entry_ptr = _side_table_page->side_table_entry_list;                                      \
+                 side_table_entry_ptr < _side_table_page->side_table_entry_list +                                      \
+                                            MM_MAX_SIDE_TABLE_ENTRIES_PER_VM_PAGE;                                     \
+                 side_table_entry_ptr++)                                                                               \
+            {                                                                                                          \
+                if (side_table_entry_ptr->data_page == 0)                                                              \
+                {                                                                                                      \
+                    continue;                                                                                          \
+                }
+
+#define MM_ITERATE_SIDE_TABLE_ENTRIES_END                                                                              \
+    }                                                                                                                  \
+    }                                                                                                                  \
+    }
+
+/* side table VM pages are single pages, so an entry finds its page by rounding its address down */
+#define MM_GET_SIDE_TABLE_PAGE_FROM_ENTRY(side_table_entry_ptr)                                                        \
+    (vm_page_for_side_table_t *)((uintptr_t)(side_table_entry_ptr) & ~((uintptr_t)SYSTEM_PAGE_SIZE - 1))
+
+/* internal record flag of records registered with mm_register_soa_struct_record() */
+#define MM_RECORD_STRUCT_OF_ARRAYS 0x80000000
+
+/* record flags that change how data VM pages are laid out */
+#define MM_RECORD_LAYOUT_FLAGS (MM_RECORD_OUT_OF_BAND_META | MM_RECORD_STRUCT_OF_ARRAYS | MM_RECORD_REALTIME)
+
+/* records whose data VM pages are tracked by side table entries instead of the first_page chain; a real-time record
+ * has neither, its objects live in the real-time pool */
+#define MM_RECORD_USES_SIDE_TABLE(struct_record_ptr)                                                                   \
+    ((((struct_record_t *)struct_record_ptr)->flags & MM_RECORD_LAYOUT_FLAGS) != 0)
+
+/* every column of a struct-of-arrays page starts on a cache line */
+#define MM_SOA_COLUMN_ALIGN 64
+
+/* the column table of a struct-of-arrays page sits where the slots of an out-of-band page start */
+#define MM_SOA_COLUMNS_OF_PAGE(vm_page_for_data_ptr)                                                                   \
+    ((mm_soa_columns_t *)((uint8_t *)(vm_page_for_data_ptr) + MM_OOB_SLOT_AREA_OFFSET))
+
+#define MM_GET_PAGE_FROM_SOA_COLUMNS(soa_columns_ptr)                                                                  \
+    ((vm_page_for_data_t *)((uint8_t *)(soa_columns_ptr)-MM_OOB_SLOT_AREA_OFFSET))
+
+/* number of slots ahead of the current one that a walk over live objects prefetches */
+#define MM_OBJECT_WALK_PREFETCH_DISTANCE 4
+
+/* An entry of the handle table of a record. Entries live in VM pages that are never moved or released, so a handle
+ * resolves to its entry with two loads and the object behind it can be moved by updating the entry. */
+typedef struct mm_handle_entry
+{
+    /* object the handle refers to, 0 while the entry is free */
+    mm_rel_ptr_t object;
+    /* bumped whenever the entry is freed, so that handles to the previous object no longer match */
+    uint32_t generation;
+    /* units of the object, or index + 1 of the next free entry while the entry is free */
+    uint32_t units;
+} mm_handle_entry_t;
+
+#define MM_HANDLE_ENTRIES_PER_VM_PAGE (SYSTEM_PAGE_SIZE / sizeof(mm_handle_entry_t))
+
+#define MM_MAX_HANDLE_ENTRY_VM_PAGES (SYSTEM_PAGE_SIZE / sizeof(mm_rel_ptr_t))
+
+#define MM_HANDLE_INDEX(handle) ((uint32_t)(handle))
+
+#define MM_HANDLE_GENERATION(handle) ((uint32_t)((handle) >> 32))
+
+#define MM_MAKE_HANDLE(index, generation) (((uint64_t)(generation) << 32) | (uint32_t)(index))
+
+/* a data VM page holding a block that cannot be moved is never drained by compaction */
+#define MM_COMPACTION_PINNED_PAGE UINT32_MAX
+
 #define MM_MAX_RECORDS_PER_VM_PAGE                                                                                     \
-    ((SYSTEM_PAGE_SIZE - sizeof(vm_page_for_struct_records_t *)) / sizeof(struct_record_t))
+    ((SYSTEM_PAGE_SIZE - sizeof(vm_page_for_struct_records_t)) / sizeof(struct_record_t))
 
 #define MM_MAX_STRUCT_NAME_SIZE 32
 typedef struct struct_record
 {
     char struct_name[MM_MAX_STRUCT_NAME_SIZE];
     size_t size;
-    struct vm_page_for_data *first_page;
+    /* MM_RECORD_* flags given at registration */
+    uint32_t flags;
+    /* color of the next data VM page of the record */
+    uint32_t next_color;
+    /* NUMA node the data VM pages of the record are placed on, MM_NUMA_NODE_ANY to follow the allocating thread */
+    int32_t numa_node;
+    mm_rel_ptr_t first_page;
+    /* first pages of the buddy runs of the record, linked through their prev and next fields */
+    mm_rel_ptr_t buddy_runs;
     glthread_t free_block_priority_list;
+    /* side table VM pages of a record with out-of-band metadata */
+    mm_rel_ptr_t side_table_pages;
+    /* side table entries whose data VM page has free slots */
+    mm_rel_ptr_t partial_side_table_entries;
+    /* side table entries not describing any data VM page */
+    mm_rel_ptr_t unused_side_table_entries;
+    /* VM page holding the column table copied into new data VM pages of a struct-of-arrays record */
+    mm_rel_ptr_t soa_layout;
+    /* VM page of links to the VM pages of handle table entries */
+    mm_rel_ptr_t handle_directory;
+    /* number of handle table entries ever used, entries are never given back */
+    uint32_t handle_count;
+    /* index + 1 of the first free handle table entry, 0 if there is none */
+    uint32_t free_handles;
+    /* constructed objects given back with mm_cache_free(), linked through the glue nodes of their meta blocks */
+    glthread_t constructed_objects;
+    /* object cache callbacks, only valid in the process that set them */
+    mm_object_ctor_t object_ctor;
+    mm_object_dtor_t object_dtor;
+    void *object_ctor_arg;
+    pid_t object_ctor_owner;
+    /* called by compaction for every moved object, only valid in the process that set it */
+    mm_relocation_cb_t relocation_callback;
+    void *relocation_arg;
+    pid_t relocation_owner;
+    /* bytes of data VM pages, buddy runs and real-time pool blocks the record holds, and its cap, 0 for none */
+    size_t budget_used;
+    size_t budget_limit;
+    /* set while the record is within MM_BUDGET_PRESSURE_SHIFT of its cap, so that the callback fires once */
+    uint32_t budget_pressure;
+    /* called when the record comes near its cap, only valid in the process that set it */
+    mm_budget_cb_t budget_callback;
+    void *budget_arg;
+    pid_t budget_owner;
 } struct_record_t;
 
+/* a record is near its budget once it holds more than its cap less an eighth */
+#define MM_BUDGET_PRESSURE_SHIFT 3
+
+/* budget callback raised under the heap lock, called by the thread that raised it once the lock is released */
+typedef struct mm_budget_event
+{
+    mm_budget_cb_t callback;
+    const char *struct_name;
+    size_t used_bytes;
+    size_t limit_bytes;
+    void *arg;
+} mm_budget_event_t;
+
+#define MM_FIRST_DATA_VM_PAGE(struct_record_ptr)                                                                       \
+    MM_REL_PTR_GET(vm_page_for_data_t, ((struct_record_t *)struct_record_ptr)->first_page)
+
 typedef struct vm_page_for_struct_records
 {
-    struct vm_page_for_struct_records *next;
+    mm_rel_ptr_t next;
     /* to point to the list of structs in the VM page - struct hack VLA used */
     struct_record_t struct_record_list[];
 } vm_page_for_struct_records_t;
@@ -104,4 +395,165 @@ typedef struct vm_page_for_struct_records
     }                                                                                                                  \
     }
 
+#define MM_NEXT_STRUCT_RECORDS_VM_PAGE(vm_page_record_ptr)                                                             \
+    MM_REL_PTR_GET(vm_page_for_struct_records_t, ((vm_page_for_struct_records_t *)vm_page_record_ptr)->next)
+
+#define MM_EXPORT_MAGIC 0x4d4d5f4558505254ULL /* "MM_EXPRT" */
+
+/* objects per batch of an object stream, each batch is written with a single writev() */
+#define MM_EXPORT_BATCH_OBJECTS 512
+/* iovecs gathered before a page stream is written out */
+#define MM_EXPORT_MAX_IOVECS 1024
+
+/* Header of a stream written by mm_export_objects(). An object stream continues with batches made of an object
+ * count, the unit count of every object and then the objects themselves, and ends with a batch of 0 objects. A page
+ * stream continues with one page marker and one data VM page image (followed by the slot bitmaps of its side table
+ * entry for out-of-band records) per page, and ends with a 0 page marker. */
+typedef struct mm_export_header
+{
+    uint64_t magic;
+    char struct_name[MM_MAX_STRUCT_NAME_SIZE];
+    uint32_t struct_size;
+    uint32_t object_stride;
+    uint32_t page_size;
+    /* MM_EXPORT_* flags of the stream */
+    uint32_t export_flags;
+    /* MM_RECORD_* flags of the exported record */
+    uint32_t record_flags;
+    /* MM_METADATA_VERSION of the exporting allocator, page images are only imported by the same version */
+    uint32_t metadata_version;
+} mm_export_header_t;
+
+#define MM_HEAP_MAGIC 0x4d4d5f4845415021ULL /* "MM_HEAP!" */
+
+/* size classes are 16 bytes apart up to 128 bytes, then four per doubling up to MM_SIZE_CLASS_MAX_BYTES */
+#define MM_SIZE_CLASS_COUNT 24
+
+/* bumped whenever the layout of meta blocks, page headers or struct records changes, so that heaps and page images
+ * written with another layout are refused */
+#define MM_METADATA_VERSION 8
+
+typedef enum
+{
+    MM_HEAP_UNFORMATTED,
+    MM_HEAP_FORMATTING,
+    MM_HEAP_READY
+} mm_heap_state_t;
+
+/* Header of a heap. The private heap keeps it in static storage and takes VM pages straight from mmap(). A shared or
+ * persistent heap keeps it at the start of its mapping and carves every VM page (struct records and data) out of that
+ * mapping, so that all processes mapping it, now or after a restart, see the same record registry, page chains and
+ * block chains. */
+typedef struct mm_heap
+{
+    uint64_t magic;
+    uint32_t state;
+    uint32_t page_size;
+    /* size of the mapping in bytes, 0 for the private heap */
+    uint64_t region_size;
+    /* offset of the first never used page of the mapping */
+    uint64_t region_used;
+    /* pages given back to the mapping, chained through their first word */
+    mm_rel_ptr_t free_region_pages;
+    /* head of the list of VM pages containing struct records */
+    mm_rel_ptr_t vm_page_record_head;
+    /* application object from which the live objects of a persistent heap are found again */
+    mm_rel_ptr_t root;
+    /* set while a persistent heap is open, cleared by a clean close */
+    uint32_t dirty;
+    /* MM_METADATA_VERSION of the allocator that formatted a shared or persistent heap */
+    uint32_t metadata_version;
+    /* records of the size classes, registered on first use */
+    mm_rel_ptr_t size_class_records[MM_SIZE_CLASS_COUNT];
+    /* serialises the allocator, process-shared and robust for a shared heap */
+    pthread_mutex_t lock;
+} mm_heap_t;
+
+/* environment variable read by mm_init(), holding "key:value" pairs separated by commas */
+#define MM_CONF_ENV "MM_CONF"
+
+/* runtime settings of the allocator, see mm_configure() */
+typedef struct mm_config
+{
+    /* empty VM pages of the private heap kept for reuse instead of being unmapped */
+    uint32_t page_cache_pages;
+    /* VM pages mapped at once when the private heap needs a page and the cache is empty */
+    uint32_t span_pages;
+    /* ask for transparent huge pages on the spans */
+    bool huge_pages;
+    /* print the block usage of every record when the process exits */
+    bool stats_print;
+    /* write a line to stderr for every allocation and free */
+    bool trace;
+    /* start the objects of consecutive data VM pages of a record at different cache lines */
+    bool cache_coloring;
+} mm_config_t;
+
+/* second level free lists per power of two of the real-time pool, and alignment of its blocks */
+#define MM_RT_SL_INDEX_COUNT_LOG2 4
+#define MM_RT_SL_INDEX_COUNT (1U << MM_RT_SL_INDEX_COUNT_LOG2)
+#define MM_RT_ALIGN_LOG2 4
+#define MM_RT_ALIGN (1U << MM_RT_ALIGN_LOG2)
+
+/* blocks smaller than MM_RT_SMALL_BLOCK_SIZE share the first first level list, blocks and pools are smaller than
+ * 1 << MM_RT_FL_INDEX_MAX bytes */
+#define MM_RT_FL_INDEX_MAX 40
+#define MM_RT_FL_INDEX_SHIFT (MM_RT_SL_INDEX_COUNT_LOG2 + MM_RT_ALIGN_LOG2)
+#define MM_RT_FL_INDEX_COUNT (MM_RT_FL_INDEX_MAX - MM_RT_FL_INDEX_SHIFT + 1)
+#define MM_RT_SMALL_BLOCK_SIZE (1U << MM_RT_FL_INDEX_SHIFT)
+
+/* Block of the real-time pool. Blocks tile the pool; the free list links are only valid while the block is free and
+ * overlay the start of its data. */
+typedef struct mm_rt_block
+{
+    /* block right before this one in the pool, NULL for the first block */
+    struct mm_rt_block *prev_phys;
+    /* size of the data of the block, a multiple of MM_RT_ALIGN */
+    uint64_t size;
+    /* record and units of an allocated block */
+    struct struct_record *record;
+    uint32_t units;
+    vm_bool_t is_free;
+    struct mm_rt_block *next_free;
+    struct mm_rt_block *prev_free;
+} mm_rt_block_t;
+
+#define MM_RT_BLOCK_HEADER_SIZE MM_BLOCK_OFFSETOF(mm_rt_block_t, next_free)
+
+#define MM_RT_BLOCK_MIN_SIZE (sizeof(mm_rt_block_t) - MM_RT_BLOCK_HEADER_SIZE)
+
+#define MM_RT_BLOCK_FROM_APP_DATA(app_data_ptr) ((mm_rt_block_t *)((uint8_t *)(app_data_ptr)-MM_RT_BLOCK_HEADER_SIZE))
+
+#define MM_RT_NEXT_PHYS_BLOCK(rt_block_ptr)                                                                            \
+    ((mm_rt_block_t *)((uint8_t *)(rt_block_ptr) + MM_RT_BLOCK_HEADER_SIZE + (rt_block_ptr)->size))
+
+/* Two-level segregated fit allocator over a pool mapped and populated once by mm_init_realtime(). Free blocks are
+ * kept in one list per (first level, second level) size range and the bitmaps tell which lists are non-empty, so a
+ * suitable list is found with two bit scans and allocating or freeing is a bounded number of list operations. The
+ * last header of the pool is an allocated block of size 0 ending the tiling. The pool has a lock of its own, so that
+ * its users never wait for a thread holding the heap lock across a system call. */
+typedef struct mm_rt_pool
+{
+    /* guards the pool instead of the heap lock, taken inside the heap lock when both are held */
+    pthread_mutex_t lock;
+    uint8_t *base;
+    size_t size;
+    /* bytes of allocated blocks, headers included */
+    size_t used_bytes;
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmap[MM_RT_FL_INDEX_COUNT];
+    mm_rt_block_t *free_blocks[MM_RT_FL_INDEX_COUNT][MM_RT_SL_INDEX_COUNT];
+} mm_rt_pool_t;
+
+
+#define MM_ITERATE_STRUCT_RECORDS_VM_PAGES_BEGIN(heap_ptr, vm_page_record_ptr)                                         \
+    {                                                                                                                  \
+        for (vm_page_record_ptr = MM_REL_PTR_GET(vm_page_for_struct_records_t, (heap_ptr)->vm_page_record_head);       \
+             vm_page_record_ptr != NULL; vm_page_record_ptr = MM_NEXT_STRUCT_RECORDS_VM_PAGE(vm_page_record_ptr))      \
+        {
+
+#define MM_ITERATE_STRUCT_RECORDS_VM_PAGES_END                                                                         \
+    }                                                                                                                  \
+    }
+
 #endif /* _MEM_MANG_ */
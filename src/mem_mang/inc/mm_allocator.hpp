@@ -0,0 +1,219 @@
+#ifndef _MM_ALLOCATOR_
+#define _MM_ALLOCATOR_
+
+#include "uapi_mm.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <new>
+#include <typeinfo>
+
+namespace mm
+{
+
+namespace detail
+{
+
+/* blocks of a record with in-band metadata start on 16 bytes whenever the struct size is a multiple of 16 */
+constexpr std::size_t max_record_alignment = 16;
+
+/* record names are at most this long, see MM_MAX_STRUCT_NAME_SIZE */
+constexpr std::size_t record_name_size = 32;
+
+/**
+ * @brief Hashes a string with 64-bit FNV-1a.
+ *
+ * @param str The NUL-terminated string.
+ * @return The hash of the string.
+ */
+inline std::uint64_t fnv1a(const char *str)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *str != '\0'; str++)
+    {
+        hash = (hash ^ static_cast<unsigned char>(*str)) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Builds the record name of a type.
+ *
+ * Mangled type names are often longer than a record name, so the name is made of the start of the mangled name,
+ * which keeps it readable in the usage printouts, and a hash of the whole mangled name and the record flags, which
+ * keeps it unique.
+ *
+ * @param type The type_info of the type.
+ * @param flags MM_RECORD_* flags of the record.
+ * @param name Filled with the NUL-terminated record name.
+ */
+inline void record_name(const std::type_info &type, std::uint32_t flags, char (&name)[record_name_size])
+{
+    std::uint64_t hash = fnv1a(type.name()) + flags * 0x9e3779b97f4a7c15ULL;
+    std::snprintf(name, sizeof(name), "%.14s#%016llx", type.name(), static_cast<unsigned long long>(hash));
+}
+
+} // namespace detail
+
+/**
+ * @brief The struct record of a type, registered the first time it is needed.
+ *
+ * The record is defined like one of MM_DEFINE_STRUCT_RECORD, so it is found again, or created, in whichever heap is
+ * attached when it is used: switching to a shared, persistent or compressed heap and back never leaves a pointer to
+ * a record of a heap that is gone.
+ *
+ * @tparam T The type whose objects the record holds.
+ * @tparam Flags MM_RECORD_* flags of the record; each set of flags gets a record of its own.
+ */
+template <typename T, std::uint32_t Flags = 0> class type_record
+{
+  public:
+    /**
+     * @brief Returns the definition of the record, for the mm_static_* calls.
+     *
+     * @return Pointer to the definition.
+     */
+    static mm_static_record_t *definition()
+    {
+        static char name[detail::record_name_size];
+        static mm_static_record_t static_record = define(name);
+        return &static_record;
+    }
+
+    /**
+     * @brief Returns the record of the type in the attached heap, registering it there on first use.
+     *
+     * @return Pointer to the record, or nullptr if the type does not fit in a data VM page.
+     */
+    static mm_record_t *get()
+    {
+        return mm_static_record(definition());
+    }
+
+    /**
+     * @brief Allocates objects of the type without initializing them.
+     *
+     * @param units Number of objects.
+     * @return Pointer to the objects, to be freed with xfree(), or nullptr if allocation failed.
+     */
+    static void *allocate(std::uint32_t units)
+    {
+        return mm_static_alloc(definition(), units);
+    }
+
+    /**
+     * @brief Returns the largest number of objects of the type a single allocation from the record can hold.
+     *
+     * The number is taken in the heap attached on first use and kept, so that callers choosing between the record and
+     * another allocator by object count choose the same way when they free, whichever heap is attached by then.
+     *
+     * @return Number of objects, 0 if the type has no record.
+     */
+    static std::uint32_t max_units()
+    {
+        static const std::uint32_t units = (get() != nullptr ? mm_record_max_units(get()) : 0);
+        return units;
+    }
+
+  private:
+    static mm_static_record_t define(char (&name)[detail::record_name_size])
+    {
+        /* containers with static storage may allocate before main() */
+        mm_init();
+
+        detail::record_name(typeid(T), Flags, name);
+        /* the record may exist already, e.g. registered by another shared object or in a shared heap, so it is looked
+         * up by name in every heap */
+        return mm_static_record_t{name, sizeof(T), Flags, 0, nullptr};
+    }
+};
+
+/**
+ * @brief Standard allocator serving objects of T from the struct record of T.
+ *
+ * Node based containers (std::list, std::map, std::unordered_map, ...) rebind the allocator to their node type, so
+ * every node type gets a record of its own. Requests the record cannot serve, such as the bucket array of an
+ * unordered container growing past a data VM page or an over-aligned type, go to std::allocator instead; the choice
+ * only depends on the type and the object count, so `deallocate` makes the same one.
+ *
+ * @tparam T The type of the allocated objects.
+ */
+template <typename T> class allocator
+{
+  public:
+    using value_type = T;
+
+    template <typename U> struct rebind
+    {
+        using other = allocator<U>;
+    };
+
+    allocator() noexcept = default;
+
+    template <typename U> allocator(const allocator<U> &) noexcept
+    {
+    }
+
+    /**
+     * @brief Allocates uninitialized storage for `n` objects.
+     *
+     * @param n Number of objects.
+     * @return Pointer to the storage.
+     * @throws std::bad_alloc if no memory could be obtained.
+     */
+    T *allocate(std::size_t n)
+    {
+        if (!uses_record(n))
+        {
+            return std::allocator<T>().allocate(n);
+        }
+
+        void *app_data = type_record<T>::allocate(static_cast<std::uint32_t>(n));
+        if (app_data == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+
+        return static_cast<T *>(app_data);
+    }
+
+    /**
+     * @brief Frees storage obtained from `allocate`.
+     *
+     * @param ptr Pointer to the storage.
+     * @param n Number of objects passed to `allocate`.
+     */
+    void deallocate(T *ptr, std::size_t n) noexcept
+    {
+        if (!uses_record(n))
+        {
+            std::allocator<T>().deallocate(ptr, n);
+            return;
+        }
+
+        xfree(ptr);
+    }
+
+  private:
+    static bool uses_record(std::size_t n)
+    {
+        return alignof(T) <= detail::max_record_alignment && n != 0 && n <= type_record<T>::max_units();
+    }
+};
+
+/* all allocators share the records, so memory allocated by one can be freed by any other */
+template <typename T, typename U> bool operator==(const allocator<T> &, const allocator<U> &) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U> bool operator!=(const allocator<T> &, const allocator<U> &) noexcept
+{
+    return false;
+}
+
+} // namespace mm
+
+#endif /* _MM_ALLOCATOR_ */
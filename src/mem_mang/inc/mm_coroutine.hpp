@@ -0,0 +1,177 @@
+#ifndef _MM_COROUTINE_
+#define _MM_COROUTINE_
+
+#include "uapi_mm.h"
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace mm
+{
+
+namespace detail
+{
+
+/* frames are cached per thread in buckets of this many bytes, up to MM_SIZE_CLASS_MAX_BYTES */
+constexpr std::size_t frame_bucket_bytes = 16;
+constexpr std::size_t frame_bucket_count = MM_SIZE_CLASS_MAX_BYTES / frame_bucket_bytes;
+
+/* frames a thread keeps per bucket, further ones go back to the size class records */
+constexpr std::uint32_t frame_cache_depth = 64;
+
+/**
+ * @brief Free coroutine frames of one thread, linked through their first word, one list per bucket.
+ *
+ * Taking a frame from it or giving one back takes no lock; the size class records are only called when a bucket is
+ * empty or full. The frames of a thread go back to the records when the thread exits. Once another heap is attached
+ * the lists are dropped without touching their frames, which went away with an unmapped heap or stay allocated in the
+ * private one.
+ */
+struct frame_cache
+{
+    void *head[frame_bucket_count] = {};
+    std::uint32_t count[frame_bucket_count] = {};
+    std::uint64_t heap_epoch = 0;
+
+    /**
+     * @brief Forgets the frames of every bucket if they were cached in a heap that is no longer attached.
+     *
+     * @param epoch The value of mm_heap_epoch().
+     */
+    void follow_heap(std::uint64_t epoch) noexcept
+    {
+        if (heap_epoch != epoch)
+        {
+            for (std::size_t bucket = 0; bucket < frame_bucket_count; bucket++)
+            {
+                head[bucket] = nullptr;
+                count[bucket] = 0;
+            }
+            heap_epoch = epoch;
+        }
+    }
+
+    ~frame_cache()
+    {
+        follow_heap(mm_heap_epoch());
+        for (std::size_t bucket = 0; bucket < frame_bucket_count; bucket++)
+        {
+            while (head[bucket] != nullptr)
+            {
+                void *frame = head[bucket];
+                head[bucket] = *static_cast<void **>(frame);
+                xfree(frame);
+            }
+        }
+    }
+};
+
+inline frame_cache &thread_frame_cache() noexcept
+{
+    thread_local frame_cache cache;
+    return cache;
+}
+
+} // namespace detail
+
+/**
+ * @brief Allocates a coroutine frame from the frame cache of the thread or the size class records.
+ *
+ * Every call of one coroutine asks for the same frame size, so a frame freed by a thread is handed out again by its
+ * next call on that thread without taking the heap lock. Frames are allocated rounded up to their cache bucket, so any
+ * cached frame of a bucket fits every request falling into it. Cached frames stay live objects of their size class
+ * record. Frames larger than MM_SIZE_CLASS_MAX_BYTES go to the global operator new; the choice only depends on the
+ * size, so `frame_deallocate` makes the same one.
+ *
+ * @param size Size of the frame.
+ * @return Pointer to the frame, aligned to __STDCPP_DEFAULT_NEW_ALIGNMENT__.
+ * @throws std::bad_alloc if no memory could be obtained.
+ */
+inline void *frame_allocate(std::size_t size)
+{
+    static_assert(__STDCPP_DEFAULT_NEW_ALIGNMENT__ <= MM_SIZE_CLASS_ALIGNMENT,
+                  "coroutine frames must be aligned like the size class records");
+
+    if (size == 0 || size > MM_SIZE_CLASS_MAX_BYTES)
+    {
+        return ::operator new(size);
+    }
+
+    detail::frame_cache &cache = detail::thread_frame_cache();
+    cache.follow_heap(mm_heap_epoch());
+    std::size_t bucket = (size - 1) / detail::frame_bucket_bytes;
+    void *frame = cache.head[bucket];
+    if (frame != nullptr)
+    {
+        cache.head[bucket] = *static_cast<void **>(frame);
+        cache.count[bucket]--;
+        return frame;
+    }
+
+    /* coroutines with static storage may start before main() */
+    static const bool initialized = (mm_init(), true);
+    (void)initialized;
+
+    frame = mm_size_class_alloc((bucket + 1) * detail::frame_bucket_bytes, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+    if (frame == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return frame;
+}
+
+/**
+ * @brief Frees a coroutine frame obtained from `frame_allocate`.
+ *
+ * The frame is kept in the frame cache of the calling thread, which need not be the thread that allocated it, unless
+ * its bucket is full.
+ *
+ * @param frame Pointer to the frame.
+ * @param size Size passed to `frame_allocate`.
+ */
+inline void frame_deallocate(void *frame, std::size_t size) noexcept
+{
+    if (size == 0 || size > MM_SIZE_CLASS_MAX_BYTES)
+    {
+        ::operator delete(frame, size);
+        return;
+    }
+
+    detail::frame_cache &cache = detail::thread_frame_cache();
+    cache.follow_heap(mm_heap_epoch());
+    std::size_t bucket = (size - 1) / detail::frame_bucket_bytes;
+    if (cache.count[bucket] == detail::frame_cache_depth)
+    {
+        xfree(frame);
+        return;
+    }
+
+    *static_cast<void **>(frame) = cache.head[bucket];
+    cache.head[bucket] = frame;
+    cache.count[bucket]++;
+}
+
+/**
+ * @brief Base of a coroutine promise type whose frames come from the size class records.
+ *
+ * Deriving the promise type from it is enough: the compiler looks operator new and delete up in the promise type
+ * when it allocates the frame of a coroutine. The promise type must not declare
+ * get_return_object_on_allocation_failure, since allocation failures are reported by throwing.
+ */
+struct pooled_frame
+{
+    static void *operator new(std::size_t size)
+    {
+        return frame_allocate(size);
+    }
+
+    static void operator delete(void *frame, std::size_t size) noexcept
+    {
+        frame_deallocate(frame, size);
+    }
+};
+
+} // namespace mm
+
+#endif /* _MM_COROUTINE_ */
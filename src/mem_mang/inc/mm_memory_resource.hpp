@@ -0,0 +1,103 @@
+#ifndef _MM_MEMORY_RESOURCE_
+#define _MM_MEMORY_RESOURCE_
+
+#include "uapi_mm.h"
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+namespace mm
+{
+
+/**
+ * @brief Polymorphic memory resource serving requests from the size class records of the allocator.
+ *
+ * Requests of up to MM_SIZE_CLASS_MAX_BYTES bytes aligned to at most MM_SIZE_CLASS_ALIGNMENT are rounded up to a
+ * size class and served by its record; all others go to the upstream resource. The choice only depends on the size
+ * and alignment of a request, so deallocation makes the same one. Put it under a std::pmr::monotonic_buffer_resource
+ * or a pool resource to give a whole subsystem arenas backed by the allocator.
+ */
+class memory_resource : public std::pmr::memory_resource
+{
+  public:
+    /**
+     * @brief Creates a resource.
+     *
+     * @param upstream Resource serving the requests the size classes cannot serve.
+     */
+    explicit memory_resource(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()) noexcept
+        : upstream_(upstream)
+    {
+        mm_init();
+    }
+
+    /**
+     * @brief Returns the resource serving the requests the size classes cannot serve.
+     *
+     * @return Pointer to the upstream resource.
+     */
+    std::pmr::memory_resource *upstream_resource() const noexcept
+    {
+        return upstream_;
+    }
+
+  private:
+    static bool uses_size_class(std::size_t bytes, std::size_t alignment) noexcept
+    {
+        return bytes <= MM_SIZE_CLASS_MAX_BYTES && alignment <= MM_SIZE_CLASS_ALIGNMENT;
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        if (!uses_size_class(bytes, alignment))
+        {
+            return upstream_->allocate(bytes, alignment);
+        }
+
+        void *app_data = mm_size_class_alloc(bytes, alignment);
+        if (app_data == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+
+        return app_data;
+    }
+
+    void do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) override
+    {
+        if (!uses_size_class(bytes, alignment))
+        {
+            upstream_->deallocate(ptr, bytes, alignment);
+            return;
+        }
+
+        xfree(ptr);
+    }
+
+    /* memory of one resource can be given back to another one if both send the large requests to the same place */
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        const memory_resource *other_resource = dynamic_cast<const memory_resource *>(&other);
+        return this == &other || (other_resource != nullptr && upstream_->is_equal(*other_resource->upstream_));
+    }
+
+    std::pmr::memory_resource *upstream_;
+};
+
+/**
+ * @brief Returns a process-wide resource over the size class records with new/delete upstream.
+ *
+ * It can be installed with std::pmr::set_default_resource to switch every pmr container that does not name a
+ * resource over to the allocator.
+ *
+ * @return Pointer to the resource.
+ */
+inline memory_resource *size_class_resource() noexcept
+{
+    static memory_resource resource;
+    return &resource;
+}
+
+} // namespace mm
+
+#endif /* _MM_MEMORY_RESOURCE_ */
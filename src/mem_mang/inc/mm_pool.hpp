@@ -0,0 +1,415 @@
+#ifndef _MM_POOL_
+#define _MM_POOL_
+
+#include "mm_allocator.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace mm
+{
+
+namespace detail
+{
+
+/* objects up to this size are kept in slots, which carry no meta block and are found through a bitmap instead of the
+ * sorted free block list; larger objects leave few slots per page and go to blocks */
+constexpr std::size_t max_slot_object_size = 1024;
+
+/* objects a thread keeps per pooled type, further ones go back to the record */
+constexpr std::uint32_t pool_cache_depth = 64;
+
+/**
+ * @brief Free objects of one pooled type kept by one thread, linked through their first word.
+ *
+ * Taking an object from it or giving one back takes no lock; the record is only called when the list is empty or
+ * full. The list belongs to the heap attached when it was filled: once another heap is attached it is dropped without
+ * touching the objects, which went away with an unmapped heap or stay allocated in the private one. The objects go
+ * back to the record when the thread exits.
+ */
+struct pool_cache
+{
+    void *head = nullptr;
+    std::uint32_t count = 0;
+    std::uint64_t heap_epoch = 0;
+
+    /**
+     * @brief Gives the objects in the list back to their record.
+     */
+    void drain() noexcept
+    {
+        if (heap_epoch == mm_heap_epoch())
+        {
+            while (head != nullptr)
+            {
+                void *object = head;
+                head = *static_cast<void **>(object);
+                xfree(object);
+            }
+        }
+        head = nullptr;
+        count = 0;
+    }
+
+    ~pool_cache()
+    {
+        drain();
+    }
+};
+
+} // namespace detail
+
+/* where a pool keeps its objects */
+enum class pool_storage
+{
+    /* fixed size slots of a record with out-of-band metadata */
+    slots,
+    /* blocks of a record with in-band metadata */
+    blocks,
+    /* the global operator new, for types aligned more strictly than the records */
+    system,
+};
+
+/**
+ * @brief Pool of objects of T, served by a struct record dedicated to T.
+ *
+ * The storage is picked at compile time from the size and alignment of T: small types go to slots, larger ones to
+ * blocks, and over-aligned ones to the global operator new. A type that does not fit in a data VM page falls back to
+ * the global operator new at run time. The pool is stateless, so its deleter adds nothing to the size of a
+ * std::unique_ptr.
+ *
+ * Each thread keeps up to detail::pool_cache_depth freed objects of T, which its next allocations take back without
+ * the heap lock; they stay live objects of the record until the list overflows, `trim` is called or the thread
+ * exits. Types smaller than a pointer cannot hold the link and always go to the record.
+ *
+ * @tparam T The type of the pooled objects.
+ */
+template <typename T> class pool
+{
+  public:
+    static constexpr pool_storage storage = (alignof(T) > detail::max_record_alignment ? pool_storage::system
+                                             : sizeof(T) <= detail::max_slot_object_size ? pool_storage::slots
+                                                                                          : pool_storage::blocks);
+
+    /* deletes objects created by the pool */
+    struct deleter
+    {
+        void operator()(T *object) const noexcept
+        {
+            pool::destroy(object);
+        }
+    };
+
+    using unique_ptr = std::unique_ptr<T, deleter>;
+
+    /* whether freed objects are kept in the list of the thread */
+    static constexpr bool cached = (storage != pool_storage::system && sizeof(T) >= sizeof(void *));
+
+    /**
+     * @brief Allocates uninitialized storage for one object.
+     *
+     * @return Pointer to the storage.
+     * @throws std::bad_alloc if no memory could be obtained.
+     */
+    static void *allocate()
+    {
+        if constexpr (storage == pool_storage::system)
+        {
+            return ::operator new(sizeof(T), std::align_val_t(alignof(T)));
+        }
+        else
+        {
+            if constexpr (cached)
+            {
+                detail::pool_cache &cache = thread_cache();
+                void *object = cache.head;
+                if (object != nullptr && cache.heap_epoch == mm_heap_epoch())
+                {
+                    cache.head = *static_cast<void **>(object);
+                    cache.count--;
+                    return object;
+                }
+            }
+            if (record_type::max_units() == 0)
+            {
+                return ::operator new(sizeof(T));
+            }
+
+            void *app_data = record_type::allocate(1);
+            if (app_data == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+
+            return app_data;
+        }
+    }
+
+    /**
+     * @brief Frees storage obtained from `allocate`.
+     *
+     * @param ptr Pointer to the storage.
+     */
+    static void deallocate(void *ptr) noexcept
+    {
+        if constexpr (storage == pool_storage::system)
+        {
+            ::operator delete(ptr, std::align_val_t(alignof(T)));
+        }
+        else
+        {
+            if (record_type::max_units() == 0)
+            {
+                ::operator delete(ptr);
+                return;
+            }
+            if constexpr (cached)
+            {
+                detail::pool_cache &cache = thread_cache();
+                std::uint64_t epoch = mm_heap_epoch();
+                if (cache.heap_epoch != epoch)
+                {
+                    /* filled in another heap: its objects went away with that heap or stay allocated in it */
+                    cache.head = nullptr;
+                    cache.count = 0;
+                    cache.heap_epoch = epoch;
+                }
+                if (cache.count < detail::pool_cache_depth)
+                {
+                    *static_cast<void **>(ptr) = cache.head;
+                    cache.head = ptr;
+                    cache.count++;
+                    return;
+                }
+            }
+
+            xfree(ptr);
+        }
+    }
+
+    /**
+     * @brief Allocates uninitialized storage of `bytes` bytes from consecutive objects of the record, as for an array.
+     *
+     * Requests for a single object go through the list of the thread like `allocate`. Requests larger than a single
+     * allocation from the record can hold go to the global operator new; the choice only depends on `bytes`, so
+     * `deallocate_bytes` makes the same one.
+     *
+     * @param bytes Size of the storage.
+     * @return Pointer to the storage.
+     * @throws std::bad_alloc if no memory could be obtained.
+     */
+    static void *allocate_bytes(std::size_t bytes)
+    {
+        if constexpr (storage == pool_storage::system)
+        {
+            return ::operator new(bytes, std::align_val_t(alignof(T)));
+        }
+        else
+        {
+            std::size_t units = units_of(bytes);
+            if (cached && units == 1)
+            {
+                return allocate();
+            }
+            if (units > record_type::max_units())
+            {
+                return ::operator new(bytes);
+            }
+
+            void *app_data = record_type::allocate(static_cast<std::uint32_t>(units));
+            if (app_data == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+
+            return app_data;
+        }
+    }
+
+    /**
+     * @brief Frees storage obtained from `allocate_bytes`.
+     *
+     * @param ptr Pointer to the storage.
+     * @param bytes Size passed to `allocate_bytes`.
+     */
+    static void deallocate_bytes(void *ptr, std::size_t bytes) noexcept
+    {
+        if constexpr (storage == pool_storage::system)
+        {
+            ::operator delete(ptr, std::align_val_t(alignof(T)));
+        }
+        else
+        {
+            std::size_t units = units_of(bytes);
+            if (cached && units == 1)
+            {
+                deallocate(ptr);
+                return;
+            }
+            if (units > record_type::max_units())
+            {
+                ::operator delete(ptr);
+                return;
+            }
+
+            xfree(ptr);
+        }
+    }
+
+    /**
+     * @brief Allocates and constructs an object.
+     *
+     * @param args Arguments forwarded to the constructor of T.
+     * @return Pointer to the object, to be destroyed with `destroy`.
+     * @throws std::bad_alloc if no memory could be obtained, or whatever the constructor throws.
+     */
+    template <typename... Args> static T *create(Args &&...args)
+    {
+        void *storage_ptr = allocate();
+        try
+        {
+            return ::new (storage_ptr) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            deallocate(storage_ptr);
+            throw;
+        }
+    }
+
+    /**
+     * @brief Destroys and frees an object created by `create`.
+     *
+     * @param object Pointer to the object, may be nullptr.
+     */
+    static void destroy(T *object) noexcept
+    {
+        if (object != nullptr)
+        {
+            object->~T();
+            deallocate(object);
+        }
+    }
+
+    /**
+     * @brief Creates an object owned by a std::unique_ptr.
+     *
+     * @param args Arguments forwarded to the constructor of T.
+     * @return The owning pointer.
+     * @throws std::bad_alloc if no memory could be obtained, or whatever the constructor throws.
+     */
+    template <typename... Args> static unique_ptr make_unique(Args &&...args)
+    {
+        return unique_ptr(create(std::forward<Args>(args)...));
+    }
+
+    /**
+     * @brief Gives the objects of T kept by the calling thread back to the record.
+     */
+    static void trim() noexcept
+    {
+        if constexpr (cached)
+        {
+            thread_cache().drain();
+        }
+    }
+
+  private:
+    using record_type = type_record<T, (storage == pool_storage::slots ? MM_RECORD_OUT_OF_BAND_META : 0U)>;
+
+    static detail::pool_cache &thread_cache() noexcept
+    {
+        thread_local detail::pool_cache cache;
+        return cache;
+    }
+
+    static std::size_t units_of(std::size_t bytes) noexcept
+    {
+        return (bytes == 0 ? 1 : (bytes + sizeof(T) - 1) / sizeof(T));
+    }
+};
+
+/**
+ * @brief CRTP base giving a class operator new and delete served by the pool of the class.
+ *
+ * Deriving `class order : public mm::pooled<order>` makes every `new order(...)` and `new order[n]` allocate from
+ * mm::pool<order> without touching the allocation sites. Only sized deallocation functions are declared, so delete
+ * always learns the size of what it frees: objects of classes derived from the class are pooled too, and must have a
+ * virtual destructor to be deleted through a base pointer as usual. Over-aligned derived classes go to the aligned
+ * global operator new and placement new behaves like the global one. There is no nothrow form: the deallocation
+ * function called when a constructor throws after a nothrow new is not told the size, so `new (std::nothrow)` does
+ * not compile for these classes instead of freeing to the wrong place.
+ *
+ * @tparam Derived The class deriving from this base.
+ */
+template <typename Derived> class pooled
+{
+  public:
+    static void *operator new(std::size_t size)
+    {
+        return pool<Derived>::allocate_bytes(size);
+    }
+
+    static void *operator new[](std::size_t size)
+    {
+        return pool<Derived>::allocate_bytes(size);
+    }
+
+    static void operator delete(void *ptr, std::size_t size) noexcept
+    {
+        pool<Derived>::deallocate_bytes(ptr, size);
+    }
+
+    static void operator delete[](void *ptr, std::size_t size) noexcept
+    {
+        pool<Derived>::deallocate_bytes(ptr, size);
+    }
+
+    static void *operator new(std::size_t size, std::align_val_t alignment)
+    {
+        return ::operator new(size, alignment);
+    }
+
+    static void *operator new[](std::size_t size, std::align_val_t alignment)
+    {
+        return ::operator new[](size, alignment);
+    }
+
+    static void operator delete(void *ptr, std::size_t, std::align_val_t alignment) noexcept
+    {
+        ::operator delete(ptr, alignment);
+    }
+
+    static void operator delete[](void *ptr, std::size_t, std::align_val_t alignment) noexcept
+    {
+        ::operator delete[](ptr, alignment);
+    }
+
+    static void *operator new(std::size_t, void *place) noexcept
+    {
+        return place;
+    }
+
+    static void *operator new[](std::size_t, void *place) noexcept
+    {
+        return place;
+    }
+
+    static void operator delete(void *, void *) noexcept
+    {
+    }
+
+    static void operator delete[](void *, void *) noexcept
+    {
+    }
+
+  protected:
+    pooled() noexcept = default;
+    ~pooled() = default;
+};
+
+} // namespace mm
+
+#endif /* _MM_POOL_ */
@@ -4,14 +4,267 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* keep block metadata in a side table instead of in front of each object, so that allocator activity after a fork()
+ * does not copy data VM pages whose objects are not written */
+#define MM_RECORD_OUT_OF_BAND_META 0x1
+
+/* serve the objects from the real-time pool set up by mm_init_realtime(), in bounded time and without system calls */
+#define MM_RECORD_REALTIME 0x2
+
+/* no NUMA node preference: pages are placed by the default policy of the kernel, on the node touching them first */
+#define MM_NUMA_NODE_ANY (-1)
+
+/* the limit given to mm_set_budget() is a number of VM pages instead of bytes */
+#define MM_BUDGET_PAGES 0x1
+
+/* export whole data VM pages instead of individual objects */
+#define MM_EXPORT_PAGES 0x1
+
+/* largest request and strictest alignment served by the size class records */
+#define MM_SIZE_CLASS_MAX_BYTES 2048
+#define MM_SIZE_CLASS_ALIGNMENT 16
+
+/* objects of a compressed heap are named by 32-bit offsets in units of MM_CREF_ALIGNMENT from the start of the heap,
+ * which lies on a multiple of MM_CREF_REGION_SIZE */
+#define MM_CREF_SHIFT 3
+#define MM_CREF_ALIGNMENT (1ULL << MM_CREF_SHIFT)
+#define MM_CREF_REGION_SIZE (1ULL << (32 + MM_CREF_SHIFT))
+
+/* most fields a struct-of-arrays record can split its struct into */
+#define MM_SOA_MAX_FIELDS 16
+
+/* a field of a struct stored in its own column */
+typedef struct mm_field
+{
+    uint32_t offset;
+    uint32_t size;
+} mm_field_t;
+
+/* column table at the start of every data VM page of a struct-of-arrays record, column offsets are relative to it */
+typedef struct mm_soa_columns
+{
+    uint32_t slot_count;
+    uint32_t field_count;
+    uint32_t column_offset[MM_SOA_MAX_FIELDS];
+    mm_field_t fields[MM_SOA_MAX_FIELDS];
+} mm_soa_columns_t;
+
+/* an object of a struct-of-arrays record: a slot of the columns of one data VM page */
+typedef struct mm_soa_ref
+{
+    mm_soa_columns_t *columns;
+    uint32_t slot;
+} mm_soa_ref_t;
+
+/* position of a walk over the live objects of a record, private to the allocator */
+typedef struct mm_object_cursor
+{
+    void *record;
+    void *page;
+    void *end_page;
+    void *block;
+    uint32_t slot;
+} mm_object_cursor_t;
+
+/* called for each live object, a non-zero return value stops the walk */
+typedef int8_t (*mm_object_visitor_t)(void *app_data, uint32_t size, void *arg);
+
+/* generation in the upper 32 bits, index into the handle table of the record in the lower 32 bits */
+typedef uint64_t mm_handle_t;
+
+#define MM_HANDLE_NULL ((mm_handle_t)0)
+
+/* 32-bit reference to an object of a compressed heap */
+typedef uint32_t mm_cref_t;
+
+#define MM_CREF_NULL ((mm_cref_t)0)
+
+/* struct record, private to the allocator */
+typedef struct mm_record mm_record_t;
+
+/* struct record defined at compile time with MM_DEFINE_STRUCT_RECORD, created in the heap on first use */
+typedef struct mm_static_record
+{
+    const char *struct_name;
+    size_t size;
+    uint32_t flags;
+    /* attachment of the heap the record below lives in, private to the allocator */
+    uint64_t heap_epoch;
+    mm_record_t *record;
+} mm_static_record_t;
+
+/* handle table of a record, private to the allocator */
+typedef struct mm_handle_table mm_handle_table_t;
+
+/* called for each live handle, a non-zero return value stops the walk */
+typedef int8_t (*mm_handle_visitor_t)(mm_handle_t handle, void *app_data, void *arg);
+
+/* object cache constructor and destructor; the constructor runs without the heap lock, the destructor runs with it held
+ * by mm_cache_reap() and must not call into the allocator, which asserts that it does not */
+typedef void (*mm_object_ctor_t)(void *app_data, void *arg);
+typedef void (*mm_object_dtor_t)(void *app_data, void *arg);
+
+/* called by compaction after an object has been copied to `new_app_data` and before `old_app_data` is freed; it runs
+ * with the heap lock held and must not call into the allocator, which asserts that it does not */
+typedef void (*mm_relocation_cb_t)(void *old_app_data, void *new_app_data, uint32_t size, void *arg);
+
+/* called once a record comes within an eighth of its budget, after the heap lock has been released */
+typedef void (*mm_budget_cb_t)(const char *struct_name, size_t used_bytes, size_t limit_bytes, void *arg);
+
 void mm_init(void);
+int8_t mm_configure(const char *conf);
 int8_t mm_register_struct_record(const char *struct_name, size_t size);
+int8_t mm_register_struct_record_with_flags(const char *struct_name, size_t size, uint32_t flags);
 void mm_print_registered_struct_records(void);
 void *xcalloc(const char *struct_name, uint32_t units);
 void xfree(void *app_mem);
 void mm_print_mem_usage(const char *struct_name);
 void mm_print_block_usage(void);
 
+/* allocation from a record looked up once */
+mm_record_t *mm_get_struct_record(const char *struct_name);
+void *mm_record_alloc(mm_record_t *record, uint32_t units);
+uint32_t mm_record_max_units(mm_record_t *record);
+
+/* allocation next to an object visited together with the new one */
+void *xcalloc_near(const char *struct_name, uint32_t units, const void *hint);
+void *mm_record_alloc_near(mm_record_t *record, uint32_t units, const void *hint);
+
+/* allocation from struct records defined at compile time */
+mm_record_t *mm_static_record(mm_static_record_t *static_record);
+void *mm_static_alloc(mm_static_record_t *static_record, uint32_t units);
+void *mm_static_xcalloc(mm_static_record_t *static_record, uint32_t units);
+
+/* untyped allocation from size class records */
+void *mm_size_class_alloc(size_t bytes, size_t alignment);
+size_t mm_usable_size(const void *app_data);
+
+/* holding the heap lock across fork(), see pthread_atfork() */
+void mm_prefork(void);
+void mm_postfork(void);
+
+/* walking the live objects of a record; walks run without the heap lock, so the objects of the walked record must not
+ * be allocated or freed while a walk over them is in progress, be it a cursor, mm_for_each_object(), an export, a
+ * struct-of-arrays page walk or mm_handle_for_each(), other records can be used freely */
+int8_t mm_object_cursor_init(mm_object_cursor_t *cursor, const char *struct_name);
+uint32_t mm_object_cursor_partition(const char *struct_name, mm_object_cursor_t *cursors, uint32_t count);
+void *mm_object_cursor_next(mm_object_cursor_t *cursor, uint32_t *size);
+int32_t mm_object_cursor_for_each(mm_object_cursor_t *cursor, mm_object_visitor_t visitor, void *arg);
+int32_t mm_for_each_object(const char *struct_name, mm_object_visitor_t visitor, void *arg);
+
+/* zero-copy export and bulk import of the objects of a record */
+int64_t mm_export_objects(const char *struct_name, int fd, uint32_t flags);
+int64_t mm_import_objects(const char *struct_name, int fd);
+
+/* shared heap over a memfd or POSIX shm object */
+int8_t mm_init_shared(int fd, size_t region_size);
+void mm_detach_shared(void);
+uint64_t mm_heap_epoch(void);
+uint64_t mm_shared_offset(const void *app_data);
+void *mm_shared_ptr(uint64_t offset);
+
+/* NUMA placement of data VM pages per record and per thread */
+int8_t mm_set_numa_node(const char *struct_name, int32_t node);
+int8_t mm_thread_set_numa_node(int32_t node);
+void mm_print_numa_usage(void);
+
+/* memory budgets of records */
+int8_t mm_set_budget(const char *struct_name, size_t limit, uint32_t flags, mm_budget_cb_t callback, void *arg);
+size_t mm_budget_usage(const char *struct_name);
+
+/* pre-reserved pool for the records registered with MM_RECORD_REALTIME */
+int8_t mm_init_realtime(size_t pool_size);
+
+/* private heap whose objects have 32-bit references; only objects of records registered while the heap is attached,
+ * other than MM_RECORD_REALTIME ones, have a reference, and only if they lie on a multiple of MM_CREF_ALIGNMENT, which
+ * holds for records whose struct size is a multiple of it and for the size class records; mm_cref_encode() returns
+ * MM_CREF_NULL for any other pointer */
+int8_t mm_init_compressed(size_t region_size);
+mm_cref_t mm_cref_encode(const void *app_data);
+void *mm_cref_decode(mm_cref_t ref);
+
+/* objects referenced through generation-checked handles */
+mm_handle_table_t *mm_handle_table(const char *struct_name);
+mm_handle_t mm_handle_alloc(mm_handle_table_t *table, uint32_t units);
+void *mm_handle_get(mm_handle_table_t *table, mm_handle_t handle);
+int8_t mm_handle_free(mm_handle_table_t *table, mm_handle_t handle);
+int32_t mm_handle_for_each(mm_handle_table_t *table, mm_handle_visitor_t visitor, void *arg);
+
+/* reference counting of shared objects */
+void *mm_retain(void *app_data);
+uint32_t mm_release(void *app_data);
+
+/* caching of constructed objects */
+int8_t mm_set_object_constructor(const char *struct_name, mm_object_ctor_t ctor, mm_object_dtor_t dtor, void *arg);
+void *mm_cache_alloc(const char *struct_name);
+void mm_cache_free(void *app_data);
+int32_t mm_cache_reap(const char *struct_name);
+
+/* compaction of sparsely used data VM pages */
+int8_t mm_set_relocation_callback(const char *struct_name, mm_relocation_cb_t callback, void *arg);
+int32_t mm_compact(const char *struct_name, uint64_t budget_ns);
+
+/* struct-of-arrays records */
+int8_t mm_register_soa_struct_record(const char *struct_name, size_t size, const mm_field_t *fields,
+                                     uint32_t field_count);
+int8_t mm_soa_alloc(const char *struct_name, mm_soa_ref_t *ref);
+void mm_soa_free(mm_soa_ref_t ref);
+void mm_soa_store(mm_soa_ref_t ref, const void *object);
+void mm_soa_load(mm_soa_ref_t ref, void *object);
+mm_soa_columns_t *mm_soa_cursor_next_page(mm_object_cursor_t *cursor, const uint64_t **used_bitmap);
+
+/* persistent heap backed by a file */
+int8_t mm_init_persistent(const char *path, size_t region_size);
+int8_t mm_close_persistent(void);
+void mm_set_heap_root(void *app_data);
+void *mm_get_heap_root(void);
+
+/* object named by `ref` in the compressed heap holding `near`, any pointer into that heap */
+static inline void *mm_cref_decode_near(const void *near, mm_cref_t ref)
+{
+    uintptr_t heap_base = (uintptr_t)near & ~(uintptr_t)(MM_CREF_REGION_SIZE - 1);
+    return (ref == MM_CREF_NULL ? NULL : (void *)(heap_base + ((uintptr_t)ref << MM_CREF_SHIFT)));
+}
+
 #define MM_REG_STRUCT(struct_name) mm_register_struct_record(#struct_name, sizeof(struct_name))
 
+#define MM_REG_STRUCT_WITH_FLAGS(struct_name, flags)                                                                   \
+    mm_register_struct_record_with_flags(#struct_name, sizeof(struct_name), flags)
+
+/* defines the record of a struct in the linker section scanned by name lookups; the definition is a global symbol, so
+ * defining the same struct twice fails to link, and its alignment is pinned so the section is a plain array */
+#define MM_DEFINE_STRUCT_RECORD(struct_name, flags)                                                                    \
+    mm_static_record_t mm_static_record_##struct_name                                                                 \
+        __attribute__((section("mm_static_records"), used, aligned(__alignof__(mm_static_record_t)))) = {             \
+            #struct_name, sizeof(struct_name), (flags), 0, NULL}
+
+#define MM_DECLARE_STRUCT_RECORD(struct_name) extern mm_static_record_t mm_static_record_##struct_name
+
+#define MM_STATIC_RECORD(struct_name) (&mm_static_record_##struct_name)
+
+#define MM_STATIC_XCALLOC(struct_name, units) mm_static_xcalloc(MM_STATIC_RECORD(struct_name), units)
+
+#define MM_SOA_FIELD_DESC(struct_name, field_name)                                                                     \
+    {                                                                                                                  \
+        (uint32_t) offsetof(struct_name, field_name), (uint32_t)sizeof(((struct_name *)0)->field_name)                 \
+    }
+
+#define MM_REG_SOA_STRUCT(struct_name, fields)                                                                         \
+    mm_register_soa_struct_record(#struct_name, sizeof(struct_name), fields, sizeof(fields) / sizeof((fields)[0]))
+
+/* column `field_index` of a data VM page of a struct-of-arrays record, as an array of `type` */
+#define MM_SOA_COLUMN(soa_columns_ptr, field_index, type)                                                              \
+    ((type *)((uint8_t *)(soa_columns_ptr) + (soa_columns_ptr)->column_offset[field_index]))
+
+/* field `field_index` of the object referenced by `soa_ref`, as an lvalue of `type` */
+#define MM_SOA_FIELD(soa_ref, field_index, type) (MM_SOA_COLUMN((soa_ref).columns, field_index, type)[(soa_ref).slot])
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* UAPI_MEM_MANG_ */
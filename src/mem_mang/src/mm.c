@@ -3,762 +3,6058 @@
 /* size of a VM page on this system */
 static size_t SYSTEM_PAGE_SIZE = 0;
 
-/* pointer to the current head of the VM page lists containing struct records */
-static vm_page_for_struct_records_t *vm_page_record_head = NULL;
+/* header of the private heap, used until a shared heap is attached */
+static mm_heap_t mm_private_heap = {.magic = MM_HEAP_MAGIC, .state = MM_HEAP_READY, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+/* heap all allocator calls operate on */
+static mm_heap_t *heap = &mm_private_heap;
+
+/* number of times a heap has been attached, telling apart heaps mapped at the same address one after the other */
+static uint64_t heap_epoch = 1;
+
+/* file backing the persistent heap, -1 if none is open */
+static int mm_persistent_fd = -1;
+
+/* runtime settings, changed by mm_configure() */
+static mm_config_t mm_config = {.page_cache_pages = 0, .span_pages = 1, .cache_coloring = true};
+
+/* empty VM pages of the private heap kept for reuse, one list per NUMA node, chained through their first word */
+static void *mm_page_cache[MM_NUMA_MAX_NODES];
+static uint32_t mm_page_cache_count[MM_NUMA_MAX_NODES];
+
+/* number of NUMA nodes memory can be placed on, 1 on machines without NUMA */
+static uint32_t mm_numa_node_count = 1;
+
+/* node the data VM pages of records without a node of their own are placed on, for the calling thread */
+static __thread int32_t mm_thread_numa_node = MM_NUMA_NODE_ANY;
+
+/* heap whose lock the calling thread holds, see _mm_lock() */
+static __thread mm_heap_t *mm_locked_heap = NULL;
+
+/* threads that read `heap` while it pointed to a mapped heap and may still touch its lock, see _mm_lock() */
+static uint32_t mm_mapped_heap_users = 0;
+
+/* set while the calling thread runs an application callback with the heap lock held, see _mm_lock() */
+static __thread bool mm_in_locked_callback = false;
+
+/* id of the process, cached so that owner checks on the allocation path make no system call; refreshed after fork() */
+static pid_t mm_pid = 0;
+
+/* budget callback raised by the calling thread, delivered by _mm_unlock() */
+static __thread mm_budget_event_t mm_budget_event;
+
+/* pool of the records registered with MM_RECORD_REALTIME, private to the process */
+static mm_rt_pool_t mm_rt_pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/* free buddy runs of the private heap, one list per order */
+static mm_buddy_free_run_t *mm_buddy_free_runs[MM_BUDDY_MAX_RUN_ORDER + 1];
+static uint32_t mm_buddy_chunk_count = 0;
+
+/* bounds of the linker section holding the records defined with MM_DEFINE_STRUCT_RECORD, both NULL if it is empty */
+extern mm_static_record_t __start_mm_static_records[] __attribute__((weak));
+extern mm_static_record_t __stop_mm_static_records[] __attribute__((weak));
 
 /**
- * @brief Requests a virtual memory page.
+ * @brief Acquires the heap lock.
  *
- * This function requests a virtual memory page by mapping it into the process's address space.
+ * The lock of a shared heap is robust: if a process died while holding it, the lock is marked consistent again and
+ * the caller proceeds with whatever state the dead process left behind. The lock is not recursive, so a callback run
+ * with it held calling back into the allocator would deadlock; that is caught here instead.
  *
- * @param units Number of units (pages) to request.
- * @return Pointer to the requested virtual memory page, or NULL if the request failed.
+ * The attached heap is only switched with the lock of the old heap held, see `_mm_switch_heap`, so a thread that got
+ * the lock of a heap that is no longer attached lets it go and takes the lock of the new one. A thread about to lock
+ * a mapped heap counts itself in `mm_mapped_heap_users` first, which keeps the mapping, and the lock in it, from being
+ * unmapped under it; the private heap is never unmapped and costs no count.
  */
-static void *_mm_request_vm_page(uint32_t units)
+static void _mm_lock(void)
 {
-    /* the virtual mapping should be done in the heap */
-    uint8_t *vm_page =
-        mmap(sbrk(0), units * SYSTEM_PAGE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-    if (vm_page == MAP_FAILED)
+    assert(!mm_in_locked_callback);
+    for (;;)
     {
-        return NULL;
-    }
-    memset(vm_page, 0, units * SYSTEM_PAGE_SIZE);
+        mm_heap_t *locked_heap = __atomic_load_n(&heap, __ATOMIC_SEQ_CST);
+        bool mapped = (locked_heap != &mm_private_heap);
+        if (mapped)
+        {
+            __atomic_add_fetch(&mm_mapped_heap_users, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&heap, __ATOMIC_SEQ_CST) != locked_heap)
+            {
+                __atomic_sub_fetch(&mm_mapped_heap_users, 1, __ATOMIC_RELEASE);
+                continue;
+            }
+        }
 
-    return (void *)vm_page;
+        if (pthread_mutex_lock(&locked_heap->lock) == EOWNERDEAD)
+        {
+            pthread_mutex_consistent(&locked_heap->lock);
+        }
+        if (__atomic_load_n(&heap, __ATOMIC_RELAXED) == locked_heap)
+        {
+            mm_locked_heap = locked_heap;
+            return;
+        }
+
+        pthread_mutex_unlock(&locked_heap->lock);
+        if (mapped)
+        {
+            __atomic_sub_fetch(&mm_mapped_heap_users, 1, __ATOMIC_RELEASE);
+        }
+    }
 }
 
 /**
- * @brief Releases a virtual memory page.
- *
- * This function releases a virtual memory page by unmapping it from the process's address space.
+ * @brief Releases the heap lock.
  *
- * @param vm_page Pointer to the virtual memory page to release.
- * @param units Number of units (pages) to release.
- * @return 0 if the page was successfully released, -1 otherwise.
+ * A budget callback raised while the lock was held is called afterwards, so that it may free objects of the record.
  */
-static int8_t _mm_release_vm_page(void *vm_page, uint32_t units)
+static void _mm_unlock(void)
 {
-    return munmap(vm_page, units * SYSTEM_PAGE_SIZE);
+    mm_budget_event_t event = mm_budget_event;
+    mm_budget_event.callback = NULL;
+
+    mm_heap_t *locked_heap = mm_locked_heap;
+    mm_locked_heap = NULL;
+    pthread_mutex_unlock(&locked_heap->lock);
+    if (locked_heap != &mm_private_heap)
+    {
+        __atomic_sub_fetch(&mm_mapped_heap_users, 1, __ATOMIC_RELEASE);
+    }
+
+    if (event.callback != NULL)
+    {
+        event.callback(event.struct_name, event.used_bytes, event.limit_bytes, event.arg);
+    }
 }
 
 /**
- * @brief Looks up a struct_record_t object by struct name.
+ * @brief Updates the pressure state of a record after its usage or cap changed.
  *
- * This function searches for a struct_record_t object with a matching struct name
- * within the linked list of struct records. It iterates through the list of vm_page_for_struct_records_t
- * objects to find the desired record. If a matching record is found, it is returned.
+ * Coming within an eighth of the cap raises the callback of the record, which fires once until the record drops
+ * below that mark again.
  *
- * @param struct_name Pointer to the struct name to search for.
- * @return Pointer to the matching struct_record_t object, or NULL if not found.
+ * @param record Pointer to the struct_record_t object.
  */
-static struct_record_t *_mm_lookup_struct_record_by_name(const char *struct_name)
+static void _mm_budget_update_pressure(struct_record_t *record)
 {
-    for (vm_page_for_struct_records_t *vm_page_record = vm_page_record_head; vm_page_record != NULL;
-         vm_page_record = vm_page_record->next)
+    size_t mark = record->budget_limit - (record->budget_limit >> MM_BUDGET_PRESSURE_SHIFT);
+    bool near_cap = (record->budget_limit != 0 && record->budget_used > mark);
+    if (near_cap && !record->budget_pressure && record->budget_callback != NULL && record->budget_owner == mm_pid)
     {
-        struct_record_t *record = NULL;
-        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
-        {
-            if (strncmp(record->struct_name, struct_name, MM_MAX_STRUCT_NAME_SIZE) == 0)
-            {
-                return record;
-            }
-        }
-        MM_ITERATE_STRUCT_RECORDS_END;
+        mm_budget_event.callback = record->budget_callback;
+        mm_budget_event.struct_name = record->struct_name;
+        mm_budget_event.used_bytes = record->budget_used;
+        mm_budget_event.limit_bytes = record->budget_limit;
+        mm_budget_event.arg = record->budget_arg;
     }
-
-    return NULL;
+    record->budget_pressure = near_cap;
 }
 
 /**
- * @brief Merges two free memory blocks into a single block.
+ * @brief Charges memory taken by a record against its budget.
  *
- * This function merges two free memory blocks into a single block. The function assumes
- * that both input blocks are free (is_free == MM_FREE). It updates the data_block_size,
- * next, and prev fields of the first block to incorporate the second block into a single block.
+ * This is the only budget check of the allocation path, made when a record takes a data VM page, a buddy run or a
+ * real-time pool block, never for objects placed in memory the record already holds.
  *
- * @param first Pointer to the first meta_block_t object.
- * @param second Pointer to the second meta_block_t object.
+ * @param record Pointer to the struct_record_t object.
+ * @param bytes Number of bytes taken.
+ * @return true if the bytes were charged, false if they would take the record over its cap.
  */
-static void _mm_merge_free_blocks(meta_block_t *first, meta_block_t *second)
+static bool _mm_budget_charge(struct_record_t *record, size_t bytes)
 {
-    assert((first->is_free == MM_FREE) && (second->is_free == MM_FREE));
+    if (record->budget_limit != 0 && record->budget_used + bytes > record->budget_limit)
+    {
+        return false;
+    }
 
-    first->data_block_size += sizeof(meta_block_t) + second->data_block_size;
-    first->next = second->next;
-    if (second->next != NULL)
+    record->budget_used += bytes;
+    if (record->budget_limit != 0)
     {
-        first->next->prev = first;
+        _mm_budget_update_pressure(record);
     }
+
+    return true;
 }
 
 /**
- * @brief Checks if a data virtual memory page is empty.
- *
- * This function checks if a data virtual memory page is empty by examining its meta_block_info
- * fields, including next, prev, and is_free.
+ * @brief Gives memory a record no longer holds back to its budget.
  *
- * @param data_vm_page Pointer to the vm_page_for_data_t object to check.
- * @return MM_FREE if the page is empty, MM_ALLOCATED otherwise.
+ * @param record Pointer to the struct_record_t object.
+ * @param bytes Number of bytes given back.
  */
-static vm_bool_t _mm_is_data_vm_page_empty(vm_page_for_data_t *data_vm_page)
+static void _mm_budget_uncharge(struct_record_t *record, size_t bytes)
 {
-    if (data_vm_page->meta_block_info.next == NULL && data_vm_page->meta_block_info.prev == NULL &&
-        data_vm_page->meta_block_info.is_free == MM_FREE)
+    record->budget_used -= bytes;
+    if (record->budget_pressure)
     {
-        return MM_FREE;
+        _mm_budget_update_pressure(record);
     }
-
-    return MM_ALLOCATED;
 }
 
 /**
- * @brief Calculates the maximum amount of virtual memory page memory available.
+ * @brief Writes a line to stderr for an allocation or free when tracing is on.
  *
- * This function calculates the maximum amount of virtual memory page memory available,
- * taking into account the system page size and the offset of the page memory within
- * the vm_page_for_data_t structure.
+ * The line is formatted on the stack and written with a single write(), so that tracing does not allocate and the
+ * lines of concurrent threads do not interleave.
  *
- * @param units Number of units to calculate memory for.
- * @return Maximum memory available for the specified number of units, in bytes.
+ * @param event "alloc" or "free".
+ * @param record Record of the object.
+ * @param app_data Pointer to the object.
+ * @param units Number of units allocated, 0 for a free.
  */
-static uint32_t _mm_max_vm_page_memory_available(uint32_t units)
+static void _mm_trace(const char *event, struct_record_t *record, const void *app_data, uint32_t units)
 {
-    return (uint32_t)((SYSTEM_PAGE_SIZE * units) - MM_BLOCK_OFFSETOF(vm_page_for_data_t, page_memory));
+    if (!mm_config.trace)
+    {
+        return;
+    }
+
+    char line[128];
+    int length = (units != 0 ? snprintf(line, sizeof(line), "mm: %s %.*s %p %u\n", event, MM_MAX_STRUCT_NAME_SIZE,
+                                        record->struct_name, app_data, units)
+                             : snprintf(line, sizeof(line), "mm: %s %.*s %p\n", event, MM_MAX_STRUCT_NAME_SIZE,
+                                        record->struct_name, app_data));
+    if (length > 0)
+    {
+        write(STDERR_FILENO, line, (size_t)length < sizeof(line) ? (size_t)length : sizeof(line) - 1);
+    }
 }
 
 /**
- * @brief Allocates a virtual memory page for data.
+ * @brief Maps anonymous memory starting on a multiple of a given alignment.
  *
- * This function allocates a virtual memory page for data and initializes its fields.
+ * Enough address space is reserved to find an aligned start in it, then what is around the aligned mapping is given
+ * back.
  *
- * @param record Pointer to the struct_record_t object associated with the data page.
- * @return Pointer to the allocated vm_page_for_data_t object.
+ * @param size Size of the mapping, a multiple of the page size.
+ * @param alignment Alignment of the start, a power of two multiple of the page size.
+ * @param prot Protection of the mapping.
+ * @return Pointer to the mapping, or NULL if the address space could not be reserved.
  */
-static vm_page_for_data_t *mm_allocate_data_vm_page(struct_record_t *record)
+static void *_mm_map_aligned(size_t size, size_t alignment, int prot)
 {
-    vm_page_for_data_t *data_vm_page = (vm_page_for_data_t *)_mm_request_vm_page(1);
-
-    MM_MARK_DATA_VM_PAGE_FREE(data_vm_page);
-
-    data_vm_page->meta_block_info.data_block_size = _mm_max_vm_page_memory_available(1);
-    data_vm_page->meta_block_info.offset = MM_BLOCK_OFFSETOF(vm_page_for_data_t, meta_block_info);
-    data_vm_page->next = NULL;
-    data_vm_page->prev = NULL;
-    data_vm_page->record = record;
-    glthread_init_node(&data_vm_page->meta_block_info.glue_node);
+    size_t reserved_size = size + alignment;
+    uint8_t *reserved = mmap(NULL, reserved_size, prot, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED)
+    {
+        return NULL;
+    }
 
-    if (!record->first_page)
+    uint8_t *base = (uint8_t *)(((uintptr_t)reserved + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if (base != reserved)
     {
-        record->first_page = data_vm_page;
+        munmap(reserved, (size_t)(base - reserved));
     }
-    else
+    if (base + size != reserved + reserved_size)
     {
-        data_vm_page->next = record->first_page;
-        record->first_page->prev = data_vm_page;
-        record->first_page = data_vm_page;
+        munmap(base + size, (size_t)(reserved + reserved_size - (base + size)));
     }
 
-    return data_vm_page;
+    return base;
 }
 
 /**
- * @brief Deletes and frees a data virtual memory page.
+ * @brief Carves virtual memory pages out of the shared heap mapping.
  *
- * This function deletes and frees a data virtual memory page. It removes the page from the associated struct_record_t's
- * page list and releases the virtual memory page using `_mm_release_vm_page`.
+ * A single page is taken from the list of pages given back to the mapping if possible, otherwise the pages are taken
+ * from the never used tail of the mapping.
  *
- * @param data_vm_page Pointer to the data virtual memory page to delete and free.
+ * @param units Number of units (pages) to request.
+ * @return Pointer to the first page, or NULL if the mapping is exhausted.
  */
-static void _mm_delete_and_free_data_vm_page(vm_page_for_data_t *data_vm_page)
+static void *_mm_request_region_pages(uint32_t units)
 {
-    struct_record_t *record = data_vm_page->record;
+    uint8_t *vm_page = NULL;
 
-    if (record->first_page == data_vm_page)
+    if (units == 1 && heap->free_region_pages != 0)
     {
-        record->first_page = data_vm_page->next;
-        if (data_vm_page->next)
-        {
-            data_vm_page->next->prev = NULL;
-        }
-        data_vm_page->next = NULL;
-        data_vm_page->prev = NULL;
+        vm_page = MM_REL_PTR_GET(uint8_t, heap->free_region_pages);
+        mm_rel_ptr_t *next_free_page = (mm_rel_ptr_t *)vm_page;
+        MM_REL_PTR_SET(heap->free_region_pages, MM_REL_PTR_GET(uint8_t, *next_free_page));
     }
     else
     {
-        if (data_vm_page->next)
+        if (heap->region_used + units * SYSTEM_PAGE_SIZE > heap->region_size)
         {
-            data_vm_page->next->prev = data_vm_page->prev;
-            data_vm_page->prev->next = data_vm_page->next;
+            return NULL;
         }
+        vm_page = (uint8_t *)heap + heap->region_used;
+        heap->region_used += units * SYSTEM_PAGE_SIZE;
     }
 
-    _mm_release_vm_page((void *)data_vm_page, 1);
+    return (void *)vm_page;
 }
 
 /**
- * @brief Compares two free memory blocks for sorting.
+ * @brief Gives virtual memory pages back to the shared heap mapping.
  *
- * This function compares two free memory blocks for sorting purposes. It compares the data_block_size
- * field of the meta_block_t objects. The function assumes that both input blocks are free (is_free == MM_FREE).
+ * @param vm_page Pointer to the first page to give back.
+ * @param units Number of units (pages) to give back.
+ */
+static void _mm_release_region_pages(void *vm_page, uint32_t units)
+{
+    for (uint32_t i = 0; i < units; i++)
+    {
+        mm_rel_ptr_t *next_free_page = (mm_rel_ptr_t *)((uint8_t *)vm_page + i * SYSTEM_PAGE_SIZE);
+        MM_REL_PTR_SET(*next_free_page, MM_REL_PTR_GET(uint8_t, heap->free_region_pages));
+        MM_REL_PTR_SET(heap->free_region_pages, next_free_page);
+    }
+}
+
+/**
+ * @brief Counts the NUMA nodes the process may place memory on.
  *
- * @param meta_block_A Pointer to the first meta_block_t object.
- * @param meta_block_B Pointer to the second meta_block_t object.
- * @return -1 if the first block has a larger data_block_size, 1 if the second block has a larger data_block_size,
- *         or 0 if both blocks have the same data_block_size.
+ * Kernels without NUMA support fail the query, and the machine is then treated as a single node.
  */
-static int8_t _mm_free_block_comparison(void *meta_block_A, void *meta_block_B)
+static void _mm_numa_init(void)
 {
-    meta_block_t *meta_block_A_ptr = (meta_block_t *)meta_block_A;
-    meta_block_t *meta_block_B_ptr = (meta_block_t *)meta_block_B;
+    unsigned long allowed_nodes[MM_NUMA_MASK_WORDS] = {0};
+    if (syscall(SYS_get_mempolicy, NULL, allowed_nodes, MM_NUMA_MASK_BITS, NULL, MPOL_F_MEMS_ALLOWED) != 0)
+    {
+        mm_numa_node_count = 1;
+        return;
+    }
 
-    assert((meta_block_A_ptr->is_free == MM_FREE) && (meta_block_B_ptr->is_free == MM_FREE));
+    uint32_t node_count = 1;
+    for (uint32_t node = 0; node < MM_NUMA_MAX_NODES; node++)
+    {
+        if (allowed_nodes[node / (8 * sizeof(unsigned long))] & (1UL << (node % (8 * sizeof(unsigned long)))))
+        {
+            node_count = node + 1;
+        }
+    }
+    mm_numa_node_count = node_count;
+}
 
-    if (meta_block_A_ptr->data_block_size > meta_block_B_ptr->data_block_size)
+/**
+ * @brief Finds the NUMA node of the CPU the calling thread runs on.
+ *
+ * @return The node, 0 on a single node machine.
+ */
+static uint32_t _mm_numa_current_node(void)
+{
+    unsigned int cpu = 0;
+    unsigned int node = 0;
+    if (mm_numa_node_count > 1 && syscall(SYS_getcpu, &cpu, &node, NULL) == 0 && node < mm_numa_node_count)
     {
-        return -1;
+        return node;
     }
-    else if (meta_block_A_ptr->data_block_size < meta_block_B_ptr->data_block_size)
+
+    return 0;
+}
+
+/**
+ * @brief Finds the NUMA node a VM page of the private heap is placed on.
+ *
+ * @param vm_page Pointer to a VM page that has been touched.
+ * @return The node, 0 on a single node machine.
+ */
+static uint32_t _mm_numa_node_of_page(void *vm_page)
+{
+    int node = 0;
+    if (mm_numa_node_count > 1 &&
+        syscall(SYS_get_mempolicy, &node, NULL, 0, vm_page, MPOL_F_NODE | MPOL_F_ADDR) == 0 && node >= 0 &&
+        (uint32_t)node < mm_numa_node_count)
     {
-        return 1;
+        return (uint32_t)node;
     }
 
     return 0;
 }
 
 /**
- * @brief Adds free data block meta information to a struct_record_t object.
+ * @brief Asks the kernel to place a range of VM pages on a NUMA node.
  *
- * This function adds free data block meta information to a struct_record_t object by inserting
- * the meta_block_t object into the free_block_priority_list of the struct_record_t. The insertion
- * is done based on priority using the _mm_free_block_comparison function.
+ * The node is preferred rather than bound to, so that the pages still come from another node when it runs out of
+ * memory. The placement is a hint: a failure of the call is ignored.
  *
- * @param record Pointer to the struct_record_t object.
- * @param free_meta_block Pointer to the meta_block_t object representing the free data block.
+ * @param addr Page aligned start of the range.
+ * @param length Length of the range in bytes.
+ * @param node The node.
+ * @param flags 0 to place the pages faulted in later, MPOL_MF_MOVE to also move the pages already faulted in.
  */
-static void _mm_add_free_data_block_meta_info(struct_record_t *record, meta_block_t *free_meta_block)
+static void _mm_numa_place(void *addr, size_t length, int32_t node, unsigned int flags)
 {
-    assert(free_meta_block->is_free == MM_FREE);
+    unsigned long nodes[MM_NUMA_MASK_WORDS] = {0};
+    nodes[(uint32_t)node / (8 * sizeof(unsigned long))] = 1UL << ((uint32_t)node % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, addr, length, MPOL_PREFERRED, nodes, MM_NUMA_MASK_BITS, flags);
+}
 
-    glthread_priority_insert(&record->free_block_priority_list, &free_meta_block->glue_node, _mm_free_block_comparison,
-                             MM_BLOCK_OFFSETOF(meta_block_t, glue_node));
+/**
+ * @brief Picks the NUMA node for the data VM pages of a record.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @return The node of the record if it has one, else the node of the calling thread, which may be MM_NUMA_NODE_ANY.
+ */
+static int32_t _mm_numa_node_of_record(const struct_record_t *record)
+{
+    return (record->numa_node != MM_NUMA_NODE_ANY ? record->numa_node : mm_thread_numa_node);
 }
 
 /**
- * @brief Retrieves the largest free data block from a struct_record_t object.
+ * @brief Requests a virtual memory page.
  *
- * This function retrieves the largest free data block from a struct_record_t object
- * by accessing the head of the free_block_priority_list and converting it to a pointer
- * to the meta_block_t object. The largest free data block is determined based on the
- * priority order defined by the _mm_free_block_comparison function.
+ * This function requests a virtual memory page by mapping it into the process's address space. A single page of the
+ * private heap is taken from the page cache of its NUMA node if it holds one, otherwise a span of pages is mapped and
+ * the pages not returned are put in that page cache. Without a node, the node of the calling thread's CPU is used,
+ * where the kernel places the pages the thread touches first. Pages of a shared heap ignore the node.
  *
- * @param record Pointer to the struct_record_t object.
- * @return Pointer to the largest free meta_block_t object, or NULL if the list is empty.
+ * @param units Number of units (pages) to request.
+ * @param node NUMA node to place the pages on, or MM_NUMA_NODE_ANY.
+ * @return Pointer to the requested virtual memory page, or NULL if the request failed.
  */
-static meta_block_t *_mm_get_largest_free_data_block(struct_record_t *record)
+static void *_mm_request_vm_page(uint32_t units, int32_t node)
 {
-    if(record->free_block_priority_list.head != NULL)
+    uint8_t *vm_page = NULL;
+    /* page cache the pages are taken from and the rest of a span goes to */
+    uint32_t cache_node = (node != MM_NUMA_NODE_ANY ? (uint32_t)node : _mm_numa_current_node());
+
+    if (heap->region_size != 0)
+    {
+        vm_page = _mm_request_region_pages(units);
+        if (vm_page == NULL)
+        {
+            return NULL;
+        }
+    }
+    else if (units == 1 && mm_page_cache[cache_node] != NULL)
     {
-        return (meta_block_t *)(GLTHREAD_BASEOF(record->free_block_priority_list.head,
-                                            MM_BLOCK_OFFSETOF(meta_block_t, glue_node)));
+        vm_page = mm_page_cache[cache_node];
+        mm_page_cache[cache_node] = *(void **)vm_page;
+        mm_page_cache_count[cache_node]--;
     }
     else
     {
-        return NULL;
+        /* single pages are mapped a span at a time, the rest of the span goes to the page cache */
+        uint32_t map_units = (units == 1 ? mm_config.span_pages : units);
+
+        /* the virtual mapping should be done in the heap */
+        vm_page = mmap(sbrk(0), map_units * SYSTEM_PAGE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (vm_page == MAP_FAILED)
+        {
+            return NULL;
+        }
+        if (mm_config.huge_pages)
+        {
+            madvise(vm_page, map_units * SYSTEM_PAGE_SIZE, MADV_HUGEPAGE);
+        }
+        /* placed before any page of the span is touched */
+        if (node != MM_NUMA_NODE_ANY)
+        {
+            _mm_numa_place(vm_page, map_units * SYSTEM_PAGE_SIZE, node, 0);
+        }
+        for (uint32_t i = map_units - 1; i >= units; i--)
+        {
+            void *spare_page = vm_page + i * SYSTEM_PAGE_SIZE;
+            *(void **)spare_page = mm_page_cache[cache_node];
+            mm_page_cache[cache_node] = spare_page;
+            mm_page_cache_count[cache_node]++;
+        }
     }
+    memset(vm_page, 0, units * SYSTEM_PAGE_SIZE);
+
+    return (void *)vm_page;
 }
 
 /**
- * @brief Binds meta blocks after splitting.
+ * @brief Releases a virtual memory page.
  *
- * This function binds meta blocks after splitting. It updates the next and prev pointers of the
- * allocated meta block and the free meta block to maintain the correct linkage. If the allocated
- * meta block has a next block, it updates the next block's prev pointer to point to the free meta
- * block. Finally, it updates the next and prev pointers of the allocated and free meta blocks.
+ * This function releases a virtual memory page by unmapping it from the process's address space. A single page of
+ * the private heap is kept in the page cache of its NUMA node instead while that cache holds fewer pages than
+ * configured.
  *
- * @param allocated_meta_block Pointer to the allocated meta block.
- * @param free_meta_block Pointer to the free meta block.
+ * @param vm_page Pointer to the virtual memory page to release.
+ * @param units Number of units (pages) to release.
+ * @return 0 if the page was successfully released, -1 otherwise.
  */
-static void _mm_bind_blocks_after_splitting(meta_block_t *allocated_meta_block, meta_block_t *free_meta_block)
+static int8_t _mm_release_vm_page(void *vm_page, uint32_t units)
 {
-    free_meta_block->next = allocated_meta_block->next;
-    free_meta_block->prev = allocated_meta_block;
-    if (allocated_meta_block->next)
+    if (heap->region_size != 0)
+    {
+        _mm_release_region_pages(vm_page, units);
+        return 0;
+    }
+
+    if (units == 1)
     {
-        allocated_meta_block->next->prev = free_meta_block;
+        uint32_t node = _mm_numa_node_of_page(vm_page);
+        if (mm_page_cache_count[node] < mm_config.page_cache_pages)
+        {
+            *(void **)vm_page = mm_page_cache[node];
+            mm_page_cache[node] = vm_page;
+            mm_page_cache_count[node]++;
+            return 0;
+        }
     }
-    allocated_meta_block->next = free_meta_block;
+
+    return munmap(vm_page, units * SYSTEM_PAGE_SIZE);
 }
 
 /**
- * @brief Splits a free data block for allocation.
- *
- * This function splits a free data block for allocation. It first checks if the meta block is free,
- * and if not, it asserts an error. It then checks if the requested size exceeds the available size
- * in the data block, and if so, returns false to indicate that the allocation cannot be done. If the
- * requested size can be accommodated, the function splits the free data block based on the remaining size.
- * There are four possible cases: no splitting, partial splitting with soft internal fragmentation, partial
- * splitting with hard internal fragmentation, and full splitting. In each case, the function updates the
- * meta block information, adds the free meta block to the meta block list, and binds the blocks after splitting.
- * Finally, it returns true to indicate successful splitting and allocation.
+ * @brief Initializes a struct record.
  *
- * @param record Pointer to the structure record.
- * @param meta_block_info Pointer to the meta block information.
- * @param req_size The requested size of the data block to allocate.
- * @return True if the splitting and allocation were successful, false otherwise.
+ * @param record Pointer to the struct_record_t object to initialize.
+ * @param struct_name The name of the struct.
+ * @param size The size of the struct.
+ * @param flags MM_RECORD_* flags of the struct.
  */
-static bool _mm_split_free_data_block_for_allocation(struct_record_t *record, meta_block_t *meta_block_info,
-                                                     uint32_t req_size)
+static void _mm_init_struct_record(struct_record_t *record, const char *struct_name, size_t size, uint32_t flags)
 {
-    assert(meta_block_info->is_free == MM_FREE);
-
-    meta_block_t *next_meta_block_info = NULL;
+    strncpy(record->struct_name, struct_name, MM_MAX_STRUCT_NAME_SIZE);
+    record->size = size;
+    record->flags = flags;
+    record->next_color = 0;
+    record->numa_node = MM_NUMA_NODE_ANY;
+    record->first_page = 0;
+    record->buddy_runs = 0;
+    glthread_init(&record->free_block_priority_list);
+    record->side_table_pages = 0;
+    record->partial_side_table_entries = 0;
+    record->unused_side_table_entries = 0;
+    record->soa_layout = 0;
+    record->handle_directory = 0;
+    record->handle_count = 0;
+    record->free_handles = 0;
+    glthread_init(&record->constructed_objects);
+    record->object_ctor = NULL;
+    record->object_dtor = NULL;
+    record->object_ctor_arg = NULL;
+    record->object_ctor_owner = 0;
+    record->relocation_callback = NULL;
+    record->relocation_arg = NULL;
+    record->relocation_owner = 0;
+    record->budget_used = 0;
+    record->budget_limit = 0;
+    record->budget_pressure = 0;
+    record->budget_callback = NULL;
+    record->budget_arg = NULL;
+    record->budget_owner = 0;
+}
 
-    /* memory allocation request cannot be done as requested size is greater than available size in the data block */
-    if (meta_block_info->data_block_size < req_size)
+/**
+ * @brief Looks up a struct_record_t object by struct name in the current heap.
+ *
+ * This function searches for a struct_record_t object with a matching struct name
+ * within the linked list of struct records. It iterates through the list of vm_page_for_struct_records_t
+ * objects to find the desired record. If a matching record is found, it is returned.
+ *
+ * @param struct_name Pointer to the struct name to search for.
+ * @return Pointer to the matching struct_record_t object, or NULL if not found.
+ */
+static struct_record_t *_mm_find_struct_record_in_heap(const char *struct_name)
+{
+    vm_page_for_struct_records_t *vm_page_record = NULL;
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_BEGIN(heap, vm_page_record)
     {
-        return false;
+        struct_record_t *record = NULL;
+        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
+        {
+            if (strncmp(record->struct_name, struct_name, MM_MAX_STRUCT_NAME_SIZE) == 0)
+            {
+                return record;
+            }
+        }
+        MM_ITERATE_STRUCT_RECORDS_END;
     }
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_END;
 
-    uint32_t remaining_size = meta_block_info->data_block_size - req_size;
+    return NULL;
+}
 
-    meta_block_info->is_free = MM_ALLOCATED;
-    meta_block_info->data_block_size = req_size;
-    /* remove the meta block from the priority queue */
-    glthread_remove_node(&record->free_block_priority_list, &meta_block_info->glue_node);
+/**
+ * @brief Appends a struct record to the record VM pages without checking whether its name is taken.
+ *
+ * The heap lock must be held.
+ *
+ * @param struct_name The name of the struct.
+ * @param size The size of the struct.
+ * @param flags MM_RECORD_* flags of the struct.
+ * @param new_record Filled with the new struct record.
+ * @return 0 if the struct record is added, -3 if no VM page could be obtained.
+ */
+static int8_t _mm_append_struct_record(const char *struct_name, size_t size, uint32_t flags,
+                                       struct_record_t **new_record)
+{
+    /* new VM pages are added at the head of the list, so only the head can have a free slot */
+    vm_page_for_struct_records_t *vm_page_record =
+        MM_REL_PTR_GET(vm_page_for_struct_records_t, heap->vm_page_record_head);
+    uint32_t count = 0;
+    struct_record_t *record = NULL;
+    if (vm_page_record != NULL)
+    {
+        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
+        {
+            count++;
+        }
+        MM_ITERATE_STRUCT_RECORDS_END;
+    }
 
-    if (remaining_size == 0) /* case 1: no splitting */
+    if (vm_page_record == NULL || count == MM_MAX_RECORDS_PER_VM_PAGE)
     {
-        return true;
+        /* allocating a VM page for the first time, or the previous VM page is full */
+        vm_page_for_struct_records_t *new_vm_page_record =
+            (vm_page_for_struct_records_t *)_mm_request_vm_page(1, MM_NUMA_NODE_ANY);
+        if (new_vm_page_record == NULL)
+        {
+            return -3;
+        }
+        MM_REL_PTR_SET(new_vm_page_record->next, vm_page_record);
+        MM_REL_PTR_SET(heap->vm_page_record_head, new_vm_page_record);
+        /* the record to be added will be the first record in the new VM page */
+        record = new_vm_page_record->struct_record_list;
     }
-    else if (sizeof(meta_block_t) < remaining_size &&
-             remaining_size <
-                 sizeof(meta_block_t) + record->size) /* case 2: partial splitting [soft internal fragmentation] */
+    else
     {
-        next_meta_block_info = MM_NEXT_META_BLOCK_BY_SIZE(meta_block_info);
-        next_meta_block_info->is_free = MM_FREE;
-        next_meta_block_info->data_block_size = remaining_size - sizeof(meta_block_t);
-        next_meta_block_info->offset =
-            meta_block_info->offset + sizeof(meta_block_t) + meta_block_info->data_block_size;
-        _mm_add_free_data_block_meta_info(record, next_meta_block_info);
-        _mm_bind_blocks_after_splitting(meta_block_info, next_meta_block_info);
+        record = &vm_page_record->struct_record_list[count];
     }
-    else if (remaining_size < sizeof(meta_block_t)) /* case 3: partial splitting [hard internal fragmentation] */
+
+    _mm_init_struct_record(record, struct_name, size, flags);
+    *new_record = record;
+
+    return 0;
+}
+
+/**
+ * @brief Creates the record of a struct defined at compile time in the current heap, unless it is there already.
+ *
+ * The first time a record of the linker section is used in the private heap it is appended without looking for its
+ * name: every path that adds a record by name looks through the defined records first, and the linker rejects two
+ * definitions of one struct. A mapped heap may have got the record from another process, and a definition outside of
+ * the section, such as the one of an mm::type_record, may share its name with a registered record, so these are
+ * looked up first.
+ *
+ * The heap lock must be held.
+ *
+ * @param static_record Pointer to the record definition.
+ * @return Pointer to the struct_record_t object, or NULL if the struct does not fit in a VM page, a mapped heap holds
+ *         a record of the same name and another size, or no VM page could be obtained.
+ */
+static struct_record_t *_mm_materialize_static_record(mm_static_record_t *static_record)
+{
+    if (static_record->heap_epoch == heap_epoch)
     {
-        /* no action required */
+        return (struct_record_t *)static_record->record;
     }
-    else /* case 4: full split [same as case 2] */
+    if (static_record->size > SYSTEM_PAGE_SIZE)
     {
-        next_meta_block_info = MM_NEXT_META_BLOCK_BY_SIZE(meta_block_info);
-        next_meta_block_info->is_free = MM_FREE;
-        next_meta_block_info->data_block_size = remaining_size - sizeof(meta_block_t);
-        next_meta_block_info->offset =
-            meta_block_info->offset + sizeof(meta_block_t) + meta_block_info->data_block_size;
-        _mm_add_free_data_block_meta_info(record, next_meta_block_info);
-        _mm_bind_blocks_after_splitting(meta_block_info, next_meta_block_info);
+        return NULL;
     }
 
-    return true;
+    struct_record_t *record = NULL;
+    bool in_section = (static_record >= __start_mm_static_records && static_record < __stop_mm_static_records);
+    if (!in_section || static_record->heap_epoch != 0 || heap != &mm_private_heap)
+    {
+        record = _mm_find_struct_record_in_heap(static_record->struct_name);
+        if (record != NULL && record->size != static_record->size)
+        {
+            return NULL;
+        }
+    }
+    if (record == NULL && _mm_append_struct_record(static_record->struct_name, static_record->size,
+                                                   static_record->flags & ~MM_RECORD_STRUCT_OF_ARRAYS, &record) != 0)
+    {
+        return NULL;
+    }
+
+    static_record->heap_epoch = heap_epoch;
+    static_record->record = (mm_record_t *)record;
+
+    return record;
 }
 
 /**
- * @brief Allocates a free data block for a given structure record.
+ * @brief Looks up a struct_record_t object by struct name.
  *
- * This function allocates a free data block for a given structure record. It first checks if there
- * is a free data block with sufficient size in the record. If not, it adds a new page for the record
- * and allocates memory from the free data block of the newly added VM data page. If there is a free data
- * block with sufficient size, it allocates memory from the largest data block in the priority queue.
- * The function splits the free data block for allocation and returns a pointer to the allocated data
- * block. If allocation fails, it returns NULL.
+ * Records defined with MM_DEFINE_STRUCT_RECORD that are not in the current heap yet are created when they are first
+ * looked up, so they are found by name like registered ones.
  *
- * @param record Pointer to the structure record.
- * @param req_size The requested size of the data block to allocate.
- * @return A pointer to the allocated meta_block_t data block, or NULL if allocation fails.
+ * @param struct_name Pointer to the struct name to search for.
+ * @return Pointer to the matching struct_record_t object, or NULL if not found.
  */
-static meta_block_t *_mm_allocate_free_data_block(struct_record_t *record, uint32_t req_size)
+static struct_record_t *_mm_lookup_struct_record_by_name(const char *struct_name)
 {
-    vm_page_for_data_t *data_vm_page = NULL;
+    struct_record_t *record = _mm_find_struct_record_in_heap(struct_name);
+    if (record != NULL)
+    {
+        return record;
+    }
 
-    meta_block_t *largest_free_meta_block = _mm_get_largest_free_data_block(record);
-    if (largest_free_meta_block == NULL || largest_free_meta_block->data_block_size < req_size)
+    for (mm_static_record_t *static_record = __start_mm_static_records; static_record < __stop_mm_static_records;
+         static_record++)
     {
-        /* add a new page for this record */
-        data_vm_page = mm_allocate_data_vm_page(record);
+        if (strncmp(static_record->struct_name, struct_name, MM_MAX_STRUCT_NAME_SIZE) == 0)
+        {
+            return _mm_materialize_static_record(static_record);
+        }
+    }
 
-        /* allocate memory from the free data block of the newly added VM data page */
-        bool status = _mm_split_free_data_block_for_allocation(record, &data_vm_page->meta_block_info, req_size);
+    return NULL;
+}
+
+/**
+ * @brief Merges two free memory blocks into a single block.
+ *
+ * This function merges two free memory blocks into a single block. The function assumes
+ * that both input blocks are free (is_free == MM_FREE). It updates the data_block_size,
+ * next, and prev fields of the first block to incorporate the second block into a single block.
+ *
+ * @param first Pointer to the first meta_block_t object.
+ * @param second Pointer to the second meta_block_t object.
+ */
+static void _mm_merge_free_blocks(meta_block_t *first, meta_block_t *second)
+{
+    assert((first->is_free == MM_FREE) && (second->is_free == MM_FREE));
 
-        return (status ? &data_vm_page->meta_block_info : NULL);
+    meta_block_t *next_meta_block = MM_NEXT_META_BLOCK(second);
+
+    first->data_block_size += sizeof(meta_block_t) + second->data_block_size;
+    MM_REL_PTR_SET(first->next, next_meta_block);
+    if (next_meta_block != NULL)
+    {
+        MM_REL_PTR_SET(next_meta_block->prev, first);
+    }
+}
+
+/**
+ * @brief Checks if a data virtual memory page is empty.
+ *
+ * This function checks if a data virtual memory page is empty by examining its meta_block_info
+ * fields, including next, prev, and is_free. The padding block in front of the first object of a colored page is
+ * skipped.
+ *
+ * @param data_vm_page Pointer to the vm_page_for_data_t object to check.
+ * @return MM_FREE if the page is empty, MM_ALLOCATED otherwise.
+ */
+static vm_bool_t _mm_is_data_vm_page_empty(vm_page_for_data_t *data_vm_page)
+{
+    meta_block_t *first_block = &data_vm_page->meta_block_info;
+    if (first_block->is_free == MM_PADDING)
+    {
+        first_block = MM_NEXT_META_BLOCK(first_block);
+    }
+
+    if (first_block != NULL && first_block->next == 0 && first_block->is_free == MM_FREE)
+    {
+        return MM_FREE;
+    }
+
+    return MM_ALLOCATED;
+}
+
+/**
+ * @brief Calculates the maximum amount of virtual memory page memory available.
+ *
+ * This function calculates the maximum amount of virtual memory page memory available,
+ * taking into account the system page size and the offset of the page memory within
+ * the vm_page_for_data_t structure.
+ *
+ * @param units Number of units to calculate memory for.
+ * @return Maximum memory available for the specified number of units, in bytes.
+ */
+static uint32_t _mm_max_vm_page_memory_available(uint32_t units)
+{
+    return (uint32_t)((SYSTEM_PAGE_SIZE * units) - MM_BLOCK_OFFSETOF(vm_page_for_data_t, page_memory));
+}
+
+/**
+ * @brief Deletes and frees a data virtual memory page.
+ *
+ * This function deletes and frees a data virtual memory page. It removes the page from the associated struct_record_t's
+ * page list and releases the virtual memory page using `_mm_release_vm_page`.
+ *
+ * @param data_vm_page Pointer to the data virtual memory page to delete and free.
+ */
+static void _mm_delete_and_free_data_vm_page(vm_page_for_data_t *data_vm_page)
+{
+    struct_record_t *record = MM_DATA_VM_PAGE_RECORD(data_vm_page);
+    vm_page_for_data_t *prev_page = MM_PREV_DATA_VM_PAGE(data_vm_page);
+    vm_page_for_data_t *next_page = MM_NEXT_DATA_VM_PAGE(data_vm_page);
+
+    if (prev_page == NULL)
+    {
+        MM_REL_PTR_SET(record->first_page, next_page);
     }
     else
     {
-        /* allocate memory from the largest data block from the priority queue */
-        bool status = _mm_split_free_data_block_for_allocation(record, largest_free_meta_block, req_size);
+        MM_REL_PTR_SET(prev_page->next, next_page);
+    }
+    if (next_page != NULL)
+    {
+        MM_REL_PTR_SET(next_page->prev, prev_page);
+    }
 
-        return (status ? largest_free_meta_block : NULL);
+    _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE);
+    _mm_release_vm_page((void *)data_vm_page, 1);
+}
+
+/**
+ * @brief Compares two free memory blocks for sorting.
+ *
+ * This function compares two free memory blocks for sorting purposes. It compares the data_block_size
+ * field of the meta_block_t objects. The function assumes that both input blocks are free (is_free == MM_FREE).
+ *
+ * @param meta_block_A Pointer to the first meta_block_t object.
+ * @param meta_block_B Pointer to the second meta_block_t object.
+ * @return -1 if the first block has a larger data_block_size, 1 if the second block has a larger data_block_size,
+ *         or 0 if both blocks have the same data_block_size.
+ */
+static int8_t _mm_free_block_comparison(void *meta_block_A, void *meta_block_B)
+{
+    meta_block_t *meta_block_A_ptr = (meta_block_t *)meta_block_A;
+    meta_block_t *meta_block_B_ptr = (meta_block_t *)meta_block_B;
+
+    assert((meta_block_A_ptr->is_free == MM_FREE) && (meta_block_B_ptr->is_free == MM_FREE));
+
+    if (meta_block_A_ptr->data_block_size > meta_block_B_ptr->data_block_size)
+    {
+        return -1;
+    }
+    else if (meta_block_A_ptr->data_block_size < meta_block_B_ptr->data_block_size)
+    {
+        return 1;
     }
+
+    return 0;
 }
 
 /**
- * @brief Calculates the size of hard internal fragmentation between two meta blocks.
+ * @brief Adds free data block meta information to a struct_record_t object.
  *
- * This function calculates the size of hard internal fragmentation between two meta blocks. It takes two meta block
- * pointers, `first` and `second`, and calculates the size by subtracting the address of the next meta block from the
- * address of the second meta block. It returns the size of hard internal fragmentation as a `uint32_t` value.
+ * This function adds free data block meta information to a struct_record_t object by inserting
+ * the meta_block_t object into the free_block_priority_list of the struct_record_t. The insertion
+ * is done based on priority using the _mm_free_block_comparison function.
  *
- * @param first Pointer to the first meta block.
- * @param second Pointer to the second meta block.
- * @return The size of hard internal fragmentation between the two meta blocks.
+ * @param record Pointer to the struct_record_t object.
+ * @param free_meta_block Pointer to the meta_block_t object representing the free data block.
  */
-static uint32_t _mm_get_hard_internal_frag_size(meta_block_t *first, meta_block_t *second)
+static void _mm_add_free_data_block_meta_info(struct_record_t *record, meta_block_t *free_meta_block)
 {
-    meta_block_t *next_meta_block = MM_NEXT_META_BLOCK_BY_SIZE(first);
-    return (uint32_t)((uint8_t *)second - (uint8_t *)next_meta_block);
+    assert(free_meta_block->is_free == MM_FREE);
+
+    glthread_priority_insert(&record->free_block_priority_list, &free_meta_block->glue_node, _mm_free_block_comparison,
+                             MM_BLOCK_OFFSETOF(meta_block_t, glue_node));
 }
 
 /**
- * @brief Frees a data block and performs block merging if possible.
+ * @brief Retrieves the largest free data block from a struct_record_t object.
  *
- * This function frees a data block specified by the `app_data_meta_block` pointer. It marks the block as free by setting
- * its `is_free` field to `MM_FREE`. It then checks if the freed block is followed by another free block (`next_meta_block`)
- * or if it is the last block in the VM page. In case 1, it merges the freed block with the next free block, and in case 2,
- * it calculates the size of hard internal fragmentation by subtracting the end of the freed block from the end of the VM
- * page. The function performs block merging with the previous free block (`prev_meta_block`) if applicable.
+ * This function retrieves the largest free data block from a struct_record_t object
+ * by accessing the head of the free_block_priority_list and converting it to a pointer
+ * to the meta_block_t object. The largest free data block is determined based on the
+ * priority order defined by the _mm_free_block_comparison function.
  *
- * After merging, the function checks if the data VM page becomes empty. If it does, the data VM page is deleted and freed.
- * Finally, the merged meta block is added to the free meta block priority queue.
+ * @param record Pointer to the struct_record_t object.
+ * @return Pointer to the largest free meta_block_t object, or NULL if the list is empty.
+ */
+static meta_block_t *_mm_get_largest_free_data_block(struct_record_t *record)
+{
+    glthread_node_t *head = GLTHREAD_HEAD(&record->free_block_priority_list);
+    if(head != NULL)
+    {
+        return (meta_block_t *)(GLTHREAD_BASEOF(head, MM_BLOCK_OFFSETOF(meta_block_t, glue_node)));
+    }
+    else
+    {
+        return NULL;
+    }
+}
+
+/**
+ * @brief Binds meta blocks after splitting.
+ *
+ * This function binds meta blocks after splitting. It updates the next and prev pointers of the
+ * allocated meta block and the free meta block to maintain the correct linkage. If the allocated
+ * meta block has a next block, it updates the next block's prev pointer to point to the free meta
+ * block. Finally, it updates the next and prev pointers of the allocated and free meta blocks.
+ *
+ * @param allocated_meta_block Pointer to the allocated meta block.
+ * @param free_meta_block Pointer to the free meta block.
+ */
+static void _mm_bind_blocks_after_splitting(meta_block_t *allocated_meta_block, meta_block_t *free_meta_block)
+{
+    meta_block_t *next_meta_block = MM_NEXT_META_BLOCK(allocated_meta_block);
+
+    MM_REL_PTR_SET(free_meta_block->next, next_meta_block);
+    MM_REL_PTR_SET(free_meta_block->prev, allocated_meta_block);
+    if (next_meta_block)
+    {
+        MM_REL_PTR_SET(next_meta_block->prev, free_meta_block);
+    }
+    MM_REL_PTR_SET(allocated_meta_block->next, free_meta_block);
+}
+
+/**
+ * @brief Splits a free data block for allocation.
+ *
+ * This function splits a free data block for allocation. It first checks if the meta block is free,
+ * and if not, it asserts an error. It then checks if the requested size exceeds the available size
+ * in the data block, and if so, returns false to indicate that the allocation cannot be done. If the
+ * requested size can be accommodated, the function splits the free data block based on the remaining size.
+ * There are four possible cases: no splitting, partial splitting with soft internal fragmentation, partial
+ * splitting with hard internal fragmentation, and full splitting. In each case, the function updates the
+ * meta block information, binds the blocks after splitting and adds the free meta block to the priority queue.
+ * Finally, it returns true to indicate successful splitting and allocation.
+ *
+ * @param record Pointer to the structure record.
+ * @param meta_block_info Pointer to the meta block information.
+ * @param req_size The requested size of the data block to allocate.
+ * @return True if the splitting and allocation were successful, false otherwise.
+ */
+static bool _mm_split_free_data_block_for_allocation(struct_record_t *record, meta_block_t *meta_block_info,
+                                                     uint32_t req_size)
+{
+    assert(meta_block_info->is_free == MM_FREE);
+
+    meta_block_t *next_meta_block_info = NULL;
+
+    /* memory allocation request cannot be done as requested size is greater than available size in the data block */
+    if (meta_block_info->data_block_size < req_size)
+    {
+        return false;
+    }
+
+    uint32_t remaining_size = meta_block_info->data_block_size - req_size;
+
+    meta_block_info->is_free = MM_ALLOCATED;
+    meta_block_info->data_block_size = req_size;
+    /* remove the meta block from the priority queue */
+    glthread_remove_node(&record->free_block_priority_list, &meta_block_info->glue_node);
+
+    if (remaining_size == 0) /* case 1: no splitting */
+    {
+        return true;
+    }
+    else if (sizeof(meta_block_t) < remaining_size &&
+             remaining_size <
+                 sizeof(meta_block_t) + record->size) /* case 2: partial splitting [soft internal fragmentation] */
+    {
+        next_meta_block_info = MM_NEXT_META_BLOCK_BY_SIZE(meta_block_info);
+        next_meta_block_info->is_free = MM_FREE;
+        next_meta_block_info->data_block_size = remaining_size - sizeof(meta_block_t);
+        next_meta_block_info->offset =
+            meta_block_info->offset + sizeof(meta_block_t) + meta_block_info->data_block_size;
+        _mm_bind_blocks_after_splitting(meta_block_info, next_meta_block_info);
+        _mm_add_free_data_block_meta_info(record, next_meta_block_info);
+    }
+    else if (remaining_size < sizeof(meta_block_t)) /* case 3: partial splitting [hard internal fragmentation] */
+    {
+        /* no action required */
+    }
+    else /* case 4: full split [same as case 2] */
+    {
+        next_meta_block_info = MM_NEXT_META_BLOCK_BY_SIZE(meta_block_info);
+        next_meta_block_info->is_free = MM_FREE;
+        next_meta_block_info->data_block_size = remaining_size - sizeof(meta_block_t);
+        next_meta_block_info->offset =
+            meta_block_info->offset + sizeof(meta_block_t) + meta_block_info->data_block_size;
+        _mm_bind_blocks_after_splitting(meta_block_info, next_meta_block_info);
+        _mm_add_free_data_block_meta_info(record, next_meta_block_info);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Picks the color of a new data VM page of a record.
+ *
+ * Colors go round in steps of MM_CACHE_COLOR_ALIGN bytes over the slack of the page, so that the page holds as many
+ * objects as without coloring.
+ *
+ * @param record Pointer to the struct_record_t object getting the page.
+ * @param slack Bytes the page leaves unused after its last object.
+ * @return Number of bytes to move the first object of the page by.
+ */
+static uint32_t _mm_next_cache_color(struct_record_t *record, uint32_t slack)
+{
+    if (!mm_config.cache_coloring)
+    {
+        return 0;
+    }
+
+    return (record->next_color++ % (slack / MM_CACHE_COLOR_ALIGN + 1)) * MM_CACHE_COLOR_ALIGN;
+}
+
+/**
+ * @brief Allocates a virtual memory page for data.
+ *
+ * This function allocates a virtual memory page for data and initializes its fields. When the page is colored, its
+ * header meta block becomes a padding block in front of the block the first object goes to. The padding block is
+ * marked MM_PADDING and kept off the free block list: it is too small for any object of the record, since the color
+ * stays within the slack of the page.
+ *
+ * @param record Pointer to the struct_record_t object associated with the data page.
+ * @param req_size Size of the allocation the page is added for.
+ * @return Pointer to the free meta block to allocate from, or NULL if no VM page could be obtained.
+ */
+static meta_block_t *mm_allocate_data_vm_page(struct_record_t *record, uint32_t req_size)
+{
+    if (!_mm_budget_charge(record, SYSTEM_PAGE_SIZE))
+    {
+        return NULL;
+    }
+
+    vm_page_for_data_t *data_vm_page = (vm_page_for_data_t *)_mm_request_vm_page(1, _mm_numa_node_of_record(record));
+    if (data_vm_page == NULL)
+    {
+        _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE);
+        return NULL;
+    }
+
+    MM_MARK_DATA_VM_PAGE_FREE(data_vm_page);
+
+    data_vm_page->meta_block_info.data_block_size = _mm_max_vm_page_memory_available(1);
+    data_vm_page->meta_block_info.offset = MM_BLOCK_OFFSETOF(vm_page_for_data_t, meta_block_info);
+    data_vm_page->next = 0;
+    data_vm_page->prev = 0;
+    MM_REL_PTR_SET(data_vm_page->record, record);
+    data_vm_page->layout = MM_PAGE_LAYOUT_IN_BAND;
+    data_vm_page->compaction_live_bytes = 0;
+    data_vm_page->compaction_draining = 0;
+    data_vm_page->color_offset = 0;
+    glthread_init_node(&data_vm_page->meta_block_info.glue_node);
+
+    vm_page_for_data_t *first_page = MM_FIRST_DATA_VM_PAGE(record);
+    if (first_page != NULL)
+    {
+        MM_REL_PTR_SET(data_vm_page->next, first_page);
+        MM_REL_PTR_SET(first_page->prev, data_vm_page);
+    }
+    MM_REL_PTR_SET(record->first_page, data_vm_page);
+
+    /* the blocks of the page start at the header meta block, and each object takes a meta block of its own */
+    uint32_t avail = data_vm_page->meta_block_info.data_block_size;
+    uint32_t block_size = (uint32_t)(sizeof(meta_block_t) + record->size);
+    uint32_t slack = (avail + (uint32_t)sizeof(meta_block_t)) % block_size;
+    uint32_t color = _mm_next_cache_color(record, slack);
+    if (color == 0 || color > avail - req_size)
+    {
+        return &data_vm_page->meta_block_info;
+    }
+
+    meta_block_t *colored_meta_block = (meta_block_t *)(data_vm_page->page_memory + color - sizeof(meta_block_t));
+    colored_meta_block->is_free = MM_FREE;
+    colored_meta_block->data_block_size = avail - color;
+    colored_meta_block->offset = data_vm_page->meta_block_info.offset + color;
+    glthread_init_node(&colored_meta_block->glue_node);
+    data_vm_page->meta_block_info.is_free = MM_PADDING;
+    data_vm_page->meta_block_info.data_block_size = color - (uint32_t)sizeof(meta_block_t);
+    _mm_bind_blocks_after_splitting(&data_vm_page->meta_block_info, colored_meta_block);
+    data_vm_page->color_offset = color;
+
+    return colored_meta_block;
+}
+
+/**
+ * @brief Allocates a free data block for a given structure record.
+ *
+ * This function allocates a free data block for a given structure record. It first checks if there
+ * is a free data block with sufficient size in the record. If not, it adds a new page for the record
+ * and allocates memory from the free data block of the newly added VM data page. If there is a free data
+ * block with sufficient size, it allocates memory from the largest data block in the priority queue.
+ * The function splits the free data block for allocation and returns a pointer to the allocated data
+ * block. If allocation fails, it returns NULL.
+ *
+ * @param record Pointer to the structure record.
+ * @param req_size The requested size of the data block to allocate.
+ * @return A pointer to the allocated meta_block_t data block, or NULL if allocation fails.
+ */
+static meta_block_t *_mm_allocate_free_data_block(struct_record_t *record, uint32_t req_size)
+{
+    meta_block_t *largest_free_meta_block = _mm_get_largest_free_data_block(record);
+    if (largest_free_meta_block == NULL || largest_free_meta_block->data_block_size < req_size)
+    {
+        /* add a new page for this record */
+        meta_block_t *free_meta_block = mm_allocate_data_vm_page(record, req_size);
+        if (free_meta_block == NULL)
+        {
+            return NULL;
+        }
+
+        /* allocate memory from the free data block of the newly added VM data page */
+        bool status = _mm_split_free_data_block_for_allocation(record, free_meta_block, req_size);
+
+        return (status ? free_meta_block : NULL);
+    }
+    else
+    {
+        /* allocate memory from the largest data block from the priority queue */
+        bool status = _mm_split_free_data_block_for_allocation(record, largest_free_meta_block, req_size);
+
+        return (status ? largest_free_meta_block : NULL);
+    }
+}
+
+/**
+ * @brief Calculates the size of hard internal fragmentation between two meta blocks.
+ *
+ * This function calculates the size of hard internal fragmentation between two meta blocks. It takes two meta block
+ * pointers, `first` and `second`, and calculates the size by subtracting the address of the next meta block from the
+ * address of the second meta block. It returns the size of hard internal fragmentation as a `uint32_t` value.
+ *
+ * @param first Pointer to the first meta block.
+ * @param second Pointer to the second meta block.
+ * @return The size of hard internal fragmentation between the two meta blocks.
+ */
+static uint32_t _mm_get_hard_internal_frag_size(meta_block_t *first, meta_block_t *second)
+{
+    meta_block_t *next_meta_block = MM_NEXT_META_BLOCK_BY_SIZE(first);
+    return (uint32_t)((uint8_t *)second - (uint8_t *)next_meta_block);
+}
+
+/**
+ * @brief Frees a data block and performs block merging if possible.
+ *
+ * This function frees a data block specified by the `app_data_meta_block` pointer. It marks the block as free by setting
+ * its `is_free` field to `MM_FREE`. It then checks if the freed block is followed by another free block (`next_meta_block`)
+ * or if it is the last block in the VM page. In case 1, it merges the freed block with the next free block, and in case 2,
+ * it calculates the size of hard internal fragmentation by subtracting the end of the freed block from the end of the VM
+ * page. The function performs block merging with the previous free block (`prev_meta_block`) if applicable. Free
+ * neighbours are taken off the free meta block priority queue before they are merged.
+ *
+ * After merging, the function checks if the data VM page becomes empty. If it does, the data VM page is deleted and freed.
+ * Finally, the merged meta block is added to the free meta block priority queue.
+ *
+ * @param app_data_meta_block Pointer to the meta block of the data block to be freed.
+ */
+static void _mm_free_data_block(meta_block_t *app_data_meta_block)
+{
+    vm_page_for_data_t *hosting_data_vm_page = (vm_page_for_data_t *)MM_GET_PAGE_FROM_META_BLOCK(app_data_meta_block);
+
+    app_data_meta_block->is_free = MM_FREE;
+
+    meta_block_t *next_meta_block = MM_NEXT_META_BLOCK(app_data_meta_block);
+    if(next_meta_block != NULL)     /* case 1: if the meta block is not the last block in the VM page, also handling hard IF memory if present */
+    {
+        app_data_meta_block->data_block_size += _mm_get_hard_internal_frag_size(app_data_meta_block, next_meta_block);
+    }
+    else    /* case 2: if the meta block is the last block in the VM page, also handling hard IF memory if present */
+    {
+        uint8_t *data_vm_page_end = (uint8_t *)((uint8_t *)hosting_data_vm_page + SYSTEM_PAGE_SIZE);
+        uint8_t *app_data_block_end = (uint8_t *)app_data_meta_block + sizeof(meta_block_t) + app_data_meta_block->data_block_size;
+        app_data_meta_block->data_block_size += (uint32_t)((uintptr_t)((void *)data_vm_page_end) - (uintptr_t)((void *)app_data_block_end));
+    }
+
+    meta_block_t *final_merged_meta_block = app_data_meta_block;
+
+    struct_record_t *record = MM_DATA_VM_PAGE_RECORD(hosting_data_vm_page);
+
+    /* perform block merging */
+    if(next_meta_block != NULL && next_meta_block->is_free == MM_FREE)
+    {
+        glthread_remove_node(&record->free_block_priority_list, &next_meta_block->glue_node);
+        _mm_merge_free_blocks(app_data_meta_block, next_meta_block);
+    }
+
+    meta_block_t *prev_meta_block = MM_PREV_META_BLOCK(app_data_meta_block);
+    if(prev_meta_block != NULL && prev_meta_block->is_free == MM_FREE)
+    {
+        glthread_remove_node(&record->free_block_priority_list, &prev_meta_block->glue_node);
+        _mm_merge_free_blocks(prev_meta_block, app_data_meta_block);
+        final_merged_meta_block = prev_meta_block;
+    }
+
+    /* check if the data VM page empty */
+    if(_mm_is_data_vm_page_empty(hosting_data_vm_page) == MM_FREE)
+    {
+        _mm_delete_and_free_data_vm_page(hosting_data_vm_page);
+        return;
+    }
+
+    /* add the final meta block to the free meta block PQ */
+    _mm_add_free_data_block_meta_info(record, final_merged_meta_block);
+}
+
+/**
+ * @brief Adds a side table entry at the head of a list of side table entries.
+ *
+ * @param list_head Pointer to the self-relative head of the list.
+ * @param entry Pointer to the side_table_entry_t object to add.
+ */
+static void _mm_side_table_list_add(mm_rel_ptr_t *list_head, side_table_entry_t *entry)
+{
+    side_table_entry_t *head = MM_REL_PTR_GET(side_table_entry_t, *list_head);
+
+    entry->prev = 0;
+    MM_REL_PTR_SET(entry->next, head);
+    if (head != NULL)
+    {
+        MM_REL_PTR_SET(head->prev, entry);
+    }
+    MM_REL_PTR_SET(*list_head, entry);
+}
+
+/**
+ * @brief Removes a side table entry from a list of side table entries.
+ *
+ * @param list_head Pointer to the self-relative head of the list.
+ * @param entry Pointer to the side_table_entry_t object to remove.
+ */
+static void _mm_side_table_list_remove(mm_rel_ptr_t *list_head, side_table_entry_t *entry)
+{
+    side_table_entry_t *prev_entry = MM_REL_PTR_GET(side_table_entry_t, entry->prev);
+    side_table_entry_t *next_entry = MM_REL_PTR_GET(side_table_entry_t, entry->next);
+
+    if (prev_entry != NULL)
+    {
+        MM_REL_PTR_SET(prev_entry->next, next_entry);
+    }
+    else
+    {
+        MM_REL_PTR_SET(*list_head, next_entry);
+    }
+    if (next_entry != NULL)
+    {
+        MM_REL_PTR_SET(next_entry->prev, prev_entry);
+    }
+    entry->prev = 0;
+    entry->next = 0;
+}
+
+/**
+ * @brief Calculates the slot size of a record with out-of-band metadata.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @return Size of one slot in bytes, the struct size rounded up to MM_OOB_SLOT_ALIGN.
+ */
+static uint32_t _mm_oob_slot_size(struct_record_t *record)
+{
+    return (uint32_t)((record->size + MM_OOB_SLOT_ALIGN - 1) & ~(MM_OOB_SLOT_ALIGN - 1));
+}
+
+/**
+ * @brief Calculates the number of slots in a data VM page of a record with out-of-band metadata.
+ *
+ * The slot count of a struct-of-arrays record is fixed by its column layout at registration.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @return Number of slots per data VM page.
+ */
+static uint32_t _mm_oob_slots_per_vm_page(struct_record_t *record)
+{
+    if (record->flags & MM_RECORD_STRUCT_OF_ARRAYS)
+    {
+        return MM_REL_PTR_GET(mm_soa_columns_t, record->soa_layout)->slot_count;
+    }
+
+    uint32_t slot_count = (uint32_t)((SYSTEM_PAGE_SIZE - MM_OOB_SLOT_AREA_OFFSET) / _mm_oob_slot_size(record));
+
+    return (slot_count < MM_OOB_MAX_SLOTS_PER_VM_PAGE ? slot_count : MM_OOB_MAX_SLOTS_PER_VM_PAGE);
+}
+
+/**
+ * @brief Takes an unused side table entry of a record.
+ *
+ * If the record has no unused side table entry, a new side table VM page is added to the record and all of its
+ * entries become unused entries.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @return Pointer to the side_table_entry_t object, or NULL if no VM page could be obtained.
+ */
+static side_table_entry_t *_mm_get_unused_side_table_entry(struct_record_t *record)
+{
+    if (record->unused_side_table_entries == 0)
+    {
+        vm_page_for_side_table_t *side_table_page =
+            (vm_page_for_side_table_t *)_mm_request_vm_page(1, _mm_numa_node_of_record(record));
+        if (side_table_page == NULL)
+        {
+            return NULL;
+        }
+        MM_REL_PTR_SET(side_table_page->next, MM_REL_PTR_GET(vm_page_for_side_table_t, record->side_table_pages));
+        MM_REL_PTR_SET(record->side_table_pages, side_table_page);
+
+        for (uint32_t i = 0; i < MM_MAX_SIDE_TABLE_ENTRIES_PER_VM_PAGE; i++)
+        {
+            _mm_side_table_list_add(&record->unused_side_table_entries, &side_table_page->side_table_entry_list[i]);
+        }
+    }
+
+    side_table_entry_t *entry = MM_REL_PTR_GET(side_table_entry_t, record->unused_side_table_entries);
+    _mm_side_table_list_remove(&record->unused_side_table_entries, entry);
+
+    return entry;
+}
+
+/**
+ * @brief Allocates a data VM page with out-of-band metadata.
+ *
+ * The header of the page is written once here and never again: the page is not chained to the other data VM pages of
+ * the record, its slots are tracked by a side table entry and the entry is what gets linked into the record's lists.
+ * A page of a struct-of-arrays record also gets a copy of the column table of the record.
+ *
+ * @param record Pointer to the struct_record_t object associated with the data page.
+ * @return Pointer to the side_table_entry_t object describing the page, or NULL if no VM page could be obtained.
+ */
+static side_table_entry_t *_mm_allocate_oob_data_vm_page(struct_record_t *record)
+{
+    if (!_mm_budget_charge(record, SYSTEM_PAGE_SIZE))
+    {
+        return NULL;
+    }
+
+    side_table_entry_t *entry = _mm_get_unused_side_table_entry(record);
+    if (entry == NULL)
+    {
+        _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE);
+        return NULL;
+    }
+
+    vm_page_for_data_t *data_vm_page = (vm_page_for_data_t *)_mm_request_vm_page(1, _mm_numa_node_of_record(record));
+    if (data_vm_page == NULL)
+    {
+        _mm_side_table_list_add(&record->unused_side_table_entries, entry);
+        _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE);
+        return NULL;
+    }
+
+    MM_REL_PTR_SET(data_vm_page->record, record);
+    data_vm_page->layout = MM_PAGE_LAYOUT_OUT_OF_BAND;
+    MM_REL_PTR_SET(data_vm_page->side_table_entry, entry);
+    entry->slot_size = _mm_oob_slot_size(record);
+    entry->slot_count = (uint16_t)_mm_oob_slots_per_vm_page(record);
+    /* the columns of a struct-of-arrays page are laid out at fixed offsets and are not colored */
+    data_vm_page->color_offset = 0;
+    if (record->flags & MM_RECORD_STRUCT_OF_ARRAYS)
+    {
+        data_vm_page->layout = MM_PAGE_LAYOUT_STRUCT_OF_ARRAYS;
+        mm_soa_columns_t *layout = MM_REL_PTR_GET(mm_soa_columns_t, record->soa_layout);
+        memcpy(MM_SOA_COLUMNS_OF_PAGE(data_vm_page), layout, sizeof(mm_soa_columns_t));
+    }
+    else
+    {
+        size_t slack = SYSTEM_PAGE_SIZE - MM_OOB_SLOT_AREA_OFFSET - (size_t)entry->slot_count * entry->slot_size;
+        data_vm_page->color_offset = _mm_next_cache_color(record, (uint32_t)slack);
+    }
+
+    memset(entry->used_bitmap, 0, sizeof(entry->used_bitmap));
+    memset(entry->head_bitmap, 0, sizeof(entry->head_bitmap));
+    entry->used_slot_count = 0;
+    MM_REL_PTR_SET(entry->data_page, data_vm_page);
+    _mm_side_table_list_add(&record->partial_side_table_entries, entry);
+
+    return entry;
+}
+
+/**
+ * @brief Finds a run of free slots in a data VM page with out-of-band metadata.
+ *
+ * @param entry Pointer to the side_table_entry_t object describing the page.
+ * @param units Number of consecutive slots needed.
+ * @return Index of the first slot of the run, or -1 if the page has no such run.
+ */
+static int32_t _mm_find_free_slot_run(side_table_entry_t *entry, uint32_t units)
+{
+    if (units == 1)
+    {
+        for (uint32_t word = 0; word * 64 < entry->slot_count; word++)
+        {
+            uint64_t free_bits = ~entry->used_bitmap[word];
+            if (free_bits != 0)
+            {
+                uint32_t slot = word * 64 + (uint32_t)__builtin_ctzll(free_bits);
+                return (slot < entry->slot_count ? (int32_t)slot : -1);
+            }
+        }
+        return -1;
+    }
+
+    uint32_t run = 0;
+    for (uint32_t slot = 0; slot < entry->slot_count; slot++)
+    {
+        if (MM_OOB_SLOT_BIT_IS_SET(entry->used_bitmap, slot))
+        {
+            run = 0;
+        }
+        else if (++run == units)
+        {
+            return (int32_t)(slot - units + 1);
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Marks a run of free slots of a data VM page with out-of-band metadata as one allocation.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param entry Pointer to the side_table_entry_t object describing the page.
+ * @param slot Index of the first slot of the run.
+ * @param units Number of slots in the run.
+ */
+static void _mm_take_side_table_slots(struct_record_t *record, side_table_entry_t *entry, uint32_t slot,
+                                      uint32_t units)
+{
+    for (uint32_t i = 0; i < units; i++)
+    {
+        MM_OOB_SLOT_BIT_SET(entry->used_bitmap, slot + i);
+    }
+    MM_OOB_SLOT_BIT_SET(entry->head_bitmap, slot);
+    entry->used_slot_count += units;
+
+    if (entry->used_slot_count == entry->slot_count)
+    {
+        _mm_side_table_list_remove(&record->partial_side_table_entries, entry);
+    }
+}
+
+/**
+ * @brief Allocates consecutive slots from a record with out-of-band metadata.
+ *
+ * The slots are taken from the first data VM page with a long enough run of free slots, or from a new data VM page
+ * if there is none. Only the side table entry of the page is updated.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param units Number of consecutive slots to allocate.
+ * @param first_slot Filled with the index of the first slot.
+ * @return Pointer to the side table entry of the page hosting the slots, or NULL if allocation fails.
+ */
+static side_table_entry_t *_mm_allocate_side_table_slots(struct_record_t *record, uint32_t units,
+                                                         uint32_t *first_slot)
+{
+    side_table_entry_t *entry = NULL;
+    int32_t slot = -1;
+
+    for (entry = MM_REL_PTR_GET(side_table_entry_t, record->partial_side_table_entries); entry != NULL;
+         entry = MM_REL_PTR_GET(side_table_entry_t, entry->next))
+    {
+        if ((uint32_t)(entry->slot_count - entry->used_slot_count) >= units &&
+            (slot = _mm_find_free_slot_run(entry, units)) >= 0)
+        {
+            break;
+        }
+    }
+
+    if (entry == NULL)
+    {
+        entry = _mm_allocate_oob_data_vm_page(record);
+        if (entry == NULL)
+        {
+            return NULL;
+        }
+        slot = 0;
+    }
+
+    _mm_take_side_table_slots(record, entry, (uint32_t)slot, units);
+    *first_slot = (uint32_t)slot;
+
+    return entry;
+}
+
+/**
+ * @brief Allocates consecutive slots from a record with out-of-band metadata.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param units Number of consecutive slots to allocate.
+ * @return Pointer to the first slot, or NULL if allocation fails.
+ */
+static void *_mm_allocate_oob_slots(struct_record_t *record, uint32_t units)
+{
+    uint32_t slot = 0;
+    side_table_entry_t *entry = _mm_allocate_side_table_slots(record, units, &slot);
+
+    return (entry != NULL ? MM_OOB_SLOT_ADDRESS(entry, slot) : NULL);
+}
+
+/**
+ * @brief Frees slots of a data VM page with out-of-band metadata.
+ *
+ * All slots of the allocation starting at `slot` are marked free in the side table entry of the page. A page
+ * left without used slots is released and its side table entry becomes unused.
+ *
+ * @param data_vm_page Pointer to the data VM page hosting the allocation.
+ * @param slot Index of the first slot of the allocation.
+ */
+static void _mm_free_side_table_slots(vm_page_for_data_t *data_vm_page, uint32_t slot)
+{
+    struct_record_t *record = MM_DATA_VM_PAGE_RECORD(data_vm_page);
+    side_table_entry_t *entry = MM_REL_PTR_GET(side_table_entry_t, data_vm_page->side_table_entry);
+
+    assert(MM_OOB_SLOT_BIT_IS_SET(entry->head_bitmap, slot));
+
+    bool was_full = (entry->used_slot_count == entry->slot_count);
+
+    MM_OOB_SLOT_BIT_CLEAR(entry->head_bitmap, slot);
+    do
+    {
+        MM_OOB_SLOT_BIT_CLEAR(entry->used_bitmap, slot);
+        entry->used_slot_count--;
+        slot++;
+    } while (slot < entry->slot_count && MM_OOB_SLOT_BIT_IS_SET(entry->used_bitmap, slot) &&
+             !MM_OOB_SLOT_BIT_IS_SET(entry->head_bitmap, slot));
+
+    if (entry->used_slot_count == 0)
+    {
+        if (!was_full)
+        {
+            _mm_side_table_list_remove(&record->partial_side_table_entries, entry);
+        }
+        entry->data_page = 0;
+        _mm_side_table_list_add(&record->unused_side_table_entries, entry);
+        _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE);
+        _mm_release_vm_page((void *)data_vm_page, 1);
+        return;
+    }
+
+    if (was_full)
+    {
+        _mm_side_table_list_add(&record->partial_side_table_entries, entry);
+    }
+}
+
+/**
+ * @brief Frees the slots of an allocation of a data VM page with out-of-band metadata.
+ *
+ * @param data_vm_page Pointer to the data VM page hosting the allocation.
+ * @param app_data Pointer to the first slot of the allocation.
+ */
+static void _mm_free_oob_slots(vm_page_for_data_t *data_vm_page, void *app_data)
+{
+    side_table_entry_t *entry = MM_REL_PTR_GET(side_table_entry_t, data_vm_page->side_table_entry);
+
+    _mm_free_side_table_slots(data_vm_page,
+                              (uint32_t)(((uint8_t *)app_data - MM_OOB_SLOT_AREA(data_vm_page)) / entry->slot_size));
+}
+
+/**
+ * @brief Finds the next side table entry of a record that describes a data VM page.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param entry Pointer to the current side_table_entry_t object, or NULL to find the first one.
+ * @return Pointer to the next used side_table_entry_t object, or NULL if there is none.
+ */
+static side_table_entry_t *_mm_next_used_side_table_entry(struct_record_t *record, side_table_entry_t *entry)
+{
+    vm_page_for_side_table_t *side_table_page = NULL;
+
+    if (entry == NULL)
+    {
+        side_table_page = MM_REL_PTR_GET(vm_page_for_side_table_t, record->side_table_pages);
+        entry = (side_table_page != NULL ? side_table_page->side_table_entry_list : NULL);
+    }
+    else
+    {
+        side_table_page = MM_GET_SIDE_TABLE_PAGE_FROM_ENTRY(entry);
+        entry++;
+    }
+
+    while (side_table_page != NULL)
+    {
+        for (; entry < side_table_page->side_table_entry_list + MM_MAX_SIDE_TABLE_ENTRIES_PER_VM_PAGE; entry++)
+        {
+            if (entry->data_page != 0)
+            {
+                return entry;
+            }
+        }
+        side_table_page = MM_REL_PTR_GET(vm_page_for_side_table_t, side_table_page->next);
+        entry = (side_table_page != NULL ? side_table_page->side_table_entry_list : NULL);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Returns the first data VM page (or side table entry) of a record for a walk over its live objects.
+ *
+ * The buddy runs of an in-band record follow its data VM pages; the first page of a run holds a single block.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @return Pointer to the vm_page_for_data_t object, or to the side_table_entry_t object for a record with a side
+ *         table, or NULL if the record has no data VM page.
+ */
+static void *_mm_object_walk_first_page(struct_record_t *record)
+{
+    if (MM_RECORD_USES_SIDE_TABLE(record))
+    {
+        return _mm_next_used_side_table_entry(record, NULL);
+    }
+
+    vm_page_for_data_t *first_page = MM_FIRST_DATA_VM_PAGE(record);
+
+    return (first_page != NULL ? first_page : MM_REL_PTR_GET(vm_page_for_data_t, record->buddy_runs));
+}
+
+/**
+ * @brief Returns the data VM page (or side table entry) following `page` in a walk over live objects.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param page Pointer to the current vm_page_for_data_t or side_table_entry_t object.
+ * @return Pointer to the next one, or NULL at the end of the record.
+ */
+static void *_mm_object_walk_next_page(struct_record_t *record, void *page)
+{
+    if (MM_RECORD_USES_SIDE_TABLE(record))
+    {
+        return _mm_next_used_side_table_entry(record, (side_table_entry_t *)page);
+    }
+
+    vm_page_for_data_t *next_page = MM_NEXT_DATA_VM_PAGE(page);
+    if (next_page == NULL && ((vm_page_for_data_t *)page)->layout != MM_PAGE_LAYOUT_BUDDY)
+    {
+        return MM_REL_PTR_GET(vm_page_for_data_t, record->buddy_runs);
+    }
+
+    return next_page;
+}
+
+/**
+ * @brief Points a cursor at the start of a range of data VM pages.
+ *
+ * @param cursor Pointer to the cursor.
+ * @param record Pointer to the struct_record_t object.
+ * @param page First page of the range.
+ * @param end_page Page following the range, or NULL for the end of the record.
+ */
+static void _mm_object_cursor_set_range(mm_object_cursor_t *cursor, struct_record_t *record, void *page,
+                                        void *end_page)
+{
+    cursor->record = record;
+    cursor->page = (page != end_page ? page : NULL);
+    cursor->end_page = end_page;
+    cursor->block = NULL;
+    cursor->slot = 0;
+    if (cursor->page != NULL && !MM_RECORD_USES_SIDE_TABLE(record))
+    {
+        cursor->block = &((vm_page_for_data_t *)cursor->page)->meta_block_info;
+    }
+}
+
+/**
+ * @brief Moves a cursor to the next page of its range.
+ *
+ * The header of the page after the new one is prefetched, so that it is in cache by the time the walk gets there.
+ *
+ * @param cursor Pointer to the cursor.
+ */
+static void _mm_object_cursor_advance_page(mm_object_cursor_t *cursor)
+{
+    struct_record_t *record = (struct_record_t *)cursor->record;
+    void *next_page = _mm_object_walk_next_page(record, cursor->page);
+
+    cursor->page = (next_page != cursor->end_page ? next_page : NULL);
+    cursor->slot = 0;
+    cursor->block = NULL;
+    if (cursor->page == NULL)
+    {
+        return;
+    }
+
+    if (MM_RECORD_USES_SIDE_TABLE(record))
+    {
+        __builtin_prefetch(MM_REL_PTR_GET(vm_page_for_data_t, ((side_table_entry_t *)cursor->page)->data_page));
+    }
+    else
+    {
+        cursor->block = &((vm_page_for_data_t *)cursor->page)->meta_block_info;
+        __builtin_prefetch(MM_NEXT_DATA_VM_PAGE(cursor->page));
+    }
+}
+
+/**
+ * @brief Finds a handle table entry of a record by index.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param index Index of the entry, below the handle count of the record.
+ * @return Pointer to the mm_handle_entry_t object.
+ */
+static mm_handle_entry_t *_mm_handle_entry(struct_record_t *record, uint32_t index)
+{
+    mm_rel_ptr_t *directory = MM_REL_PTR_GET(mm_rel_ptr_t, record->handle_directory);
+    mm_handle_entry_t *entries = MM_REL_PTR_GET(mm_handle_entry_t, directory[index / MM_HANDLE_ENTRIES_PER_VM_PAGE]);
+
+    return &entries[index % MM_HANDLE_ENTRIES_PER_VM_PAGE];
+}
+
+/**
+ * @brief Takes a free handle table entry of a record.
+ *
+ * Freed entries are reused first. Otherwise the next never used entry is taken, adding a VM page of entries (and the
+ * directory VM page for the first one) when needed. The heap lock must be held.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param index Filled with the index of the entry.
+ * @return Pointer to the mm_handle_entry_t object, or NULL if the table is full or no VM page could be obtained.
+ */
+static mm_handle_entry_t *_mm_take_handle_entry(struct_record_t *record, uint32_t *index)
+{
+    mm_handle_entry_t *entry = NULL;
+
+    if (record->free_handles != 0)
+    {
+        *index = record->free_handles - 1;
+        entry = _mm_handle_entry(record, *index);
+        record->free_handles = entry->units;
+        return entry;
+    }
+
+    if (record->handle_directory == 0)
+    {
+        mm_rel_ptr_t *directory = (mm_rel_ptr_t *)_mm_request_vm_page(1, _mm_numa_node_of_record(record));
+        if (directory == NULL)
+        {
+            return NULL;
+        }
+        memset(directory, 0, SYSTEM_PAGE_SIZE);
+        MM_REL_PTR_SET(record->handle_directory, directory);
+    }
+
+    if (record->handle_count % MM_HANDLE_ENTRIES_PER_VM_PAGE == 0)
+    {
+        uint32_t entries_page_index = (uint32_t)(record->handle_count / MM_HANDLE_ENTRIES_PER_VM_PAGE);
+        if (entries_page_index == MM_MAX_HANDLE_ENTRY_VM_PAGES)
+        {
+            return NULL;
+        }
+
+        mm_handle_entry_t *entries = (mm_handle_entry_t *)_mm_request_vm_page(1, _mm_numa_node_of_record(record));
+        if (entries == NULL)
+        {
+            return NULL;
+        }
+        mm_rel_ptr_t *directory = MM_REL_PTR_GET(mm_rel_ptr_t, record->handle_directory);
+        MM_REL_PTR_SET(directory[entries_page_index], entries);
+    }
+
+    *index = record->handle_count;
+    entry = _mm_handle_entry(record, *index);
+    entry->object = 0;
+    entry->generation = 1;
+    record->handle_count++;
+
+    return entry;
+}
+
+/**
+ * @brief Frees a handle table entry of a record.
+ *
+ * The generation of the entry is bumped, so that every handle to the entry given out so far goes stale. Generation 0
+ * is skipped to keep MM_HANDLE_NULL invalid. The heap lock must be held.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param index Index of the entry.
+ */
+static void _mm_release_handle_entry(struct_record_t *record, uint32_t index)
+{
+    mm_handle_entry_t *entry = _mm_handle_entry(record, index);
+
+    entry->object = 0;
+    if (++entry->generation == 0)
+    {
+        entry->generation = 1;
+    }
+    entry->units = record->free_handles;
+    record->free_handles = index + 1;
+}
+
+/**
+ * @brief Calculates the bytes taken by the allocated blocks of every data VM page of a record.
+ *
+ * The result is kept in the page headers for the duration of a compaction. A page holding a block that can be
+ * neither fixed up by the relocation callback of the record nor through a handle, or a cached object, is marked as
+ * pinned.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param has_callback Whether the relocation callback of the record can be called by this process.
+ */
+static void _mm_compaction_scan_pages(struct_record_t *record, bool has_callback)
+{
+    vm_page_for_data_t *data_vm_page = NULL;
+    MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page)
+    {
+        data_vm_page->compaction_live_bytes = 0;
+        data_vm_page->compaction_draining = 0;
+
+        meta_block_t *meta_block_ptr = NULL;
+        MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(data_vm_page, meta_block_ptr)
+        {
+            if (meta_block_ptr->is_free == MM_FREE || meta_block_ptr->is_free == MM_PADDING)
+            {
+                continue;
+            }
+            /* a cached object is linked into the object cache through its meta block */
+            if (meta_block_ptr->is_free == MM_CACHED || (!has_callback && meta_block_ptr->handle == 0))
+            {
+                data_vm_page->compaction_live_bytes = MM_COMPACTION_PINNED_PAGE;
+                break;
+            }
+            data_vm_page->compaction_live_bytes += (uint32_t)sizeof(meta_block_t) + meta_block_ptr->data_block_size;
+        }
+        MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END;
+    }
+    MM_ITERATE_DATA_VM_PAGES_END;
+}
+
+/**
+ * @brief Picks the next data VM page to be drained by compaction.
+ *
+ * The page must be the sparsest page that is neither pinned nor drained already, and the pages denser than it must
+ * have enough free bytes left to take all of its blocks.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @return Pointer to the vm_page_for_data_t object to drain, or NULL if no page is worth draining.
+ */
+static vm_page_for_data_t *_mm_compaction_pick_source_page(struct_record_t *record)
+{
+    vm_page_for_data_t *sparsest_page = NULL;
+    vm_page_for_data_t *data_vm_page = NULL;
+    MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page)
+    {
+        if (data_vm_page->compaction_draining || data_vm_page->compaction_live_bytes == MM_COMPACTION_PINNED_PAGE)
+        {
+            continue;
+        }
+        if (sparsest_page == NULL || data_vm_page->compaction_live_bytes < sparsest_page->compaction_live_bytes)
+        {
+            sparsest_page = data_vm_page;
+        }
+    }
+    MM_ITERATE_DATA_VM_PAGES_END;
+
+    if (sparsest_page == NULL)
+    {
+        return NULL;
+    }
+
+    size_t free_bytes = 0;
+    MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page)
+    {
+        if (data_vm_page != sparsest_page && !data_vm_page->compaction_draining &&
+            data_vm_page->compaction_live_bytes != MM_COMPACTION_PINNED_PAGE)
+        {
+            free_bytes += _mm_max_vm_page_memory_available(1) + sizeof(meta_block_t) -
+                          data_vm_page->compaction_live_bytes;
+        }
+    }
+    MM_ITERATE_DATA_VM_PAGES_END;
+
+    return (free_bytes >= sparsest_page->compaction_live_bytes ? sparsest_page : NULL);
+}
+
+/**
+ * @brief Finds a free block for an object moved out of a data VM page that is being drained.
+ *
+ * The priority queue of free blocks is walked for the smallest block that fits and lies in a page at least as dense
+ * as the drained one, so that objects only move towards denser pages and no new data VM page is added. Pinned pages
+ * qualify, they are never drained.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param source_page Pointer to the page being drained.
+ * @param req_size Size of the object to move.
+ * @return Pointer to the free meta_block_t object, or NULL if no free block qualifies.
+ */
+static meta_block_t *_mm_compaction_find_destination(struct_record_t *record, vm_page_for_data_t *source_page,
+                                                     uint32_t req_size)
+{
+    meta_block_t *best_fit = NULL;
+
+    for (glthread_node_t *node = GLTHREAD_HEAD(&record->free_block_priority_list); node != NULL;
+         node = GLTHREAD_NEXT(node))
+    {
+        meta_block_t *free_meta_block =
+            (meta_block_t *)GLTHREAD_BASEOF(node, MM_BLOCK_OFFSETOF(meta_block_t, glue_node));
+        /* the queue is sorted by decreasing size */
+        if (free_meta_block->data_block_size < req_size)
+        {
+            break;
+        }
+
+        vm_page_for_data_t *data_vm_page = (vm_page_for_data_t *)MM_GET_PAGE_FROM_META_BLOCK(free_meta_block);
+        if (data_vm_page == source_page || data_vm_page->compaction_draining ||
+            data_vm_page->compaction_live_bytes < source_page->compaction_live_bytes)
+        {
+            continue;
+        }
+        best_fit = free_meta_block;
+    }
+
+    return best_fit;
+}
+
+/**
+ * @brief Moves an allocated block into a free block of another data VM page.
+ *
+ * The object is copied, its handle table entry is pointed at the new copy, the relocation callback is called and the
+ * old block is freed, which releases the source page through `_mm_delete_and_free_data_vm_page` once it is empty.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param meta_block_ptr Pointer to the meta block of the block to move.
+ * @param destination Pointer to the free meta block to move the object into.
+ * @param has_callback Whether the relocation callback of the record can be called by this process.
+ */
+static void _mm_compaction_move_block(struct_record_t *record, meta_block_t *meta_block_ptr,
+                                      meta_block_t *destination, bool has_callback)
+{
+    uint32_t size = meta_block_ptr->data_block_size;
+    vm_page_for_data_t *destination_page = (vm_page_for_data_t *)MM_GET_PAGE_FROM_META_BLOCK(destination);
+
+    _mm_split_free_data_block_for_allocation(record, destination, size);
+    if (destination_page->compaction_live_bytes != MM_COMPACTION_PINNED_PAGE)
+    {
+        destination_page->compaction_live_bytes += (uint32_t)sizeof(meta_block_t) + size;
+    }
+
+    void *old_app_data = (void *)(meta_block_ptr + 1);
+    void *new_app_data = (void *)(destination + 1);
+    memcpy(new_app_data, old_app_data, size);
+
+    destination->handle = meta_block_ptr->handle;
+    destination->refcount = meta_block_ptr->refcount;
+    if (destination->handle != 0)
+    {
+        MM_REL_PTR_SET(_mm_handle_entry(record, destination->handle - 1)->object, new_app_data);
+    }
+    if (has_callback)
+    {
+        mm_in_locked_callback = true;
+        record->relocation_callback(old_app_data, new_app_data, size, record->relocation_arg);
+        mm_in_locked_callback = false;
+    }
+
+    meta_block_ptr->handle = 0;
+    _mm_free_data_block(meta_block_ptr);
+}
+
+/**
+ * @brief Checks whether memory belongs to the real-time pool.
+ *
+ * @param app_data Pointer to the memory.
+ * @return true if the memory is inside the pool, false otherwise or if there is no pool.
+ */
+static bool _mm_rt_pool_owns(const void *app_data)
+{
+    const uint8_t *address = (const uint8_t *)app_data;
+    /* the base is published after the size by mm_init_realtime(), and neither changes afterwards */
+    const uint8_t *base = __atomic_load_n(&mm_rt_pool.base, __ATOMIC_ACQUIRE);
+
+    return (base != NULL && address >= base && address < base + mm_rt_pool.size);
+}
+
+/**
+ * @brief Calculates the free list of the real-time pool holding blocks of a given size.
+ *
+ * @param size Size of the block data.
+ * @param fl Filled with the first level index.
+ * @param sl Filled with the second level index.
+ */
+static void _mm_rt_mapping(uint64_t size, uint32_t *fl, uint32_t *sl)
+{
+    if (size < MM_RT_SMALL_BLOCK_SIZE)
+    {
+        *fl = 0;
+        *sl = (uint32_t)(size / (MM_RT_SMALL_BLOCK_SIZE / MM_RT_SL_INDEX_COUNT));
+        return;
+    }
+
+    uint32_t msb = 63 - (uint32_t)__builtin_clzll(size);
+    *sl = (uint32_t)(size >> (msb - MM_RT_SL_INDEX_COUNT_LOG2)) ^ MM_RT_SL_INDEX_COUNT;
+    *fl = msb - (MM_RT_FL_INDEX_SHIFT - 1);
+}
+
+/**
+ * @brief Adds a free block of the real-time pool to the head of its free list.
+ *
+ * @param block Pointer to the block.
+ */
+static void _mm_rt_insert_free_block(mm_rt_block_t *block)
+{
+    uint32_t fl = 0, sl = 0;
+    _mm_rt_mapping(block->size, &fl, &sl);
+
+    block->is_free = MM_FREE;
+    block->prev_free = NULL;
+    block->next_free = mm_rt_pool.free_blocks[fl][sl];
+    if (block->next_free != NULL)
+    {
+        block->next_free->prev_free = block;
+    }
+    mm_rt_pool.free_blocks[fl][sl] = block;
+    mm_rt_pool.fl_bitmap |= 1ULL << fl;
+    mm_rt_pool.sl_bitmap[fl] |= 1U << sl;
+}
+
+/**
+ * @brief Takes a free block of the real-time pool off its free list.
+ *
+ * @param block Pointer to the block.
+ */
+static void _mm_rt_remove_free_block(mm_rt_block_t *block)
+{
+    uint32_t fl = 0, sl = 0;
+    _mm_rt_mapping(block->size, &fl, &sl);
+
+    if (block->prev_free != NULL)
+    {
+        block->prev_free->next_free = block->next_free;
+    }
+    else
+    {
+        mm_rt_pool.free_blocks[fl][sl] = block->next_free;
+    }
+    if (block->next_free != NULL)
+    {
+        block->next_free->prev_free = block->prev_free;
+    }
+
+    if (mm_rt_pool.free_blocks[fl][sl] == NULL)
+    {
+        mm_rt_pool.sl_bitmap[fl] &= ~(1U << sl);
+        if (mm_rt_pool.sl_bitmap[fl] == 0)
+        {
+            mm_rt_pool.fl_bitmap &= ~(1ULL << fl);
+        }
+    }
+    block->is_free = MM_ALLOCATED;
+}
+
+/**
+ * @brief Takes a free block of the real-time pool large enough for a request off its free list.
+ *
+ * The request is rounded up to the next second level range, so that any block of the list found can hold it, and
+ * the first non-empty list from there is found with two bit scans.
+ *
+ * @param size Size of the request, a multiple of MM_RT_ALIGN.
+ * @return Pointer to the block, or NULL if the pool has no block large enough.
+ */
+static mm_rt_block_t *_mm_rt_take_free_block(uint64_t size)
+{
+    if (size >= MM_RT_SMALL_BLOCK_SIZE)
+    {
+        size += (1ULL << (63 - (uint32_t)__builtin_clzll(size) - MM_RT_SL_INDEX_COUNT_LOG2)) - 1;
+    }
+
+    uint32_t fl = 0, sl = 0;
+    _mm_rt_mapping(size, &fl, &sl);
+    if (fl >= MM_RT_FL_INDEX_COUNT)
+    {
+        return NULL;
+    }
+
+    uint32_t sl_map = mm_rt_pool.sl_bitmap[fl] & (~0U << sl);
+    if (sl_map == 0)
+    {
+        uint64_t fl_map = mm_rt_pool.fl_bitmap & (~0ULL << (fl + 1));
+        if (fl_map == 0)
+        {
+            return NULL;
+        }
+        fl = (uint32_t)__builtin_ctzll(fl_map);
+        sl_map = mm_rt_pool.sl_bitmap[fl];
+    }
+    sl = (uint32_t)__builtin_ctz(sl_map);
+
+    mm_rt_block_t *block = mm_rt_pool.free_blocks[fl][sl];
+    _mm_rt_remove_free_block(block);
+
+    return block;
+}
+
+/**
+ * @brief Calculates the largest request an empty real-time pool can serve.
+ *
+ * Requests are rounded up to the next second level range before a free list is picked, so the single free block of
+ * an empty pool only serves requests up to the start of its own range.
+ *
+ * @return Size of the largest request in bytes, 0 if there is no pool.
+ */
+static uint64_t _mm_rt_max_request_size(void)
+{
+    if (mm_rt_pool.base == NULL)
+    {
+        return 0;
+    }
+
+    uint64_t size = mm_rt_pool.size - 2 * MM_RT_BLOCK_HEADER_SIZE;
+    if (size >= MM_RT_SMALL_BLOCK_SIZE)
+    {
+        size &= ~((1ULL << (63 - (uint32_t)__builtin_clzll(size) - MM_RT_SL_INDEX_COUNT_LOG2)) - 1);
+    }
+
+    return size;
+}
+
+/**
+ * @brief Calculates the size of the real-time pool block asked for by an allocation.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param units The number of structure units allocated.
+ * @return Size of the block without its header.
+ */
+static uint64_t _mm_rt_block_size(const struct_record_t *record, uint32_t units)
+{
+    uint64_t size = ((uint64_t)units * record->size + MM_RT_ALIGN - 1) & ~(uint64_t)(MM_RT_ALIGN - 1);
+
+    return (size < MM_RT_BLOCK_MIN_SIZE ? MM_RT_BLOCK_MIN_SIZE : size);
+}
+
+/**
+ * @brief Allocates units of a real-time record from the real-time pool.
+ *
+ * The block found is split when the rest can hold a block of its own. Nothing here depends on the number of blocks
+ * in the pool and no system call is made; the allocation fails right away if the pool has no large enough block.
+ * Only the pool lock is taken, so the heap lock may or may not be held.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param units The number of structure units to allocate.
+ * @return A pointer to the allocated memory, or NULL if there is no pool or it has no room for the request.
+ */
+static void *_mm_rt_allocate(struct_record_t *record, uint32_t units)
+{
+    uint64_t size = _mm_rt_block_size(record, units);
+    if (units == 0 || __atomic_load_n(&mm_rt_pool.base, __ATOMIC_ACQUIRE) == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mm_rt_pool.lock);
+    /* the budget is charged for the block asked for, which a block left unsplit may exceed by less than a header */
+    if (!_mm_budget_charge(record, MM_RT_BLOCK_HEADER_SIZE + size))
+    {
+        pthread_mutex_unlock(&mm_rt_pool.lock);
+        return NULL;
+    }
+
+    mm_rt_block_t *block = _mm_rt_take_free_block(size);
+    if (block == NULL)
+    {
+        _mm_budget_uncharge(record, MM_RT_BLOCK_HEADER_SIZE + size);
+        pthread_mutex_unlock(&mm_rt_pool.lock);
+        return NULL;
+    }
+
+    if (block->size >= size + MM_RT_BLOCK_HEADER_SIZE + MM_RT_BLOCK_MIN_SIZE)
+    {
+        mm_rt_block_t *rest = (mm_rt_block_t *)((uint8_t *)block + MM_RT_BLOCK_HEADER_SIZE + size);
+        rest->prev_phys = block;
+        rest->size = block->size - size - MM_RT_BLOCK_HEADER_SIZE;
+        MM_RT_NEXT_PHYS_BLOCK(rest)->prev_phys = rest;
+        block->size = size;
+        _mm_rt_insert_free_block(rest);
+    }
+
+    block->record = record;
+    block->units = units;
+    mm_rt_pool.used_bytes += MM_RT_BLOCK_HEADER_SIZE + block->size;
+    pthread_mutex_unlock(&mm_rt_pool.lock);
+
+    return (uint8_t *)block + MM_RT_BLOCK_HEADER_SIZE;
+}
+
+/**
+ * @brief Frees memory allocated by `_mm_rt_allocate`, merging it with free neighbours in the pool.
+ *
+ * Only the pool lock is taken, so the heap lock may or may not be held.
+ *
+ * @param app_data Pointer to the memory to free.
+ */
+static void _mm_rt_free(void *app_data)
+{
+    mm_rt_block_t *block = MM_RT_BLOCK_FROM_APP_DATA(app_data);
+
+    pthread_mutex_lock(&mm_rt_pool.lock);
+    assert(block->is_free == MM_ALLOCATED);
+
+    mm_rt_pool.used_bytes -= MM_RT_BLOCK_HEADER_SIZE + block->size;
+    _mm_budget_uncharge(block->record, MM_RT_BLOCK_HEADER_SIZE + _mm_rt_block_size(block->record, block->units));
+
+    mm_rt_block_t *next = MM_RT_NEXT_PHYS_BLOCK(block);
+    if (next->is_free == MM_FREE)
+    {
+        _mm_rt_remove_free_block(next);
+        block->size += MM_RT_BLOCK_HEADER_SIZE + next->size;
+        MM_RT_NEXT_PHYS_BLOCK(block)->prev_phys = block;
+    }
+
+    mm_rt_block_t *prev = block->prev_phys;
+    if (prev != NULL && prev->is_free == MM_FREE)
+    {
+        _mm_rt_remove_free_block(prev);
+        prev->size += MM_RT_BLOCK_HEADER_SIZE + block->size;
+        MM_RT_NEXT_PHYS_BLOCK(prev)->prev_phys = prev;
+        block = prev;
+    }
+
+    _mm_rt_insert_free_block(block);
+    pthread_mutex_unlock(&mm_rt_pool.lock);
+}
+
+/**
+ * @brief Adds a free buddy run to the free list of its order.
+ *
+ * @param run Pointer to the first page of the run.
+ * @param order Order of the run, which spans 1 << order pages.
+ */
+static void _mm_buddy_insert_free_run(mm_buddy_free_run_t *run, uint32_t order)
+{
+    MM_BUDDY_CHUNK_OF(run)->run_order[MM_BUDDY_PAGE_INDEX(run)] = (uint8_t)(MM_BUDDY_RUN_FREE | (order + 1));
+
+    run->prev = NULL;
+    run->next = mm_buddy_free_runs[order];
+    if (run->next != NULL)
+    {
+        run->next->prev = run;
+    }
+    mm_buddy_free_runs[order] = run;
+}
+
+/**
+ * @brief Takes a free buddy run off the free list of its order.
+ *
+ * @param run Pointer to the first page of the run.
+ * @param order Order of the run.
+ */
+static void _mm_buddy_remove_free_run(mm_buddy_free_run_t *run, uint32_t order)
+{
+    MM_BUDDY_CHUNK_OF(run)->run_order[MM_BUDDY_PAGE_INDEX(run)] = 0;
+
+    if (run->prev != NULL)
+    {
+        run->prev->next = run->next;
+    }
+    else
+    {
+        mm_buddy_free_runs[order] = run->next;
+    }
+    if (run->next != NULL)
+    {
+        run->next->prev = run->prev;
+    }
+}
+
+/**
+ * @brief Maps a new buddy chunk and puts its runs in the free lists.
+ *
+ * Without its first page a chunk splits into one free run of every order, the run of order k starting at page 1 << k.
+ *
+ * @return 0 if the chunk is mapped, -1 otherwise.
+ */
+static int8_t _mm_buddy_map_chunk(void)
+{
+    mm_buddy_chunk_t *chunk = _mm_map_aligned(MM_BUDDY_CHUNK_SIZE, MM_BUDDY_CHUNK_SIZE, PROT_READ | PROT_WRITE);
+    if (chunk == NULL)
+    {
+        return -1;
+    }
+
+    chunk->free_pages = MM_BUDDY_CHUNK_PAGES - 1;
+    mm_buddy_chunk_count++;
+    for (uint32_t order = 0; order <= MM_BUDDY_MAX_RUN_ORDER; order++)
+    {
+        _mm_buddy_insert_free_run((mm_buddy_free_run_t *)((uint8_t *)chunk + (SYSTEM_PAGE_SIZE << order)), order);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Unmaps a buddy chunk whose pages are all free again.
+ *
+ * Coalescing has then merged the free runs back into the runs the chunk was split into when it was mapped.
+ *
+ * @param chunk Pointer to the chunk.
+ */
+static void _mm_buddy_unmap_chunk(mm_buddy_chunk_t *chunk)
+{
+    for (uint32_t order = 0; order <= MM_BUDDY_MAX_RUN_ORDER; order++)
+    {
+        _mm_buddy_remove_free_run((mm_buddy_free_run_t *)((uint8_t *)chunk + (SYSTEM_PAGE_SIZE << order)), order);
+    }
+
+    munmap(chunk, MM_BUDDY_CHUNK_SIZE);
+    mm_buddy_chunk_count--;
+}
+
+/**
+ * @brief Calculates the memory an allocation from a buddy run of the largest order can hold.
+ *
+ * @return Size in bytes, after the header of the first page.
+ */
+static size_t _mm_buddy_max_run_memory_available(void)
+{
+    return (SYSTEM_PAGE_SIZE << MM_BUDDY_MAX_RUN_ORDER) - MM_BLOCK_OFFSETOF(vm_page_for_data_t, page_memory);
+}
+
+/**
+ * @brief Allocates units of an in-band record too large for a data VM page from a buddy run of the private heap.
+ *
+ * The run is the smallest power of two of pages holding the units. It is taken from the free list of its order, or
+ * split off a larger free run: each split hands the upper half, found by flipping bit `order` of the page index, to
+ * the free list of the next lower order. The first page gets the header of an in-band data VM page whose only block
+ * covers the run, so meta block based calls treat the allocation like any other in-band block. Runs are linked into a
+ * list of their own in the record rather than into its page list, so walks over the live objects visit them after
+ * the data VM pages while page based code such as compaction leaves them alone.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param units The number of structure units to allocate.
+ * @return A pointer to the allocated memory, or NULL if a shared heap is attached, the units do not fit in the largest
+ *         run or no chunk could be mapped.
+ */
+static void *_mm_buddy_allocate(struct_record_t *record, uint32_t units)
+{
+    size_t bytes = (size_t)units * record->size;
+    if (heap->region_size != 0 || bytes > _mm_buddy_max_run_memory_available())
+    {
+        return NULL;
+    }
+
+    size_t pages = (MM_BLOCK_OFFSETOF(vm_page_for_data_t, page_memory) + bytes + SYSTEM_PAGE_SIZE - 1) /
+                   SYSTEM_PAGE_SIZE;
+    uint32_t order = (pages <= 1 ? 0 : 64 - (uint32_t)__builtin_clzll(pages - 1));
+    if (!_mm_budget_charge(record, SYSTEM_PAGE_SIZE << order))
+    {
+        return NULL;
+    }
+
+    uint32_t free_order = order;
+    while (free_order <= MM_BUDDY_MAX_RUN_ORDER && mm_buddy_free_runs[free_order] == NULL)
+    {
+        free_order++;
+    }
+    if (free_order > MM_BUDDY_MAX_RUN_ORDER)
+    {
+        if (_mm_buddy_map_chunk() != 0)
+        {
+            _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE << order);
+            return NULL;
+        }
+        free_order = order;
+        while (mm_buddy_free_runs[free_order] == NULL)
+        {
+            free_order++;
+        }
+    }
+
+    mm_buddy_free_run_t *run = mm_buddy_free_runs[free_order];
+    _mm_buddy_remove_free_run(run, free_order);
+    while (free_order > order)
+    {
+        free_order--;
+        _mm_buddy_insert_free_run((mm_buddy_free_run_t *)((uintptr_t)run ^ (SYSTEM_PAGE_SIZE << free_order)),
+                                  free_order);
+    }
+
+    mm_buddy_chunk_t *chunk = MM_BUDDY_CHUNK_OF(run);
+    chunk->run_order[MM_BUDDY_PAGE_INDEX(run)] = (uint8_t)(order + 1);
+    chunk->free_pages -= 1U << order;
+
+    /* a run may hold pages faulted in for an earlier run, which are moved too */
+    int32_t node = _mm_numa_node_of_record(record);
+    if (node != MM_NUMA_NODE_ANY)
+    {
+        _mm_numa_place(run, SYSTEM_PAGE_SIZE << order, node, MPOL_MF_MOVE);
+    }
+
+    vm_page_for_data_t *data_vm_page = (vm_page_for_data_t *)run;
+    memset(data_vm_page, 0, sizeof(vm_page_for_data_t));
+    MM_REL_PTR_SET(data_vm_page->record, record);
+    data_vm_page->layout = MM_PAGE_LAYOUT_BUDDY;
+    data_vm_page->meta_block_info.is_free = MM_ALLOCATED;
+    data_vm_page->meta_block_info.data_block_size =
+        (uint32_t)((SYSTEM_PAGE_SIZE << order) - MM_BLOCK_OFFSETOF(vm_page_for_data_t, page_memory));
+    data_vm_page->meta_block_info.offset = MM_BLOCK_OFFSETOF(vm_page_for_data_t, meta_block_info);
+    data_vm_page->meta_block_info.refcount = 1;
+    glthread_init_node(&data_vm_page->meta_block_info.glue_node);
+
+    vm_page_for_data_t *first_run = MM_REL_PTR_GET(vm_page_for_data_t, record->buddy_runs);
+    if (first_run != NULL)
+    {
+        MM_REL_PTR_SET(data_vm_page->next, first_run);
+        MM_REL_PTR_SET(first_run->prev, data_vm_page);
+    }
+    MM_REL_PTR_SET(record->buddy_runs, data_vm_page);
+
+    return data_vm_page->page_memory;
+}
+
+/**
+ * @brief Frees a buddy run, merging it with its free buddies.
+ *
+ * The buddy of a run of order k is found by flipping bit k of its page index; while that run is free and of the same
+ * order, both are merged into the run of order k + 1 starting at the lower of them. A chunk left without allocated
+ * runs is unmapped unless it is the last one, so that allocating and freeing a single large array over and over does
+ * not map and unmap a chunk each time.
+ *
+ * @param data_vm_page Pointer to the first page of the run.
+ */
+static void _mm_buddy_free(vm_page_for_data_t *data_vm_page)
+{
+    mm_buddy_chunk_t *chunk = MM_BUDDY_CHUNK_OF(data_vm_page);
+    uintptr_t run = (uintptr_t)data_vm_page;
+    uint32_t order = (uint32_t)chunk->run_order[MM_BUDDY_PAGE_INDEX(run)] - 1;
+
+    assert(order <= MM_BUDDY_MAX_RUN_ORDER);
+
+    struct_record_t *record = MM_DATA_VM_PAGE_RECORD(data_vm_page);
+    vm_page_for_data_t *prev_run = MM_PREV_DATA_VM_PAGE(data_vm_page);
+    vm_page_for_data_t *next_run = MM_NEXT_DATA_VM_PAGE(data_vm_page);
+    if (prev_run != NULL)
+    {
+        MM_REL_PTR_SET(prev_run->next, next_run);
+    }
+    else
+    {
+        MM_REL_PTR_SET(record->buddy_runs, next_run);
+    }
+    if (next_run != NULL)
+    {
+        MM_REL_PTR_SET(next_run->prev, prev_run);
+    }
+
+    _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE << order);
+    chunk->run_order[MM_BUDDY_PAGE_INDEX(run)] = 0;
+    chunk->free_pages += 1U << order;
+
+    while (order < MM_BUDDY_MAX_RUN_ORDER)
+    {
+        uintptr_t buddy = run ^ (SYSTEM_PAGE_SIZE << order);
+        if (chunk->run_order[MM_BUDDY_PAGE_INDEX(buddy)] != (MM_BUDDY_RUN_FREE | (order + 1)))
+        {
+            break;
+        }
+        _mm_buddy_remove_free_run((mm_buddy_free_run_t *)buddy, order);
+        run &= ~(uintptr_t)(SYSTEM_PAGE_SIZE << order);
+        order++;
+    }
+    _mm_buddy_insert_free_run((mm_buddy_free_run_t *)run, order);
+
+    if (chunk->free_pages == MM_BUDDY_CHUNK_PAGES - 1 && mm_buddy_chunk_count > 1)
+    {
+        _mm_buddy_unmap_chunk(chunk);
+    }
+}
+
+/**
+ * @brief Calculates the distance between consecutive units of an allocation of a record.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @return The struct size, or the slot size for a record with out-of-band metadata.
+ */
+static uint32_t _mm_object_stride(struct_record_t *record)
+{
+    return (record->flags & MM_RECORD_OUT_OF_BAND_META ? _mm_oob_slot_size(record) : (uint32_t)record->size);
+}
+
+/**
+ * @brief Allocates units of a record without initializing them.
+ *
+ * The allocation is checked against the memory available in a completely free VM data page and served from the
+ * block allocator or, for a record with out-of-band metadata, from the slot allocator. Larger in-band allocations
+ * get a buddy run of pages of their own. A real-time record is served from the real-time pool instead. The heap lock
+ * must be held.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param units The number of structure units to allocate.
+ * @return A pointer to the allocated memory, or NULL if allocation failed.
+ */
+static void *_mm_allocate_units(struct_record_t *record, uint32_t units)
+{
+    /* objects of a real-time record are not traced, since tracing makes a system call */
+    if (record->flags & MM_RECORD_REALTIME)
+    {
+        return _mm_rt_allocate(record, units);
+    }
+
+    /* objects of a struct-of-arrays record are not contiguous and are only reachable through mm_soa_alloc() */
+    if (record->flags & MM_RECORD_STRUCT_OF_ARRAYS)
+    {
+        return NULL;
+    }
+
+    if (record->flags & MM_RECORD_OUT_OF_BAND_META)
+    {
+        /* we cannot allocate more slots than a completely free VM data page holds */
+        if (units == 0 || units > _mm_oob_slots_per_vm_page(record))
+        {
+            return NULL;
+        }
+
+        void *app_data = _mm_allocate_oob_slots(record, units);
+        if (app_data != NULL)
+        {
+            _mm_trace("alloc", record, app_data, units);
+        }
+        return app_data;
+    }
+
+    /* memory that is greater than the memory available in a completely free VM data page comes from a buddy run */
+    if (units * record->size > _mm_max_vm_page_memory_available(1))
+    {
+        void *app_data = _mm_buddy_allocate(record, units);
+        if (app_data != NULL)
+        {
+            _mm_trace("alloc", record, app_data, units);
+        }
+        return app_data;
+    }
+
+    meta_block_t *free_meta_block = _mm_allocate_free_data_block(record, record->size * units);
+    if (free_meta_block == NULL)
+    {
+        return NULL;
+    }
+    free_meta_block->handle = 0;
+    free_meta_block->refcount = 1;
+    _mm_trace("alloc", record, free_meta_block + 1, units);
+
+    return (void *)(free_meta_block + 1);
+}
+
+/**
+ * @brief Finds the free block of a data VM page closest to an address that can hold a request.
+ *
+ * @param data_vm_page Pointer to a data VM page with in-band metadata.
+ * @param hint Address the block should be close to.
+ * @param req_size The requested size of the data block.
+ * @return Pointer to the free meta_block_t object, or NULL if no free block of the page is large enough.
+ */
+static meta_block_t *_mm_find_free_data_block_near(vm_page_for_data_t *data_vm_page, const void *hint,
+                                                   uint32_t req_size)
+{
+    meta_block_t *nearest = NULL;
+    uintptr_t nearest_distance = UINTPTR_MAX;
+
+    for (meta_block_t *meta_block_ptr = &data_vm_page->meta_block_info; meta_block_ptr != NULL;
+         meta_block_ptr = MM_NEXT_META_BLOCK(meta_block_ptr))
+    {
+        if (meta_block_ptr->is_free != MM_FREE || meta_block_ptr->data_block_size < req_size)
+        {
+            continue;
+        }
+
+        uintptr_t block = (uintptr_t)meta_block_ptr;
+        uintptr_t distance = (block > (uintptr_t)hint ? block - (uintptr_t)hint : (uintptr_t)hint - block);
+        if (distance < nearest_distance)
+        {
+            nearest = meta_block_ptr;
+            nearest_distance = distance;
+        }
+    }
+
+    return nearest;
+}
+
+/**
+ * @brief Allocates units of a record close to another object of the record, without initializing them.
+ *
+ * The units are placed in the data VM page of `hint` if it has room for them. Otherwise a page with in-band metadata
+ * tries its neighbours in the page list of the record, which were mapped right before and after it; the allocation
+ * falls back to `_mm_allocate_units` when none of them has room, or when `hint` is NULL or belongs to another record.
+ * The heap lock must be held.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param units The number of structure units to allocate.
+ * @param hint Pointer to an object the new one will be visited with, or NULL.
+ * @return A pointer to the allocated memory, or NULL if allocation failed.
+ */
+static void *_mm_allocate_units_near(struct_record_t *record, uint32_t units, const void *hint)
+{
+    if (hint == NULL || (record->flags & (MM_RECORD_STRUCT_OF_ARRAYS | MM_RECORD_REALTIME)) || _mm_rt_pool_owns(hint))
+    {
+        return _mm_allocate_units(record, units);
+    }
+
+    vm_page_for_data_t *hint_page = MM_GET_PAGE_FROM_APP_DATA(hint);
+    if (MM_DATA_VM_PAGE_RECORD(hint_page) != record)
+    {
+        return _mm_allocate_units(record, units);
+    }
+
+    if (hint_page->layout == MM_PAGE_LAYOUT_BUDDY)
+    {
+        return _mm_allocate_units(record, units);
+    }
+
+    if (hint_page->layout == MM_PAGE_LAYOUT_OUT_OF_BAND)
+    {
+        side_table_entry_t *entry = MM_REL_PTR_GET(side_table_entry_t, hint_page->side_table_entry);
+        int32_t slot = -1;
+        if (units == 0 || (uint32_t)(entry->slot_count - entry->used_slot_count) < units ||
+            (slot = _mm_find_free_slot_run(entry, units)) < 0)
+        {
+            return _mm_allocate_units(record, units);
+        }
+
+        _mm_take_side_table_slots(record, entry, (uint32_t)slot, units);
+        void *app_data = MM_OOB_SLOT_ADDRESS(entry, slot);
+        _mm_trace("alloc", record, app_data, units);
+        return app_data;
+    }
+
+    /* arrays larger than a data VM page get a buddy run of their own, wherever the hint is */
+    if ((size_t)units * record->size > _mm_max_vm_page_memory_available(1))
+    {
+        return _mm_allocate_units(record, units);
+    }
+
+    uint32_t req_size = record->size * units;
+    vm_page_for_data_t *candidate_pages[] = {hint_page, MM_PREV_DATA_VM_PAGE(hint_page),
+                                             MM_NEXT_DATA_VM_PAGE(hint_page)};
+    for (uint32_t i = 0; i < sizeof(candidate_pages) / sizeof(candidate_pages[0]); i++)
+    {
+        if (candidate_pages[i] == NULL)
+        {
+            continue;
+        }
+
+        meta_block_t *free_meta_block = _mm_find_free_data_block_near(candidate_pages[i], hint, req_size);
+        if (free_meta_block != NULL)
+        {
+            _mm_split_free_data_block_for_allocation(record, free_meta_block, req_size);
+            free_meta_block->handle = 0;
+            free_meta_block->refcount = 1;
+            _mm_trace("alloc", record, free_meta_block + 1, units);
+            return (void *)(free_meta_block + 1);
+        }
+    }
+
+    return _mm_allocate_units(record, units);
+}
+
+/**
+ * @brief Frees memory allocated by `_mm_allocate_units`.
+ *
+ * Blocks of data VM pages with out-of-band metadata have no meta block in front of them; they are recognised from the
+ * header of their page and freed in the side table. The handle of an in-band block allocated by handle is released
+ * too. Objects of the real-time pool are recognised from their address. The heap lock must be held.
+ *
+ * @param app_data Pointer to the memory to free.
+ */
+static void _mm_free_units(void *app_data)
+{
+    if (_mm_rt_pool_owns(app_data))
+    {
+        _mm_rt_free(app_data);
+        return;
+    }
+
+    vm_page_for_data_t *data_vm_page = MM_GET_PAGE_FROM_APP_DATA(app_data);
+    _mm_trace("free", MM_DATA_VM_PAGE_RECORD(data_vm_page), app_data, 0);
+    if (data_vm_page->layout == MM_PAGE_LAYOUT_OUT_OF_BAND)
+    {
+        _mm_free_oob_slots(data_vm_page, app_data);
+        return;
+    }
+
+    /* objects of a struct-of-arrays page are freed with mm_soa_free() */
+    assert(data_vm_page->layout == MM_PAGE_LAYOUT_IN_BAND || data_vm_page->layout == MM_PAGE_LAYOUT_BUDDY);
+
+    meta_block_t *app_data_meta_block = (meta_block_t *)((uint8_t *)app_data - sizeof(meta_block_t));
+
+    assert(app_data_meta_block->is_free == MM_ALLOCATED);
+
+    /* a block allocated by handle and freed with xfree() must not be reachable through its handle anymore */
+    if (app_data_meta_block->handle != 0)
+    {
+        _mm_release_handle_entry(MM_DATA_VM_PAGE_RECORD(data_vm_page), app_data_meta_block->handle - 1);
+    }
+
+    if (data_vm_page->layout == MM_PAGE_LAYOUT_BUDDY)
+    {
+        _mm_buddy_free(data_vm_page);
+        return;
+    }
+
+    _mm_free_data_block(app_data_meta_block);
+}
+
+/**
+ * @brief Writes all bytes described by an iovec array.
+ *
+ * `writev` may write less than asked for, e.g. to a pipe or a socket; the iovecs are advanced past the written bytes
+ * and the rest is written again. The iovec array is consumed.
+ *
+ * @param fd File descriptor to write to.
+ * @param iov Array of iovecs.
+ * @param iov_count Number of iovecs.
+ * @return 0 if everything was written, -1 otherwise.
+ */
+static int8_t _mm_writev_all(int fd, struct iovec *iov, int iov_count)
+{
+    while (iov_count > 0)
+    {
+        ssize_t written = writev(fd, iov, iov_count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        while (iov_count > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0)
+        {
+            iov->iov_base = (uint8_t *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Reads all bytes described by an iovec array.
+ *
+ * The counterpart of `_mm_writev_all`; running into the end of the file before all bytes are read is an error.
+ *
+ * @param fd File descriptor to read from.
+ * @param iov Array of iovecs.
+ * @param iov_count Number of iovecs.
+ * @return 0 if everything was read, -1 otherwise.
+ */
+static int8_t _mm_readv_all(int fd, struct iovec *iov, int iov_count)
+{
+    while (iov_count > 0)
+    {
+        ssize_t nread = readv(fd, iov, iov_count);
+        if (nread < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (nread == 0)
+        {
+            return -1;
+        }
+
+        while (iov_count > 0 && (size_t)nread >= iov->iov_len)
+        {
+            nread -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0)
+        {
+            iov->iov_base = (uint8_t *)iov->iov_base + nread;
+            iov->iov_len -= nread;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Reads a fixed size item from a stream.
+ *
+ * @param fd File descriptor to read from.
+ * @param item Buffer receiving the item.
+ * @param size Size of the item in bytes.
+ * @return 0 if the item was read, -1 otherwise.
+ */
+static int8_t _mm_read_item(int fd, void *item, size_t size)
+{
+    struct iovec iov = {.iov_base = item, .iov_len = size};
+
+    return _mm_readv_all(fd, &iov, 1);
+}
+
+/**
+ * @brief Exports the live objects of a record as an object stream.
+ *
+ * Objects are gathered in batches of MM_EXPORT_BATCH_OBJECTS; each batch goes out with a single `writev` whose
+ * iovecs point straight at the objects.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param fd File descriptor to write to.
+ * @return Number of objects exported, or -1 if writing failed.
+ */
+static int64_t _mm_export_object_stream(struct_record_t *record, int fd)
+{
+    struct iovec iov[MM_EXPORT_BATCH_OBJECTS + 2];
+    uint32_t units[MM_EXPORT_BATCH_OBJECTS];
+    uint32_t stride = _mm_object_stride(record);
+    uint32_t count = 0;
+    int64_t exported = 0;
+    mm_object_cursor_t cursor;
+    void *app_data = NULL;
+    uint32_t size = 0;
+
+    _mm_object_cursor_set_range(&cursor, record, _mm_object_walk_first_page(record), NULL);
+    do
+    {
+        app_data = mm_object_cursor_next(&cursor, &size);
+        if (app_data != NULL)
+        {
+            units[count] = size / stride;
+            iov[count + 2].iov_base = app_data;
+            iov[count + 2].iov_len = (size_t)units[count] * stride;
+            count++;
+        }
+
+        /* a full batch, or the last one which is followed by the empty batch ending the stream */
+        if (count == MM_EXPORT_BATCH_OBJECTS || (app_data == NULL && count != 0))
+        {
+            iov[0].iov_base = &count;
+            iov[0].iov_len = sizeof(count);
+            iov[1].iov_base = units;
+            iov[1].iov_len = count * sizeof(units[0]);
+            if (_mm_writev_all(fd, iov, (int)count + 2) != 0)
+            {
+                return -1;
+            }
+            exported += count;
+            count = 0;
+        }
+    } while (app_data != NULL);
+
+    iov[0].iov_base = &count;
+    iov[0].iov_len = sizeof(count);
+
+    return (_mm_writev_all(fd, iov, 1) == 0 ? exported : -1);
+}
+
+/**
+ * @brief Exports the data VM pages of a record as a page stream.
+ *
+ * Page images are gathered into up to MM_EXPORT_MAX_IOVECS iovecs per `writev`. A page of a record with out-of-band
+ * metadata is followed by the slot bitmaps of its side table entry.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param fd File descriptor to write to.
+ * @return Number of objects exported, or -1 if writing failed.
+ */
+static int64_t _mm_export_page_stream(struct_record_t *record, int fd)
+{
+    static const uint32_t page_marker = 1;
+    static const uint32_t end_marker = 0;
+    struct iovec iov[MM_EXPORT_MAX_IOVECS];
+    int iov_count = 0;
+    int64_t exported = 0;
+
+    for (void *page = _mm_object_walk_first_page(record); page != NULL; page = _mm_object_walk_next_page(record, page))
+    {
+        if (iov_count + 4 > MM_EXPORT_MAX_IOVECS)
+        {
+            if (_mm_writev_all(fd, iov, iov_count) != 0)
+            {
+                return -1;
+            }
+            iov_count = 0;
+        }
+
+        iov[iov_count].iov_base = (void *)&page_marker;
+        iov[iov_count++].iov_len = sizeof(page_marker);
+
+        if (MM_RECORD_USES_SIDE_TABLE(record))
+        {
+            side_table_entry_t *entry = (side_table_entry_t *)page;
+            iov[iov_count].iov_base = MM_REL_PTR_GET(vm_page_for_data_t, entry->data_page);
+            iov[iov_count++].iov_len = SYSTEM_PAGE_SIZE;
+            iov[iov_count].iov_base = entry->used_bitmap;
+            iov[iov_count++].iov_len = sizeof(entry->used_bitmap);
+            iov[iov_count].iov_base = entry->head_bitmap;
+            iov[iov_count++].iov_len = sizeof(entry->head_bitmap);
+            for (uint32_t word = 0; word * 64 < entry->slot_count; word++)
+            {
+                exported += __builtin_popcountll(entry->head_bitmap[word]);
+            }
+        }
+        else
+        {
+            meta_block_t *meta_block_ptr = NULL;
+            iov[iov_count].iov_base = page;
+            iov[iov_count++].iov_len = SYSTEM_PAGE_SIZE;
+            MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(page, meta_block_ptr)
+            {
+                exported += (meta_block_ptr->is_free == MM_ALLOCATED);
+            }
+            MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END;
+        }
+    }
+
+    iov[iov_count].iov_base = (void *)&end_marker;
+    iov[iov_count++].iov_len = sizeof(end_marker);
+
+    return (_mm_writev_all(fd, iov, iov_count) == 0 ? exported : -1);
+}
+
+/**
+ * @brief Imports an object stream into a record.
+ *
+ * For every batch the objects are allocated first and the batch is then read straight into them with a single
+ * `readv`. A batch that cannot be read completely is freed again, earlier batches stay imported.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param fd File descriptor to read from.
+ * @return Number of objects imported, or -1 if reading or allocating failed.
+ */
+static int64_t _mm_import_object_stream(struct_record_t *record, int fd)
+{
+    struct iovec iov[MM_EXPORT_BATCH_OBJECTS];
+    /* the iovecs are advanced while they are read, so the objects are remembered apart for freeing them */
+    void *objects[MM_EXPORT_BATCH_OBJECTS];
+    uint32_t units[MM_EXPORT_BATCH_OBJECTS];
+    uint32_t stride = _mm_object_stride(record);
+    uint32_t count = 0;
+    int64_t imported = 0;
+
+    while (_mm_read_item(fd, &count, sizeof(count)) == 0)
+    {
+        if (count == 0)
+        {
+            return imported;
+        }
+        if (count > MM_EXPORT_BATCH_OBJECTS || _mm_read_item(fd, units, count * sizeof(units[0])) != 0)
+        {
+            return -1;
+        }
+
+        _mm_lock();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            objects[i] = _mm_allocate_units(record, units[i]);
+            iov[i].iov_base = objects[i];
+            iov[i].iov_len = (size_t)units[i] * stride;
+            if (objects[i] == NULL)
+            {
+                while (i-- > 0)
+                {
+                    _mm_free_units(objects[i]);
+                }
+                _mm_unlock();
+                return -1;
+            }
+        }
+        _mm_unlock();
+
+        if (_mm_readv_all(fd, iov, (int)count) != 0)
+        {
+            _mm_lock();
+            for (uint32_t i = 0; i < count; i++)
+            {
+                _mm_free_units(objects[i]);
+            }
+            _mm_unlock();
+            return -1;
+        }
+        imported += count;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Links an imported data VM page image into a record.
+ *
+ * The meta blocks of an in-band page image are linked by self-relative offsets within the page, so they are valid
+ * as read; only the page header is rewritten, the free blocks are queued again and cached objects are freed, which
+ * may release the page again. An out-of-band page gets the side
+ * table entry its slot bitmaps were read into, and a struct-of-arrays page keeps the column table it was exported
+ * with. The heap lock must be held.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param data_vm_page Pointer to the data VM page holding the image.
+ * @param entry Pointer to the side table entry holding the slot bitmaps, NULL for an in-band page.
+ * @return Number of objects in the page.
+ */
+static int64_t _mm_link_imported_data_vm_page(struct_record_t *record, vm_page_for_data_t *data_vm_page,
+                                              side_table_entry_t *entry)
+{
+    int64_t imported = 0;
+
+    MM_REL_PTR_SET(data_vm_page->record, record);
+
+    if (entry != NULL)
+    {
+        data_vm_page->layout = (record->flags & MM_RECORD_STRUCT_OF_ARRAYS ? MM_PAGE_LAYOUT_STRUCT_OF_ARRAYS
+                                                                           : MM_PAGE_LAYOUT_OUT_OF_BAND);
+        MM_REL_PTR_SET(data_vm_page->side_table_entry, entry);
+        entry->slot_size = _mm_oob_slot_size(record);
+        entry->slot_count = (uint16_t)_mm_oob_slots_per_vm_page(record);
+        if (record->flags & MM_RECORD_STRUCT_OF_ARRAYS)
+        {
+            /* the page carries its own column table, which may come from a different field layout */
+            entry->slot_count = (uint16_t)MM_SOA_COLUMNS_OF_PAGE(data_vm_page)->slot_count;
+        }
+        entry->used_slot_count = 0;
+        for (uint32_t word = 0; word * 64 < entry->slot_count; word++)
+        {
+            entry->used_slot_count += __builtin_popcountll(entry->used_bitmap[word]);
+            imported += __builtin_popcountll(entry->head_bitmap[word]);
+        }
+        MM_REL_PTR_SET(entry->data_page, data_vm_page);
+        if (entry->used_slot_count < entry->slot_count)
+        {
+            _mm_side_table_list_add(&record->partial_side_table_entries, entry);
+        }
+        return imported;
+    }
+
+    data_vm_page->layout = MM_PAGE_LAYOUT_IN_BAND;
+    data_vm_page->side_table_entry = 0;
+    data_vm_page->compaction_live_bytes = 0;
+    data_vm_page->compaction_draining = 0;
+    data_vm_page->prev = 0;
+    vm_page_for_data_t *first_page = MM_FIRST_DATA_VM_PAGE(record);
+    MM_REL_PTR_SET(data_vm_page->next, first_page);
+    if (first_page != NULL)
+    {
+        MM_REL_PTR_SET(first_page->prev, data_vm_page);
+    }
+    MM_REL_PTR_SET(record->first_page, data_vm_page);
+
+    meta_block_t *meta_block_ptr = NULL;
+    MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(data_vm_page, meta_block_ptr)
+    {
+        glthread_init_node(&meta_block_ptr->glue_node);
+        /* handles of the exporting heap mean nothing here */
+        meta_block_ptr->handle = 0;
+        if (meta_block_ptr->is_free == MM_FREE)
+        {
+            _mm_add_free_data_block_meta_info(record, meta_block_ptr);
+        }
+        else if (meta_block_ptr->is_free == MM_ALLOCATED)
+        {
+            meta_block_ptr->refcount = 1;
+            imported++;
+        }
+    }
+    MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END;
+
+    /* cached objects were constructed by the exporting process, they are freed rather than cached here */
+    meta_block_ptr = &data_vm_page->meta_block_info;
+    while (meta_block_ptr != NULL)
+    {
+        meta_block_t *next_meta_block = MM_NEXT_META_BLOCK(meta_block_ptr);
+        while (next_meta_block != NULL && next_meta_block->is_free == MM_FREE)
+        {
+            next_meta_block = MM_NEXT_META_BLOCK(next_meta_block);
+        }
+        if (meta_block_ptr->is_free == MM_CACHED)
+        {
+            meta_block_ptr->is_free = MM_ALLOCATED;
+            _mm_free_data_block(meta_block_ptr);
+        }
+        meta_block_ptr = next_meta_block;
+    }
+
+    return imported;
+}
+
+/**
+ * @brief Checks the slot bitmaps and layout of an imported out-of-band or struct-of-arrays page image.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param data_vm_page Pointer to the data VM page holding the image.
+ * @param entry Pointer to the side table entry holding the slot bitmaps.
+ * @return true if every used slot lies inside the page and every allocation starts with a head slot.
+ */
+static bool _mm_imported_slots_are_valid(struct_record_t *record, vm_page_for_data_t *data_vm_page,
+                                         side_table_entry_t *entry)
+{
+    size_t slot_area = SYSTEM_PAGE_SIZE - MM_OOB_SLOT_AREA_OFFSET;
+    uint32_t slot_count = 0;
+
+    if (record->flags & MM_RECORD_STRUCT_OF_ARRAYS)
+    {
+        mm_soa_columns_t *columns = MM_SOA_COLUMNS_OF_PAGE(data_vm_page);
+        slot_count = columns->slot_count;
+        if (data_vm_page->color_offset != 0 || slot_count == 0 || slot_count > MM_OOB_MAX_SLOTS_PER_VM_PAGE ||
+            columns->field_count == 0 || columns->field_count > MM_SOA_MAX_FIELDS)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < columns->field_count; i++)
+        {
+            mm_field_t *field = &columns->fields[i];
+            if ((size_t)field->offset + field->size > record->size || columns->column_offset[i] < sizeof(*columns) ||
+                columns->column_offset[i] + (size_t)slot_count * field->size > slot_area)
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        slot_count = _mm_oob_slots_per_vm_page(record);
+        if (data_vm_page->color_offset + (size_t)slot_count * _mm_oob_slot_size(record) > slot_area)
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t slot = 0; slot < MM_OOB_MAX_SLOTS_PER_VM_PAGE; slot++)
+    {
+        bool used = MM_OOB_SLOT_BIT_IS_SET(entry->used_bitmap, slot);
+        bool head = MM_OOB_SLOT_BIT_IS_SET(entry->head_bitmap, slot);
+        if ((used || head) && slot >= slot_count)
+        {
+            return false;
+        }
+        /* a head slot is used, and a used slot that is not a head continues the allocation before it */
+        if ((head && !used) || (used && !head && (slot == 0 || !MM_OOB_SLOT_BIT_IS_SET(entry->used_bitmap, slot - 1))))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Checks the meta block chain of an imported in-band page image.
+ *
+ * The blocks of an in-band page tile it from the header meta block on, so every block has to sit right behind its
+ * predecessor, record its own offset, link back to it and end inside the page; only the header meta block may be a
+ * padding block. This keeps a corrupt or hostile stream from making the allocator follow links out of the page.
+ *
+ * @param data_vm_page Pointer to the data VM page holding the image.
+ * @return true if the chain is well formed.
+ */
+static bool _mm_imported_blocks_are_valid(vm_page_for_data_t *data_vm_page)
+{
+    meta_block_t *prev_meta_block = NULL;
+    size_t expected_offset = MM_BLOCK_OFFSETOF(vm_page_for_data_t, meta_block_info);
+
+    while (expected_offset != 0)
+    {
+        meta_block_t *meta_block_ptr = (meta_block_t *)((uint8_t *)data_vm_page + expected_offset);
+        size_t block_end = expected_offset + sizeof(meta_block_t) + meta_block_ptr->data_block_size;
+        if (meta_block_ptr->offset != expected_offset || block_end > SYSTEM_PAGE_SIZE ||
+            MM_PREV_META_BLOCK(meta_block_ptr) != prev_meta_block ||
+            (meta_block_ptr->is_free != MM_FREE && meta_block_ptr->is_free != MM_ALLOCATED &&
+             meta_block_ptr->is_free != MM_CACHED && meta_block_ptr->is_free != MM_PADDING) ||
+            (meta_block_ptr->is_free == MM_PADDING && prev_meta_block != NULL))
+        {
+            return false;
+        }
+
+        expected_offset = 0;
+        if (meta_block_ptr->next != 0)
+        {
+            if (block_end + sizeof(meta_block_t) > SYSTEM_PAGE_SIZE ||
+                MM_NEXT_META_BLOCK(meta_block_ptr) != MM_NEXT_META_BLOCK_BY_SIZE(meta_block_ptr))
+            {
+                return false;
+            }
+            expected_offset = block_end;
+        }
+        prev_meta_block = meta_block_ptr;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Imports a page stream into a record.
+ *
+ * Every page image is read straight into a freshly obtained data VM page, checked and then linked into the record.
+ * Pages linked before a failure stay in the record.
+ *
+ * @param record Pointer to the struct_record_t object.
+ * @param fd File descriptor to read from.
+ * @return Number of objects imported, or -1 if reading failed, a page image is malformed or no VM page could be
+ *         obtained.
+ */
+static int64_t _mm_import_page_stream(struct_record_t *record, int fd)
+{
+    uint32_t page_marker = 0;
+    int64_t imported = 0;
+    bool out_of_band = MM_RECORD_USES_SIDE_TABLE(record);
+
+    while (_mm_read_item(fd, &page_marker, sizeof(page_marker)) == 0)
+    {
+        if (page_marker == 0)
+        {
+            return imported;
+        }
+
+        side_table_entry_t *entry = NULL;
+        _mm_lock();
+        if (!_mm_budget_charge(record, SYSTEM_PAGE_SIZE))
+        {
+            _mm_unlock();
+            return -1;
+        }
+        if (out_of_band && (entry = _mm_get_unused_side_table_entry(record)) == NULL)
+        {
+            _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE);
+            _mm_unlock();
+            return -1;
+        }
+        vm_page_for_data_t *data_vm_page =
+            (vm_page_for_data_t *)_mm_request_vm_page(1, _mm_numa_node_of_record(record));
+        if (data_vm_page == NULL)
+        {
+            if (entry != NULL)
+            {
+                _mm_side_table_list_add(&record->unused_side_table_entries, entry);
+            }
+            _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE);
+        }
+        _mm_unlock();
+        if (data_vm_page == NULL)
+        {
+            return -1;
+        }
+
+        struct iovec iov[3] = {{.iov_base = data_vm_page, .iov_len = SYSTEM_PAGE_SIZE}};
+        if (entry != NULL)
+        {
+            iov[1].iov_base = entry->used_bitmap;
+            iov[1].iov_len = sizeof(entry->used_bitmap);
+            iov[2].iov_base = entry->head_bitmap;
+            iov[2].iov_len = sizeof(entry->head_bitmap);
+        }
+
+        int8_t status = _mm_readv_all(fd, iov, entry != NULL ? 3 : 1);
+        if (status == 0 && !(entry != NULL ? _mm_imported_slots_are_valid(record, data_vm_page, entry)
+                                           : _mm_imported_blocks_are_valid(data_vm_page)))
+        {
+            status = -1;
+        }
+
+        _mm_lock();
+        if (status != 0)
+        {
+            if (entry != NULL)
+            {
+                _mm_side_table_list_add(&record->unused_side_table_entries, entry);
+            }
+            _mm_budget_uncharge(record, SYSTEM_PAGE_SIZE);
+            _mm_release_vm_page(data_vm_page, 1);
+            _mm_unlock();
+            return -1;
+        }
+        imported += _mm_link_imported_data_vm_page(record, data_vm_page, entry);
+        _mm_unlock();
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Prints the block usage of every record, registered with atexit() by the stats_print option.
+ */
+static void _mm_print_stats_at_exit(void)
+{
+    mm_print_block_usage();
+}
+
+/**
+ * @brief Reports an option of a configuration string that cannot be applied.
+ *
+ * @param option Start of the "key:value" pair.
+ * @param length Length of the pair.
+ */
+static void _mm_report_invalid_option(const char *option, size_t length)
+{
+    char line[128];
+    int line_length = snprintf(line, sizeof(line), "mm: ignoring invalid option \"%.*s\"\n", (int)length, option);
+    if (line_length > 0)
+    {
+        write(STDERR_FILENO, line, (size_t)line_length < sizeof(line) ? (size_t)line_length : sizeof(line) - 1);
+    }
+}
+
+/**
+ * @brief Parses the value of a numeric option.
+ *
+ * @param value Start of the value.
+ * @param length Length of the value.
+ * @param min Smallest accepted value.
+ * @param number Filled with the value.
+ * @return true if the value is a decimal number of at least `min` fitting in 32 bits.
+ */
+static bool _mm_parse_option_number(const char *value, size_t length, uint32_t min, uint32_t *number)
+{
+    uint64_t parsed = 0;
+    if (length == 0 || length > 10)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        if (value[i] < '0' || value[i] > '9')
+        {
+            return false;
+        }
+        parsed = parsed * 10 + (uint64_t)(value[i] - '0');
+    }
+    if (parsed < min || parsed > UINT32_MAX)
+    {
+        return false;
+    }
+
+    *number = (uint32_t)parsed;
+    return true;
+}
+
+/**
+ * @brief Parses the value of a switch.
+ *
+ * @param value Start of the value.
+ * @param length Length of the value.
+ * @param on Filled with the value.
+ * @return true if the value is "true" or "false".
+ */
+static bool _mm_parse_option_switch(const char *value, size_t length, bool *on)
+{
+    if (length == 4 && strncmp(value, "true", 4) == 0)
+    {
+        *on = true;
+        return true;
+    }
+    if (length == 5 && strncmp(value, "false", 5) == 0)
+    {
+        *on = false;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Applies one "key:value" option.
+ *
+ * The heap lock must be held.
+ *
+ * @param option Start of the option.
+ * @param length Length of the option.
+ * @return true if the option is known and its value valid.
+ */
+static bool _mm_apply_option(const char *option, size_t length)
+{
+    const char *separator = memchr(option, ':', length);
+    if (separator == NULL)
+    {
+        return false;
+    }
+
+    size_t key_length = (size_t)(separator - option);
+    const char *value = separator + 1;
+    size_t value_length = length - key_length - 1;
+
+#define MM_OPTION_KEY_IS(key) (key_length == sizeof(key) - 1 && strncmp(option, key, key_length) == 0)
+    bool valid = false;
+    if (MM_OPTION_KEY_IS("page_cache"))
+    {
+        valid = _mm_parse_option_number(value, value_length, 0, &mm_config.page_cache_pages);
+    }
+    else if (MM_OPTION_KEY_IS("span"))
+    {
+        valid = _mm_parse_option_number(value, value_length, 1, &mm_config.span_pages);
+    }
+    else if (MM_OPTION_KEY_IS("huge_pages"))
+    {
+        valid = _mm_parse_option_switch(value, value_length, &mm_config.huge_pages);
+    }
+    else if (MM_OPTION_KEY_IS("stats_print"))
+    {
+        valid = _mm_parse_option_switch(value, value_length, &mm_config.stats_print);
+    }
+    else if (MM_OPTION_KEY_IS("trace"))
+    {
+        valid = _mm_parse_option_switch(value, value_length, &mm_config.trace);
+    }
+    else if (MM_OPTION_KEY_IS("coloring"))
+    {
+        valid = _mm_parse_option_switch(value, value_length, &mm_config.cache_coloring);
+    }
+#undef MM_OPTION_KEY_IS
+
+    return valid;
+}
+
+/**
+ * @brief Changes runtime settings of the allocator.
+ *
+ * The string holds "key:value" pairs separated by commas, in the style of MALLOC_CONF, e.g.
+ * "page_cache:64,span:16,stats_print:true". The keys are:
+ *
+ * - page_cache: number of empty VM pages the private heap keeps per NUMA node for reuse instead of unmapping them
+ *   (default 0).
+ * - span: number of VM pages the private heap maps at once when it needs a page and its cache is empty (default 1).
+ * - huge_pages: true to ask for transparent huge pages on every span (default false).
+ * - stats_print: true to print the block usage of every record when the process exits (default false).
+ * - trace: true to write a line to stderr for every allocation and free (default false).
+ * - coloring: true to start the objects of consecutive data VM pages of a record at different cache lines, which
+ *   costs no memory (default true).
+ *
+ * Invalid pairs are reported on stderr and skipped; the other pairs are applied. mm_init() applies the string held by
+ * the MM_CONF environment variable, so a process can be tuned without a rebuild.
+ *
+ * @param conf The configuration string.
+ * @return 0 if every pair was applied, -1 if some were invalid.
+ */
+int8_t mm_configure(const char *conf)
+{
+    static bool stats_registered = false;
+    int8_t rc = 0;
+
+    _mm_lock();
+    while (*conf != '\0')
+    {
+        size_t length = strcspn(conf, ",");
+        if (length != 0 && !_mm_apply_option(conf, length))
+        {
+            _mm_report_invalid_option(conf, length);
+            rc = -1;
+        }
+        conf += length;
+        if (*conf == ',')
+        {
+            conf++;
+        }
+    }
+    bool register_stats = (mm_config.stats_print && !stats_registered);
+    stats_registered = stats_registered || register_stats;
+    _mm_unlock();
+
+    if (register_stats)
+    {
+        atexit(_mm_print_stats_at_exit);
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Caches the id of the process, in the child after fork() too.
+ */
+static void _mm_refresh_pid(void)
+{
+    mm_pid = getpid();
+}
+
+/**
+ * @brief Fork handler run in the child.
+ *
+ * Threads counted in `mm_mapped_heap_users` do not exist in the child, so the count is reset to the lock the calling
+ * thread may hold across fork(), see `mm_prefork`.
+ */
+static void _mm_atfork_child(void)
+{
+    _mm_refresh_pid();
+    mm_mapped_heap_users = (mm_locked_heap != NULL && mm_locked_heap != &mm_private_heap ? 1 : 0);
+}
+
+/**
+ * @brief Initializes the memory management system.
+ *
+ * This function initializes the memory management system by retrieving the system page size
+ * using the `sysconf` function and storing it in the `SYSTEM_PAGE_SIZE` global variable.
+ * It is typically called at the start of the program to set up the memory management system.
+ * The first call also applies the settings held by the MM_CONF environment variable, see `mm_configure`, and
+ * registers a fork handler that sets up the child process.
+ */
+void mm_init(void)
+{
+    static bool conf_applied = false;
+
+    SYSTEM_PAGE_SIZE = sysconf(_SC_PAGESIZE);
+    mm_private_heap.page_size = (uint32_t)SYSTEM_PAGE_SIZE;
+    _mm_refresh_pid();
+    _mm_numa_init();
+
+    if (!__atomic_exchange_n(&conf_applied, true, __ATOMIC_ACQ_REL))
+    {
+        pthread_atfork(NULL, NULL, _mm_atfork_child);
+        const char *conf = getenv(MM_CONF_ENV);
+        if (conf != NULL)
+        {
+            mm_configure(conf);
+        }
+    }
+}
+
+/**
+ * @brief Initializes the lock of a heap living in a mapping.
+ *
+ * The lock is made process-shared and robust so that every process mapping the heap can take it and a process dying
+ * while holding it does not wedge the others.
+ *
+ * @param mapped_heap Pointer to the heap header.
+ */
+static void _mm_init_heap_lock(mm_heap_t *mapped_heap)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&mapped_heap->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/**
+ * @brief Formats a freshly created shared heap mapping.
+ *
+ * The first pages of the mapping hold the heap header; the rest is handed out as VM pages.
+ *
+ * @param shared_heap Pointer to the start of the mapping.
+ * @param region_size Size of the mapping in bytes.
+ */
+static void _mm_format_shared_heap(mm_heap_t *shared_heap, size_t region_size)
+{
+    _mm_init_heap_lock(shared_heap);
+
+    shared_heap->page_size = (uint32_t)SYSTEM_PAGE_SIZE;
+    shared_heap->region_size = region_size;
+    shared_heap->region_used = (sizeof(mm_heap_t) + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE * SYSTEM_PAGE_SIZE;
+    shared_heap->free_region_pages = 0;
+    shared_heap->vm_page_record_head = 0;
+    shared_heap->root = 0;
+    shared_heap->dirty = 0;
+    shared_heap->metadata_version = MM_METADATA_VERSION;
+    memset(shared_heap->size_class_records, 0, sizeof(shared_heap->size_class_records));
+    shared_heap->magic = MM_HEAP_MAGIC;
+}
+
+/**
+ * @brief Maps the heap held by a file or shared memory object, with the format lock of the object held.
+ *
+ * @param fd File descriptor of the object.
+ * @param region_size Size of the heap in bytes, used when the object is empty.
+ * @param mapped_heap Filled with the mapped heap header.
+ * @return 0 if the heap is mapped, -1 if the object cannot be sized or mapped, -2 if it does not hold a heap
+ *         of this page size and metadata version.
+ */
+static int8_t _mm_map_heap_locked(int fd, size_t region_size, mm_heap_t **mapped_heap)
+{
+    struct stat fd_stat;
+
+    if (fstat(fd, &fd_stat) != 0)
+    {
+        return -1;
+    }
+
+    bool created = (fd_stat.st_size == 0);
+    if (created)
+    {
+        region_size = (region_size + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE * SYSTEM_PAGE_SIZE;
+        if (region_size <= sizeof(mm_heap_t) || ftruncate(fd, region_size) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        region_size = fd_stat.st_size;
+    }
+
+    mm_heap_t *shared_heap = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shared_heap == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    /* only an object this call grew is formatted, anything else is checked and left untouched if it is not a heap */
+    if (created)
+    {
+        shared_heap->state = MM_HEAP_FORMATTING;
+        _mm_format_shared_heap(shared_heap, region_size);
+        shared_heap->state = MM_HEAP_READY;
+    }
+
+    /* a heap left FORMATTING was being formatted by a process that died, and holds nothing to attach to */
+    if (shared_heap->state != MM_HEAP_READY || shared_heap->magic != MM_HEAP_MAGIC ||
+        shared_heap->metadata_version != MM_METADATA_VERSION || shared_heap->page_size != SYSTEM_PAGE_SIZE ||
+        shared_heap->region_size != region_size)
+    {
+        munmap(shared_heap, region_size);
+        return -2;
+    }
+
+    *mapped_heap = shared_heap;
+
+    return 0;
+}
+
+/**
+ * @brief Maps the heap held by a file or shared memory object.
+ *
+ * The first process to map the object finds it empty, grows it to `region_size` and formats it; later processes map
+ * the existing heap and use its size. An object that is not empty is never formatted, so pointing this at a file
+ * that does not hold a heap refuses it instead of wiping it. Processes mapping the object are serialised with a POSIX
+ * record lock on it rather than with a flag in the heap: the kernel drops the lock of a process that dies, so a
+ * process dying while formatting leaves a heap that later processes refuse instead of one they wait for.
+ *
+ * @param fd File descriptor of the object.
+ * @param region_size Size of the heap in bytes, used when the object is empty.
+ * @param mapped_heap Filled with the mapped heap header.
+ * @return 0 if the heap is mapped, -1 if the object cannot be locked, sized or mapped, -2 if it does not hold a heap
+ *         of this page size and metadata version.
+ */
+static int8_t _mm_map_heap(int fd, size_t region_size, mm_heap_t **mapped_heap)
+{
+    struct flock format_lock = {.l_type = F_WRLCK, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0};
+
+    SYSTEM_PAGE_SIZE = sysconf(_SC_PAGESIZE);
+
+    int rc = 0;
+    while ((rc = fcntl(fd, F_SETLKW, &format_lock)) != 0 && errno == EINTR)
+    {
+    }
+    if (rc != 0)
+    {
+        return -1;
+    }
+
+    int8_t status = _mm_map_heap_locked(fd, region_size, mapped_heap);
+
+    format_lock.l_type = F_UNLCK;
+    fcntl(fd, F_SETLK, &format_lock);
+
+    return status;
+}
+
+/**
+ * @brief Makes another heap the one all calls operate on, and releases the heap lock.
+ *
+ * Called with the lock of the attached heap held, so that no thread is inside the allocator on it. Threads already
+ * waiting for that lock find the switch once they get it and move on to the new heap. A mapped old heap is unmapped
+ * once the last of them has let go of its lock.
+ *
+ * @param new_heap Pointer to the heap to attach.
+ */
+static void _mm_switch_heap(mm_heap_t *new_heap)
+{
+    mm_heap_t *old_heap = mm_locked_heap;
+    size_t old_region_size = old_heap->region_size;
+
+    __atomic_add_fetch(&heap_epoch, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&heap, new_heap, __ATOMIC_SEQ_CST);
+    _mm_unlock();
+
+    if (old_heap != &mm_private_heap)
+    {
+        while (__atomic_load_n(&mm_mapped_heap_users, __ATOMIC_ACQUIRE) != 0)
+        {
+            sched_yield();
+        }
+        munmap(old_heap, old_region_size);
+    }
+}
+
+/**
+ * @brief Attaches the memory management system to a shared heap.
+ *
+ * This function maps the shared memory object referred to by `fd` (a memfd or a POSIX shm object) and makes it the
+ * heap all subsequent calls operate on. Struct records, data VM pages and meta blocks all live inside the mapping and
+ * are linked by self-relative offsets, so every process mapping the same object sees the same heap even if the object
+ * is mapped at a different address. The first process to attach formats the mapping, growing an empty object to
+ * `region_size`; later processes attach to the existing heap and use its size. Objects are handed between processes
+ * as offsets obtained with `mm_shared_offset` and turned back into pointers with `mm_shared_ptr`. Only one heap can be
+ * attached besides the private one, `mm_detach_shared` has to be called before attaching another.
+ *
+ * @param fd File descriptor of the shared memory object.
+ * @param region_size Size of the heap in bytes, used when the object is empty.
+ * @return 0 if the heap is attached, -1 if the object cannot be sized or mapped, -2 if it does not hold a heap, -3 if
+ *         a shared, persistent or compressed heap is already attached.
+ */
+int8_t mm_init_shared(int fd, size_t region_size)
+{
+    mm_heap_t *shared_heap = NULL;
+
+    if (heap != &mm_private_heap)
+    {
+        return -3;
+    }
+
+    int8_t status = _mm_map_heap(fd, region_size, &shared_heap);
+    if (status != 0)
+    {
+        return status;
+    }
+
+    _mm_lock();
+    _mm_switch_heap(shared_heap);
+
+    return 0;
+}
+
+/**
+ * @brief Opens a persistent heap backed by a file.
+ *
+ * This function maps the file at `path`, creating and formatting it if it does not exist yet, and makes it the heap
+ * all subsequent calls operate on. As with a shared heap, all metadata inside the file is position independent, so a
+ * restarted process finds its records, data VM pages and live objects in place without rebuilding anything; the root
+ * object set with `mm_set_heap_root` is the entry point to the application's data. The heap is marked dirty while it
+ * is open and clean again by `mm_close_persistent`, which detects a process that went away without closing it. The file
+ * is locked with flock() while the heap is open, so only one process at a time can open it.
+ *
+ * @param path Path of the file backing the heap.
+ * @param region_size Size of the heap in bytes, used when the file is created.
+ * @return 0 if the heap is open, 1 if it is open but was not closed cleanly last time, -1 if the file cannot be
+ *         opened, sized or mapped, -2 if it does not hold a heap, -3 if a shared, persistent or compressed heap is
+ *         already attached, -4 if another process has the heap open.
+ */
+int8_t mm_init_persistent(const char *path, size_t region_size)
+{
+    mm_heap_t *persistent_heap = NULL;
+
+    if (heap != &mm_private_heap)
+    {
+        return -3;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(fd);
+        return errno == EWOULDBLOCK ? -4 : -1;
+    }
+
+    int8_t status = _mm_map_heap(fd, region_size, &persistent_heap);
+    if (status != 0)
+    {
+        close(fd);
+        return status;
+    }
+
+    uint32_t was_dirty = persistent_heap->dirty;
+    if (was_dirty)
+    {
+        /* the process that did not close the heap may have died inside the allocator, leaving the lock held; with
+         * the file locked no other process can be using it */
+        pthread_mutex_destroy(&persistent_heap->lock);
+        _mm_init_heap_lock(persistent_heap);
+    }
+    persistent_heap->dirty = 1;
+    msync(persistent_heap, SYSTEM_PAGE_SIZE, MS_SYNC);
+
+    _mm_lock();
+    mm_persistent_fd = fd;
+    _mm_switch_heap(persistent_heap);
+
+    return was_dirty ? 1 : 0;
+}
+
+/**
+ * @brief Closes the persistent heap.
+ *
+ * This function writes the heap back to its file, marks it clean and switches back to the private heap. All of it
+ * happens with the heap lock held, so no thread changes the heap between the write back and the clean marker, and
+ * threads calling into the allocator meanwhile carry on with the private heap once it is attached.
+ *
+ * @return 0 if the heap was written back and marked clean, -1 if no persistent heap is open or writing failed.
+ */
+int8_t mm_close_persistent(void)
+{
+    _mm_lock();
+    if (mm_persistent_fd == -1)
+    {
+        _mm_unlock();
+        return -1;
+    }
+
+    int8_t status = 0;
+    if (msync(heap, heap->region_size, MS_SYNC) != 0)
+    {
+        status = -1;
+    }
+    else
+    {
+        /* the marker is only cleared once everything it vouches for is on disk */
+        heap->dirty = 0;
+        if (msync(heap, SYSTEM_PAGE_SIZE, MS_SYNC) != 0)
+        {
+            status = -1;
+        }
+    }
+
+    close(mm_persistent_fd);
+    mm_persistent_fd = -1;
+    _mm_switch_heap(&mm_private_heap);
+
+    return status;
+}
+
+/**
+ * @brief Sets the root object of the heap.
+ *
+ * @param app_data Pointer to memory allocated from the heap, or NULL to clear the root.
+ */
+void mm_set_heap_root(void *app_data)
+{
+    _mm_lock();
+    MM_REL_PTR_SET(heap->root, app_data);
+    _mm_unlock();
+}
+
+/**
+ * @brief Returns the root object of the heap.
+ *
+ * @return Pointer to the root object, or NULL if none is set.
+ */
+void *mm_get_heap_root(void)
+{
+    _mm_lock();
+    void *root = MM_REL_PTR_GET(void, heap->root);
+    _mm_unlock();
+
+    return root;
+}
+
+/**
+ * @brief Detaches the memory management system from the shared heap.
+ *
+ * This function unmaps the shared heap of this process and switches back to the private heap. The shared heap itself,
+ * and every object in it, stays alive for as long as the shared memory object exists. The switch happens with the
+ * heap lock held, so threads calling into the allocator meanwhile carry on with the private heap.
+ */
+void mm_detach_shared(void)
+{
+    _mm_lock();
+    if (heap == &mm_private_heap || mm_persistent_fd != -1)
+    {
+        _mm_unlock();
+        return;
+    }
+
+    _mm_switch_heap(&mm_private_heap);
+}
+
+/**
+ * @brief Returns a number that changes whenever another heap is attached.
+ *
+ * Caches of objects kept outside of the allocator, such as the per-thread lists of mm::pool, compare it with the
+ * number they were filled under to tell that their objects belong to a heap that is no longer attached. It is read
+ * without taking the heap lock.
+ *
+ * @return The attachment count of the heap.
+ */
+uint64_t mm_heap_epoch(void)
+{
+    return __atomic_load_n(&heap_epoch, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Tells whether an offset from the start of the attached heap may point to memory handed out by the heap.
+ *
+ * Only heaps living in a mapping (shared, persistent or compressed) have offsets; the heap header at the start of the
+ * mapping never holds application memory, so offset 0 is free to mean "no object".
+ *
+ * @param offset Offset from the start of the heap header.
+ * @return true if the offset lies past the heap header and inside the mapping.
+ */
+static bool _mm_heap_offset_is_valid(uint64_t offset)
+{
+    return heap->region_size != 0 && offset >= sizeof(mm_heap_t) && offset < heap->region_size;
+}
+
+/**
+ * @brief Converts a pointer into the attached heap into a position independent offset.
+ *
+ * The offset is the distance from the start of the mapping of a shared, persistent or compressed heap, the same for
+ * every process mapping the heap; in a compressed heap it is the `mm_cref_t` of the object times MM_CREF_ALIGNMENT.
+ * The private heap has no offsets.
+ *
+ * @param app_data Pointer to memory in the attached heap.
+ * @return Offset of the memory from the start of the heap, or 0 if the private heap is attached or the pointer is
+ *         outside of the attached heap.
+ */
+uint64_t mm_shared_offset(const void *app_data)
+{
+    uint64_t offset = (uint64_t)((uintptr_t)app_data - (uintptr_t)heap);
+
+    if ((uintptr_t)app_data < (uintptr_t)heap || !_mm_heap_offset_is_valid(offset))
+    {
+        return 0;
+    }
+
+    return offset;
+}
+
+/**
+ * @brief Converts an offset obtained with `mm_shared_offset` into a pointer valid in this process.
+ *
+ * @param offset Offset of the memory from the start of the heap.
+ * @return Pointer to the memory, or NULL if the private heap is attached or the offset is outside of the attached
+ *         heap.
+ */
+void *mm_shared_ptr(uint64_t offset)
+{
+    if (!_mm_heap_offset_is_valid(offset))
+    {
+        return NULL;
+    }
+
+    return (void *)((uint8_t *)heap + offset);
+}
+
+/**
+ * @brief Sets up the pool serving the records registered with MM_RECORD_REALTIME.
+ *
+ * The pool is mapped, populated and locked in memory here, so that allocating and freeing objects of real-time records
+ * later never makes a system call and takes a bounded number of steps whatever the state of the pool: no list is
+ * walked, no page is mapped or unmapped and, unlike `xcalloc`, `mm_record_alloc` does not write to the memory it
+ * returns. An allocation the pool has no room for fails at once. Locking the pool is best effort, it stays populated
+ * but may be swapped out if RLIMIT_MEMLOCK is too low. The pool is private to the process, even for records of a
+ * shared or persistent heap. It has a lock of its own: `mm_record_alloc` on a real-time record and `xfree` of its
+ * objects take only that lock, so they never wait for another thread mapping pages under the heap lock. `xcalloc`
+ * and the other calls looking a record up by name still take the heap lock first.
+ *
+ * @param pool_size Size of the pool in bytes.
+ * @return 0 if the pool is set up, -1 if a pool already exists, the size is too small or too large or the pool could
+ *         not be mapped.
+ */
+int8_t mm_init_realtime(size_t pool_size)
+{
+    SYSTEM_PAGE_SIZE = sysconf(_SC_PAGESIZE);
+    pool_size = (pool_size + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE * SYSTEM_PAGE_SIZE;
+    if (pool_size < 2 * MM_RT_BLOCK_HEADER_SIZE + MM_RT_BLOCK_MIN_SIZE || pool_size >= (1ULL << MM_RT_FL_INDEX_MAX))
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mm_rt_pool.lock);
+    if (mm_rt_pool.base != NULL)
+    {
+        pthread_mutex_unlock(&mm_rt_pool.lock);
+        return -1;
+    }
+
+    uint8_t *base = mmap(NULL, pool_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_POPULATE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        pthread_mutex_unlock(&mm_rt_pool.lock);
+        return -1;
+    }
+    mlock(base, pool_size);
+
+    mm_rt_block_t *block = (mm_rt_block_t *)base;
+    block->prev_phys = NULL;
+    block->size = pool_size - 2 * MM_RT_BLOCK_HEADER_SIZE;
+    mm_rt_block_t *sentinel = MM_RT_NEXT_PHYS_BLOCK(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+    sentinel->is_free = MM_ALLOCATED;
+
+    mm_rt_pool.size = pool_size;
+    mm_rt_pool.used_bytes = 0;
+    _mm_rt_insert_free_block(block);
+    __atomic_store_n(&mm_rt_pool.base, base, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&mm_rt_pool.lock);
+
+    return 0;
+}
+
+/**
+ * @brief Attaches the memory management system to a new private heap in which objects have 32-bit references.
+ *
+ * The heap is an anonymous mapping of `region_size` bytes starting on a multiple of MM_CREF_REGION_SIZE, and every
+ * data VM page of it is carved out of that mapping. An object is then named by its offset from the start of the
+ * mapping in units of MM_CREF_ALIGNMENT, which fits in 32 bits, and the start of the mapping can be recovered from the
+ * address of any object in it. Objects allocated before the call stay in the previous private heap; `mm_detach_shared`
+ * unmaps the heap and switches back.
+ *
+ * @param region_size Size of the heap in bytes, at most MM_CREF_REGION_SIZE.
+ * @return 0 if the heap is attached, -1 if the size is invalid, another heap than the private one is attached, or
+ *         the address space could not be reserved.
+ */
+int8_t mm_init_compressed(size_t region_size)
+{
+    SYSTEM_PAGE_SIZE = sysconf(_SC_PAGESIZE);
+    region_size = (region_size + SYSTEM_PAGE_SIZE - 1) / SYSTEM_PAGE_SIZE * SYSTEM_PAGE_SIZE;
+    if (region_size <= sizeof(mm_heap_t) || region_size > MM_CREF_REGION_SIZE || heap != &mm_private_heap)
+    {
+        return -1;
+    }
+
+    /* the address space is reserved inaccessible, so that only the heap itself counts as committed memory */
+    uint8_t *base = _mm_map_aligned(region_size, MM_CREF_REGION_SIZE, PROT_NONE);
+    if (base == NULL)
+    {
+        return -1;
+    }
+    if (mprotect(base, region_size, PROT_READ | PROT_WRITE) != 0)
+    {
+        munmap(base, region_size);
+        return -1;
+    }
+
+    mm_heap_t *compressed_heap = (mm_heap_t *)base;
+    _mm_format_shared_heap(compressed_heap, region_size);
+    compressed_heap->state = MM_HEAP_READY;
+
+    _mm_lock();
+    _mm_switch_heap(compressed_heap);
+
+    return 0;
+}
+
+/**
+ * @brief Converts a pointer to an object of the attached compressed heap into a 32-bit reference.
+ *
+ * Only memory inside the region of the heap has a reference. Objects of records registered with MM_RECORD_REALTIME
+ * come from the real-time pool and objects allocated before the heap was attached from the private heap, so they get
+ * MM_CREF_NULL rather than a reference that would decode to another address.
+ *
+ * @param app_data Pointer to an object of the heap, on a multiple of MM_CREF_ALIGNMENT.
+ * @return Reference to the object, or MM_CREF_NULL for NULL, if no compressed heap is attached or if the pointer lies
+ *         outside of the heap or off MM_CREF_ALIGNMENT.
+ */
+mm_cref_t mm_cref_encode(const void *app_data)
+{
+    uintptr_t offset = (uintptr_t)app_data - (uintptr_t)heap;
+    if (((uintptr_t)heap & (MM_CREF_REGION_SIZE - 1)) != 0 || (uintptr_t)app_data < (uintptr_t)heap ||
+        !_mm_heap_offset_is_valid(offset) || (offset & (MM_CREF_ALIGNMENT - 1)) != 0)
+    {
+        return MM_CREF_NULL;
+    }
+
+    return (mm_cref_t)(offset >> MM_CREF_SHIFT);
+}
+
+/**
+ * @brief Converts a 32-bit reference into a pointer to an object of the attached compressed heap.
+ *
+ * `mm_cref_decode_near` does the same without a call when a pointer into the heap is at hand.
+ *
+ * @param ref Reference obtained with `mm_cref_encode`.
+ * @return Pointer to the object, or NULL for MM_CREF_NULL or if no compressed heap is attached.
+ */
+void *mm_cref_decode(mm_cref_t ref)
+{
+    if (ref == MM_CREF_NULL || heap->region_size == 0 || ((uintptr_t)heap & (MM_CREF_REGION_SIZE - 1)) != 0)
+    {
+        return NULL;
+    }
+
+    return mm_cref_decode_near(heap, ref);
+}
+
+/**
+ * @brief Adds a struct record to the record VM pages.
+ *
+ * The heap lock must be held.
+ *
+ * @param struct_name The name of the struct to register.
+ * @param size The size of the struct.
+ * @param flags MM_RECORD_* flags of the struct.
+ * @param new_record Filled with the new struct record.
+ * @return 0 if the struct record is added, -2 if the struct name already exists in the record list,
+ *         -3 if no VM page could be obtained.
+ */
+static int8_t _mm_add_struct_record(const char *struct_name, size_t size, uint32_t flags,
+                                    struct_record_t **new_record)
+{
+    if (_mm_lookup_struct_record_by_name(struct_name) != NULL)
+    {
+        /* struct name already exists in the record list */
+        return -2;
+    }
+
+    return _mm_append_struct_record(struct_name, size, flags, new_record);
+}
+
+/**
+ * @brief Finds the size class of a request.
+ *
+ * Classes are 16 bytes apart up to 128 bytes and four per power of two above that, which bounds the memory lost to
+ * rounding to 25% and keeps every class a multiple of MM_SIZE_CLASS_ALIGNMENT.
+ *
+ * @param bytes Size of the request, at most MM_SIZE_CLASS_MAX_BYTES.
+ * @param class_size Filled with the size of the class.
+ * @return Index of the class.
+ */
+static uint32_t _mm_size_class_index(size_t bytes, uint32_t *class_size)
+{
+    if (bytes <= 128)
+    {
+        uint32_t index = (bytes == 0 ? 0 : (uint32_t)((bytes - 1) / 16));
+        *class_size = (index + 1) * 16;
+        return index;
+    }
+
+    /* bytes lies in (2^shift, 2^(shift + 1)], which is split into four classes of 2^(shift - 2) bytes */
+    uint32_t shift = 63 - (uint32_t)__builtin_clzll((unsigned long long)(bytes - 1));
+    uint32_t step = 1U << (shift - 2);
+    uint32_t quarter = (uint32_t)((bytes - 1 - (1ULL << shift)) / step);
+    *class_size = (1U << shift) + (quarter + 1) * step;
+
+    return 8 + (shift - 7) * 4 + quarter;
+}
+
+/**
+ * @brief Returns the record of a size class, registering it on first use.
+ *
+ * The heap lock must be held.
+ *
+ * @param index Index of the size class.
+ * @param class_size Size of the class.
+ * @return Pointer to the struct_record_t object, or NULL if it could not be registered.
+ */
+static struct_record_t *_mm_size_class_record(uint32_t index, uint32_t class_size)
+{
+    struct_record_t *record = MM_REL_PTR_GET(struct_record_t, heap->size_class_records[index]);
+    if (record != NULL)
+    {
+        return record;
+    }
+
+    char struct_name[MM_MAX_STRUCT_NAME_SIZE];
+    snprintf(struct_name, sizeof(struct_name), "mm_size_class_%u", class_size);
+    if (_mm_add_struct_record(struct_name, class_size, 0, &record) != 0)
+    {
+        record = _mm_lookup_struct_record_by_name(struct_name);
+        if (record == NULL || record->size != class_size || MM_RECORD_USES_SIDE_TABLE(record))
+        {
+            return NULL;
+        }
+    }
+    MM_REL_PTR_SET(heap->size_class_records[index], record);
+
+    return record;
+}
+
+/**
+ * @brief Registers a struct record in the memory management system.
+ *
+ * This function registers a struct record in the memory management system. The struct record
+ * represents a struct with the given name and size. The function checks if the size exceeds
+ * the system page size and returns -1 if it does. If the struct name already exists in the
+ * record list, it returns -2. Otherwise, it inserts the struct record into the VM page at the
+ * head of the record list, creating a new VM page for it if that one is full.
+ *
+ * @param struct_name The name of the struct to register.
+ * @param size The size of the struct.
+ * @return 0 if the struct record is registered successfully, -1 if the size exceeds the system page size,
+ *         -2 if the struct name already exists in the record list, -3 if no VM page could be obtained.
+ */
+int8_t mm_register_struct_record(const char *struct_name, size_t size)
+{
+    return mm_register_struct_record_with_flags(struct_name, size, 0);
+}
+
+/**
+ * @brief Registers a struct record with MM_RECORD_* flags in the memory management system.
+ *
+ * This function registers a struct record like `mm_register_struct_record` and selects how the data VM pages of the
+ * record are laid out. With MM_RECORD_OUT_OF_BAND_META the objects are stored in fixed size slots and their metadata
+ * is kept in side table VM pages of the record, so that allocating and freeing never write to the data VM pages of
+ * other objects. This keeps the number of pages copied on write small when the process forks.
+ *
+ * @param struct_name The name of the struct to register.
+ * @param size The size of the struct.
+ * @param flags MM_RECORD_* flags of the struct.
+ * @return 0 if the struct record is registered successfully, -1 if the size exceeds the system page size,
+ *         -2 if the struct name already exists in the record list, -3 if no VM page could be obtained.
+ */
+int8_t mm_register_struct_record_with_flags(const char *struct_name, size_t size, uint32_t flags)
+{
+    /* we cannot accomodate a struct whose size is greater than the page size */
+    if (size > SYSTEM_PAGE_SIZE)
+    {
+        return -1;
+    }
+
+    _mm_lock();
+    struct_record_t *record = NULL;
+    int8_t rc = _mm_add_struct_record(struct_name, size, flags & ~MM_RECORD_STRUCT_OF_ARRAYS, &record);
+    _mm_unlock();
+
+    return rc;
+}
+
+/**
+ * @brief Lays out the columns of a data VM page of a struct-of-arrays record.
+ *
+ * The columns follow the column table in the order of the fields, each one starting on a cache line. The slot count
+ * is the largest one whose columns fit in the page.
+ *
+ * @param columns Pointer to the column table to fill.
+ * @param fields Array of field descriptors.
+ * @param field_count Number of field descriptors.
+ * @return 0 if the columns are laid out, -1 if not even one slot fits in a data VM page.
+ */
+static int8_t _mm_init_soa_columns(mm_soa_columns_t *columns, const mm_field_t *fields, uint32_t field_count)
+{
+    size_t first_column = (MM_OOB_SLOT_AREA_OFFSET + sizeof(mm_soa_columns_t) + MM_SOA_COLUMN_ALIGN - 1) &
+                          ~((size_t)MM_SOA_COLUMN_ALIGN - 1);
+    size_t slot_bytes = 0;
+    for (uint32_t i = 0; i < field_count; i++)
+    {
+        slot_bytes += fields[i].size;
+    }
+
+    if (first_column >= SYSTEM_PAGE_SIZE)
+    {
+        return -1;
+    }
+
+    /* start from the slot count ignoring column padding and shrink it until the padded columns fit */
+    size_t slot_count = (SYSTEM_PAGE_SIZE - first_column) / slot_bytes;
+    if (slot_count > MM_OOB_MAX_SLOTS_PER_VM_PAGE)
+    {
+        slot_count = MM_OOB_MAX_SLOTS_PER_VM_PAGE;
+    }
+
+    for (; slot_count > 0; slot_count--)
+    {
+        size_t column = first_column;
+        for (uint32_t i = 0; i < field_count; i++)
+        {
+            columns->column_offset[i] = (uint32_t)(column - MM_OOB_SLOT_AREA_OFFSET);
+            column += (slot_count * fields[i].size + MM_SOA_COLUMN_ALIGN - 1) & ~((size_t)MM_SOA_COLUMN_ALIGN - 1);
+        }
+        if (column <= SYSTEM_PAGE_SIZE)
+        {
+            break;
+        }
+    }
+
+    if (slot_count == 0)
+    {
+        return -1;
+    }
+
+    columns->slot_count = (uint32_t)slot_count;
+    columns->field_count = field_count;
+    memcpy(columns->fields, fields, field_count * sizeof(mm_field_t));
+
+    return 0;
+}
+
+/**
+ * @brief Registers a struct record whose objects are stored as a struct of arrays.
+ *
+ * Every data VM page of the record holds one column per field, so that a loop touching only some fields of many
+ * objects reads only the cache lines of those fields. Objects are allocated with `mm_soa_alloc` and referenced by
+ * their page and slot; slot state is kept in side table entries as for MM_RECORD_OUT_OF_BAND_META. One VM page
+ * holds the column table of the record, which is copied into each new data VM page.
+ *
+ * @param struct_name The name of the struct to register.
+ * @param size The size of the struct.
+ * @param fields Array of field descriptors, see MM_SOA_FIELD_DESC.
+ * @param field_count Number of field descriptors, at most MM_SOA_MAX_FIELDS.
+ * @return 0 if the struct record is registered successfully, -1 if the size or the fields are invalid or do not fit
+ *         in a data VM page, -2 if the struct name already exists in the record list, -3 if no VM page could be
+ *         obtained.
+ */
+int8_t mm_register_soa_struct_record(const char *struct_name, size_t size, const mm_field_t *fields,
+                                     uint32_t field_count)
+{
+    if (size > SYSTEM_PAGE_SIZE || field_count == 0 || field_count > MM_SOA_MAX_FIELDS)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < field_count; i++)
+    {
+        if (fields[i].size == 0 || (size_t)fields[i].offset + fields[i].size > size)
+        {
+            return -1;
+        }
+    }
+
+    mm_soa_columns_t columns;
+    if (_mm_init_soa_columns(&columns, fields, field_count) != 0)
+    {
+        return -1;
+    }
+
+    _mm_lock();
+
+    mm_soa_columns_t *layout = (mm_soa_columns_t *)_mm_request_vm_page(1, MM_NUMA_NODE_ANY);
+    if (layout == NULL)
+    {
+        _mm_unlock();
+        return -3;
+    }
+    memcpy(layout, &columns, sizeof(columns));
+
+    struct_record_t *record = NULL;
+    int8_t rc = _mm_add_struct_record(struct_name, size, MM_RECORD_STRUCT_OF_ARRAYS, &record);
+    if (rc != 0)
+    {
+        _mm_release_vm_page(layout, 1);
+    }
+    else
+    {
+        MM_REL_PTR_SET(record->soa_layout, layout);
+    }
+
+    _mm_unlock();
+
+    return rc;
+}
+
+/**
+ * @brief Prints the registered struct records in the memory management system.
+ *
+ * This function prints the registered struct records in the memory management system.
+ * It iterates through the linked list of vm_page_for_struct_records_t objects and the
+ * struct_record_list within each object, printing the struct name and size of each record.
+ */
+void mm_print_registered_struct_records(void)
+{
+    _mm_lock();
+    vm_page_for_struct_records_t *vm_page_record = NULL;
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_BEGIN(heap, vm_page_record)
+    {
+        struct_record_t *record = NULL;
+        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
+        {
+            printf("%s: %ld\n", record->struct_name, record->size);
+        }
+        MM_ITERATE_STRUCT_RECORDS_END;
+    }
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_END;
+    _mm_unlock();
+}
+
+/**
+ * @brief Prints the data VM pages and blocks of a single structure record.
+ *
+ * For every data VM page it prints detailed information about each block, including its address, status, size,
+ * offset, previous block, and next block. Data VM pages with out-of-band metadata have no meta blocks, so for
+ * those the slot usage kept in their side table entry is printed instead.
+ *
+ * @param record Pointer to the struct_record_t object.
+ */
+static void _mm_print_record_mem_usage(struct_record_t *record)
+{
+    printf("%s: %ld\n", record->struct_name, record->size);
+    uint32_t page_num = 0;
+
+    if (MM_RECORD_USES_SIDE_TABLE(record))
+    {
+        side_table_entry_t *entry = NULL;
+        MM_ITERATE_SIDE_TABLE_ENTRIES_BEGIN(record, entry)
+        {
+            printf("\tPage Number: %d\n", page_num++);
+            printf("\t\t\t%14p\tSlot Size: %5d\tSlots: %5d\tUsed: %5d\n",
+                   (void *)MM_REL_PTR_GET(vm_page_for_data_t, entry->data_page), entry->slot_size, entry->slot_count,
+                   entry->used_slot_count);
+        }
+        MM_ITERATE_SIDE_TABLE_ENTRIES_END;
+        return;
+    }
+
+    vm_page_for_data_t *data_vm_page_ptr = NULL;
+    MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page_ptr)
+    {
+        meta_block_t *meta_block_ptr = NULL;
+        uint32_t block_count = 0;
+        printf("\tPage Number: %d\n", page_num++);
+        MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(data_vm_page_ptr, meta_block_ptr)
+        {
+            printf("\t\t\t%14p\tBlock: %5d\tStatus: %s\tBlock Size: %5d\tOffset: %5d\tPrev: %14p\tNext: %14p\n", (void *)meta_block_ptr, block_count, meta_block_ptr->is_free == MM_CACHED ? "CACHED   " : meta_block_ptr->is_free == MM_PADDING ? "PADDING  " : meta_block_ptr->is_free ? "ALLOCATED" : "F R E E D", meta_block_ptr->data_block_size, meta_block_ptr->offset, (void *)MM_PREV_META_BLOCK(meta_block_ptr), (void *)MM_NEXT_META_BLOCK(meta_block_ptr));
+            block_count++;
+        }MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END;
+    }
+    MM_ITERATE_DATA_VM_PAGES_END;
+}
+
+/**
+ * @brief Prints memory usage statistics for registered structure records.
+ *
+ * This function prints memory usage statistics for registered structure records. It first prints the page size.
+ * Then, it iterates through the VM pages and structure records. If a specific struct name is provided, it prints
+ * the statistics for that struct only. Otherwise, it prints the statistics for all registered structs.
+ *
+ * @param struct_name Optional. The name of the struct to print statistics for. If NULL, print stats for all registered structs.
+ */
+void mm_print_mem_usage(const char *struct_name)
+{
+    printf("\nPage Size = %zd\n\n", SYSTEM_PAGE_SIZE);
+
+    _mm_lock();
+    vm_page_for_struct_records_t *vm_page_record = NULL;
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_BEGIN(heap, vm_page_record)
+    {
+        struct_record_t *record = NULL;
+        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
+        {
+            if(struct_name != NULL) /* print stats of specified struct */
+            {
+                if(strncmp(record->struct_name, struct_name, MM_MAX_STRUCT_NAME_SIZE) == 0)
+                {
+                    _mm_print_record_mem_usage(record);
+
+                    _mm_unlock();
+                    return;
+                }
+            }
+            else /* print stats of all registered structs */
+            {
+                _mm_print_record_mem_usage(record);
+            }
+        }
+        MM_ITERATE_STRUCT_RECORDS_END;
+    }
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_END;
+    _mm_unlock();
+}
+
+/**
+ * @brief Prints the block usage statistics for all registered structure records.
+ *
+ * This function prints the block usage statistics for all registered structure records. It iterates through
+ * the VM pages and structure records, and for each record, it iterates through the data VM pages and meta blocks
+ * to calculate the number of allocated blocks and free blocks. It also calculates the application memory usage
+ * by multiplying the number of allocated blocks with the size of each block. For a record with out-of-band
+ * metadata, allocations and free slots are counted from the side table instead. The statistics are then printed
+ * for each structure record.
+ */
+void mm_print_block_usage(void)
+{
+    printf("\n");
+    _mm_lock();
+    vm_page_for_struct_records_t *vm_page_record = NULL;
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_BEGIN(heap, vm_page_record)
+    {
+        struct_record_t *record = NULL;
+        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
+        {
+            printf("%-20s\t", record->struct_name);
+            uint32_t allocated_block_count = 0;
+            uint32_t free_block_count = 0;
+            size_t app_mem_usage = 0;
+            if (MM_RECORD_USES_SIDE_TABLE(record))
+            {
+                side_table_entry_t *entry = NULL;
+                MM_ITERATE_SIDE_TABLE_ENTRIES_BEGIN(record, entry)
+                {
+                    for (uint32_t word = 0; word * 64 < entry->slot_count; word++)
+                    {
+                        allocated_block_count += (uint32_t)__builtin_popcountll(entry->head_bitmap[word]);
+                    }
+                    free_block_count += entry->slot_count - entry->used_slot_count;
+                    app_mem_usage += (size_t)entry->used_slot_count * entry->slot_size;
+                }
+                MM_ITERATE_SIDE_TABLE_ENTRIES_END;
+            }
+            else
+            {
+                vm_page_for_data_t *data_vm_page_ptr = NULL;
+                MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page_ptr)
+                {
+                    meta_block_t *meta_block_ptr = NULL;
+                    MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(data_vm_page_ptr, meta_block_ptr)
+                    {
+                        if(meta_block_ptr->is_free == MM_ALLOCATED)
+                        {
+                            allocated_block_count++;
+                        }
+                        else if(meta_block_ptr->is_free != MM_PADDING)
+                        {
+                            free_block_count++;
+                        }
+                    }
+                    MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END;
+                }
+                MM_ITERATE_DATA_VM_PAGES_END;
+                app_mem_usage = allocated_block_count * (sizeof(meta_block_t) + record->size);
+            }
+            printf("TBC: %5d\tFBC: %5d\tABC: %5d\tAppMemUsage: %10ld\n", allocated_block_count + free_block_count, free_block_count, allocated_block_count, app_mem_usage);
+        }
+        MM_ITERATE_STRUCT_RECORDS_END;
+    }
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_END;
+    if (mm_rt_pool.base != NULL)
+    {
+        pthread_mutex_lock(&mm_rt_pool.lock);
+        printf("%-20s\tUsed: %10zu\tSize: %10zu\n", "real-time pool", mm_rt_pool.used_bytes, mm_rt_pool.size);
+        pthread_mutex_unlock(&mm_rt_pool.lock);
+    }
+    _mm_unlock();
+}
+
+/**
+ * @brief Places the data VM pages of a record on a NUMA node.
+ *
+ * Pages the record gets from then on, including its side table and handle table pages and its buddy runs, are placed
+ * on the node; pages it already has stay where they are. The node is preferred rather than bound to, so allocations
+ * still succeed when the node runs out of memory. Records of a shared or persistent heap keep the placement of the
+ * heap mapping.
+ *
+ * @param struct_name The name of the struct.
+ * @param node The node, or MM_NUMA_NODE_ANY to place the pages like those of records without a node.
+ * @return 0 on success, -1 if the struct has not been registered or the process cannot use the node.
+ */
+int8_t mm_set_numa_node(const char *struct_name, int32_t node)
+{
+    if (node != MM_NUMA_NODE_ANY && (node < 0 || (uint32_t)node >= mm_numa_node_count))
+    {
+        return -1;
+    }
+
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL)
+    {
+        _mm_unlock();
+        return -1;
+    }
+
+    record->numa_node = node;
+    _mm_unlock();
+
+    return 0;
+}
+
+/**
+ * @brief Places the data VM pages the calling thread gets for records without a node of their own on a NUMA node.
+ *
+ * Worker threads pinned to the CPUs of one node call it once so that the pages of the objects they allocate are local
+ * to them even when the pages come from the page cache or a span mapped by another thread. Only the pages of the
+ * allocator are placed; the memory policy of the thread is left alone.
+ *
+ * @param node The node, or MM_NUMA_NODE_ANY to place the pages on the node of the CPU that touches them first.
+ * @return 0 on success, -1 if the process cannot use the node.
+ */
+int8_t mm_thread_set_numa_node(int32_t node)
+{
+    if (node != MM_NUMA_NODE_ANY && (node < 0 || (uint32_t)node >= mm_numa_node_count))
+    {
+        return -1;
+    }
+
+    mm_thread_numa_node = node;
+
+    return 0;
+}
+
+/**
+ * @brief Counts the NUMA nodes a batch of VM pages is placed on.
+ *
+ * On a single node machine every page is counted on node 0 without asking the kernel.
+ *
+ * @param pages Array of pointers to the VM pages.
+ * @param count Number of pages in the array, at most MM_NUMA_QUERY_BATCH.
+ * @param pages_per_node Array of mm_numa_node_count counters, one per node.
+ * @param unknown_pages Counter of pages whose node could not be found.
+ */
+static void _mm_numa_count_pages(void **pages, uint32_t count, uint32_t *pages_per_node, uint32_t *unknown_pages)
+{
+    if (mm_numa_node_count == 1)
+    {
+        pages_per_node[0] += count;
+        return;
+    }
+
+    int status[MM_NUMA_QUERY_BATCH];
+    if (syscall(SYS_move_pages, 0, (unsigned long)count, pages, NULL, status, 0) != 0)
+    {
+        *unknown_pages += count;
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (status[i] >= 0 && (uint32_t)status[i] < mm_numa_node_count)
+        {
+            pages_per_node[status[i]]++;
+        }
+        else
+        {
+            (*unknown_pages)++;
+        }
+    }
+}
+
+/**
+ * @brief Prints one line of the NUMA usage report.
+ *
+ * @param name Name printed at the start of the line.
+ * @param pages_per_node Array of mm_numa_node_count counters, one per node.
+ * @param unknown_pages Number of pages whose node could not be found.
+ */
+static void _mm_print_numa_line(const char *name, const uint32_t *pages_per_node, uint32_t unknown_pages)
+{
+    printf("%-20s\t", name);
+    for (uint32_t node = 0; node < mm_numa_node_count; node++)
+    {
+        printf("N%u: %6u\t", node, pages_per_node[node]);
+    }
+    printf("Unknown: %6u\n", unknown_pages);
+}
+
+/**
+ * @brief Prints how the data VM pages of every record and the empty page caches are spread across the NUMA nodes.
+ *
+ * The node of each page is asked from the kernel with move_pages(), which does not move anything when given no
+ * target nodes. Pages the kernel cannot place, e.g. pages swapped out or pages of a buddy run never written to, are
+ * counted as unknown. Every page of the buddy runs of a record is listed with the record.
+ */
+void mm_print_numa_usage(void)
+{
+    uint32_t pages_per_node[MM_NUMA_MAX_NODES];
+    uint32_t unknown_pages = 0;
+    void *pages[MM_NUMA_QUERY_BATCH];
+    uint32_t count = 0;
+
+    printf("\nNUMA nodes: %u\n", mm_numa_node_count);
+    _mm_lock();
+    vm_page_for_struct_records_t *vm_page_record = NULL;
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_BEGIN(heap, vm_page_record)
+    {
+        struct_record_t *record = NULL;
+        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
+        {
+            memset(pages_per_node, 0, sizeof(pages_per_node));
+            unknown_pages = 0;
+            count = 0;
+            if (MM_RECORD_USES_SIDE_TABLE(record))
+            {
+                side_table_entry_t *entry = NULL;
+                MM_ITERATE_SIDE_TABLE_ENTRIES_BEGIN(record, entry)
+                {
+                    pages[count++] = MM_REL_PTR_GET(vm_page_for_data_t, entry->data_page);
+                    if (count == MM_NUMA_QUERY_BATCH)
+                    {
+                        _mm_numa_count_pages(pages, count, pages_per_node, &unknown_pages);
+                        count = 0;
+                    }
+                }
+                MM_ITERATE_SIDE_TABLE_ENTRIES_END;
+            }
+            else
+            {
+                vm_page_for_data_t *data_vm_page = NULL;
+                MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page)
+                {
+                    pages[count++] = data_vm_page;
+                    if (count == MM_NUMA_QUERY_BATCH)
+                    {
+                        _mm_numa_count_pages(pages, count, pages_per_node, &unknown_pages);
+                        count = 0;
+                    }
+                }
+                MM_ITERATE_DATA_VM_PAGES_END;
+            }
+            for (vm_page_for_data_t *run = MM_REL_PTR_GET(vm_page_for_data_t, record->buddy_runs); run != NULL;
+                 run = MM_NEXT_DATA_VM_PAGE(run))
+            {
+                uint32_t order = (uint32_t)MM_BUDDY_CHUNK_OF(run)->run_order[MM_BUDDY_PAGE_INDEX(run)] - 1;
+                for (uint32_t page = 0; page < 1U << order; page++)
+                {
+                    pages[count++] = (char *)run + (size_t)page * SYSTEM_PAGE_SIZE;
+                    if (count == MM_NUMA_QUERY_BATCH)
+                    {
+                        _mm_numa_count_pages(pages, count, pages_per_node, &unknown_pages);
+                        count = 0;
+                    }
+                }
+            }
+            _mm_numa_count_pages(pages, count, pages_per_node, &unknown_pages);
+            _mm_print_numa_line(record->struct_name, pages_per_node, unknown_pages);
+        }
+        MM_ITERATE_STRUCT_RECORDS_END;
+    }
+    MM_ITERATE_STRUCT_RECORDS_VM_PAGES_END;
+
+    if (heap->region_size == 0)
+    {
+        /* the page caches are kept per node, so their pages are counted without asking the kernel */
+        for (uint32_t node = 0; node < mm_numa_node_count; node++)
+        {
+            pages_per_node[node] = mm_page_cache_count[node];
+        }
+        _mm_print_numa_line("page cache", pages_per_node, 0);
+    }
+    _mm_unlock();
+}
+
+/**
+ * @brief Caps the memory a record holds.
+ *
+ * The record is charged for the data VM pages and buddy runs it takes, or for its blocks of the real-time pool, and
+ * not for the objects in them, so the check costs nothing while objects fit in memory the record already holds. An
+ * allocation that needs more memory than the cap leaves fails right away and returns NULL, without a system call.
+ * Once the record holds more than its cap less an eighth, the callback is called once, by the thread whose allocation
+ * crossed the mark and after the heap lock has been released, so that it can free objects of the record, e.g. evict
+ * cache entries; it fires again after the record has dropped below the mark. A record already past the mark gets the
+ * call before this function returns, and a cap below what it holds only stops it from growing. Records registered with
+ * MM_RECORD_REALTIME take a cap but no callback: their allocations never run application code.
+ *
+ * @param struct_name The name of the struct.
+ * @param limit The cap in bytes, or in VM pages with MM_BUDGET_PAGES; 0 removes the cap.
+ * @param flags 0 or MM_BUDGET_PAGES.
+ * @param callback Function called when the record comes near its cap, or NULL; only called in this process.
+ * @param arg Argument passed to the callback.
+ * @return 0 on success, -1 if the struct has not been registered, the flags or limit are invalid or a callback is
+ *         given for a real-time record.
+ */
+int8_t mm_set_budget(const char *struct_name, size_t limit, uint32_t flags, mm_budget_cb_t callback, void *arg)
+{
+    if ((flags & ~(uint32_t)MM_BUDGET_PAGES) != 0 ||
+        ((flags & MM_BUDGET_PAGES) && limit > SIZE_MAX / SYSTEM_PAGE_SIZE))
+    {
+        return -1;
+    }
+
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL || (callback != NULL && (record->flags & MM_RECORD_REALTIME)))
+    {
+        _mm_unlock();
+        return -1;
+    }
+
+    /* real-time records are charged under the pool lock only */
+    pthread_mutex_lock(&mm_rt_pool.lock);
+    record->budget_limit = (flags & MM_BUDGET_PAGES ? limit * SYSTEM_PAGE_SIZE : limit);
+    record->budget_callback = callback;
+    record->budget_arg = arg;
+    record->budget_owner = mm_pid;
+    record->budget_pressure = 0;
+    _mm_budget_update_pressure(record);
+    pthread_mutex_unlock(&mm_rt_pool.lock);
+    _mm_unlock();
+
+    return 0;
+}
+
+/**
+ * @brief Returns the memory a record is charged for against its budget.
+ *
+ * @param struct_name The name of the struct.
+ * @return Bytes of data VM pages, buddy runs and real-time pool blocks the record holds, 0 if the struct has not been
+ *         registered.
+ */
+size_t mm_budget_usage(const char *struct_name)
+{
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    pthread_mutex_lock(&mm_rt_pool.lock);
+    size_t used = (record != NULL ? record->budget_used : 0);
+    pthread_mutex_unlock(&mm_rt_pool.lock);
+    _mm_unlock();
+
+    return used;
+}
+
+/**
+ * @brief Allocates and initializes memory for a structure array.
+ *
+ * This function allocates and initializes memory for a structure array of the specified size.
+ * It performs checks to ensure that the structure has been registered and that the requested
+ * memory size is within the available memory in a completely free VM data page. It then finds
+ * a suitable data block to satisfy the memory request and initializes it with zeros. Finally,
+ * it returns a pointer to the allocated and initialized memory.
+ *
+ * @param struct_name The name of the structure to allocate memory for.
+ * @param units The number of structure units to allocate.
+ * @return A pointer to the allocated and initialized memory, or NULL if allocation failed or
+ *         the structure is not registered.
+ */
+void *xcalloc(const char *struct_name, uint32_t units)
+{
+    _mm_lock();
+
+    /* we cannot allocate memory for a struct that has not been registered */
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL)
+    {
+        _mm_unlock();
+        return NULL;
+    }
+
+    /* find a data block that can satisfy the memory request from the application */
+    void *app_data = _mm_allocate_units(record, units);
+
+    _mm_unlock();
+
+    if (app_data)
+    {
+        memset(app_data, 0, (size_t)units * _mm_object_stride(record));
+    }
+
+    return app_data;
+}
+
+/**
+ * @brief Allocates and initializes memory for a structure array next to an object it will be visited with.
+ *
+ * Nodes of a tree or a list allocated next to their parent or predecessor share its data VM page, or sit in a page
+ * mapped right next to it, so walking the structure touches fewer cache lines and TLB entries.
+ *
+ * @param struct_name The name of the structure to allocate memory for.
+ * @param units The number of structure units to allocate.
+ * @param hint Pointer to an object of the same structure, or NULL to allocate like `xcalloc`; an object of another
+ *             structure is ignored.
+ * @return A pointer to the allocated and initialized memory, or NULL if allocation failed or the structure is not
+ *         registered.
+ */
+void *xcalloc_near(const char *struct_name, uint32_t units, const void *hint)
+{
+    _mm_lock();
+
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL)
+    {
+        _mm_unlock();
+        return NULL;
+    }
+
+    void *app_data = _mm_allocate_units_near(record, units, hint);
+
+    _mm_unlock();
+
+    if (app_data)
+    {
+        memset(app_data, 0, (size_t)units * _mm_object_stride(record));
+    }
+
+    return app_data;
+}
+
+/**
+ * @brief Frees a dynamically allocated memory block.
+ *
+ * The `xfree` function frees the memory block pointed to by `app_data`. It calculates the pointer to the meta block
+ * corresponding to the data block by subtracting the size of the meta block from the `app_data` pointer. The function
+ * asserts that the meta block's `is_free` field is already set to `MM_FREE` to ensure that the block is not already freed.
+ *
+ * After the assertion, the function calls `_mm_free_data_block` to perform the actual freeing of the data block,
+ * including block merging and memory management operations. Blocks of data VM pages with out-of-band metadata are
+ * freed in their side table instead.
+ *
+ * @param app_data Pointer to the dynamically allocated memory block to be freed.
+ */
+void xfree(void *app_data)
+{
+    if (_mm_rt_pool_owns(app_data))
+    {
+        _mm_rt_free(app_data);
+        return;
+    }
+
+    _mm_lock();
+    _mm_free_units(app_data);
+    _mm_unlock();
+}
+
+/**
+ * @brief Looks up a registered struct record.
+ *
+ * Callers allocating the same struct over and over look the record up once and allocate with `mm_record_alloc`,
+ * which skips the lookup by name done by `xcalloc`.
+ *
+ * @param struct_name The name of the struct.
+ * @return Pointer to the record, or NULL if the struct has not been registered.
+ */
+mm_record_t *mm_get_struct_record(const char *struct_name)
+{
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    _mm_unlock();
+
+    return (mm_record_t *)record;
+}
+
+/**
+ * @brief Allocates memory for a structure array of a record without initializing it.
+ *
+ * @param record Pointer to the record, as returned by `mm_get_struct_record`.
+ * @param units The number of structure units to allocate.
+ * @return A pointer to the allocated memory, to be freed with `xfree`, or NULL if allocation failed.
+ */
+void *mm_record_alloc(mm_record_t *record, uint32_t units)
+{
+    if (((struct_record_t *)record)->flags & MM_RECORD_REALTIME)
+    {
+        return _mm_rt_allocate((struct_record_t *)record, units);
+    }
+
+    _mm_lock();
+    void *app_data = _mm_allocate_units((struct_record_t *)record, units);
+    _mm_unlock();
+
+    return app_data;
+}
+
+/**
+ * @brief Allocates memory for a structure array of a record next to another object of the record, without
+ *        initializing it.
+ *
+ * @param record Pointer to the record, as returned by `mm_get_struct_record`.
+ * @param units The number of structure units to allocate.
+ * @param hint Pointer to an object of the record, or NULL to allocate like `mm_record_alloc`.
+ * @return A pointer to the allocated memory, to be freed with `xfree`, or NULL if allocation failed.
+ */
+void *mm_record_alloc_near(mm_record_t *record, uint32_t units, const void *hint)
+{
+    _mm_lock();
+    void *app_data = _mm_allocate_units_near((struct_record_t *)record, units, hint);
+    _mm_unlock();
+
+    return app_data;
+}
+
+/**
+ * @brief Calculates the largest number of units of a record that a single allocation can hold.
+ *
+ * @param record Pointer to the record, as returned by `mm_get_struct_record`.
+ * @return The number of units fitting in a completely free data VM page, or in the largest buddy run for an in-band
+ *         record of the private heap, 0 for a struct-of-arrays record.
+ */
+uint32_t mm_record_max_units(mm_record_t *record)
+{
+    struct_record_t *struct_record = (struct_record_t *)record;
+
+    if (struct_record->flags & MM_RECORD_STRUCT_OF_ARRAYS)
+    {
+        return 0;
+    }
+    if (struct_record->flags & MM_RECORD_OUT_OF_BAND_META)
+    {
+        return _mm_oob_slots_per_vm_page(struct_record);
+    }
+    if (struct_record->flags & MM_RECORD_REALTIME)
+    {
+        size_t max_units = (struct_record->size != 0 ? _mm_rt_max_request_size() / struct_record->size : 0);
+        return (uint32_t)(max_units < UINT32_MAX ? max_units : UINT32_MAX);
+    }
+
+    size_t max_bytes =
+        (heap->region_size == 0 ? _mm_buddy_max_run_memory_available() : _mm_max_vm_page_memory_available(1));
+
+    return (struct_record->size != 0 ? (uint32_t)(max_bytes / struct_record->size) : 0);
+}
+
+/**
+ * @brief Calculates how many bytes an object can use.
+ *
+ * This is the size of its block or slot run, which is at least the size it was allocated with and includes any
+ * rounding the allocator did.
+ *
+ * @param app_data Pointer to an object of a record with in-band metadata, out-of-band slots or of a real-time record.
+ * @return Number of usable bytes.
+ */
+size_t mm_usable_size(const void *app_data)
+{
+    vm_page_for_data_t *data_vm_page = MM_GET_PAGE_FROM_APP_DATA(app_data);
+    size_t usable_size = 0;
+
+    _mm_lock();
+    if (_mm_rt_pool_owns(app_data))
+    {
+        usable_size = (size_t)MM_RT_BLOCK_FROM_APP_DATA(app_data)->size;
+    }
+    else if (data_vm_page->layout == MM_PAGE_LAYOUT_OUT_OF_BAND)
+    {
+        side_table_entry_t *entry = MM_REL_PTR_GET(side_table_entry_t, data_vm_page->side_table_entry);
+        size_t slot_offset = (size_t)((const uint8_t *)app_data - MM_OOB_SLOT_AREA(data_vm_page));
+        uint32_t slot = (uint32_t)(slot_offset / entry->slot_size);
+        uint32_t units = 0;
+        do
+        {
+            units++;
+            slot++;
+        } while (slot < entry->slot_count && MM_OOB_SLOT_BIT_IS_SET(entry->used_bitmap, slot) &&
+                 !MM_OOB_SLOT_BIT_IS_SET(entry->head_bitmap, slot));
+        usable_size = (size_t)units * entry->slot_size;
+    }
+    else
+    {
+        usable_size = ((const meta_block_t *)((const uint8_t *)app_data - sizeof(meta_block_t)))->data_block_size;
+    }
+    _mm_unlock();
+
+    return usable_size;
+}
+
+/**
+ * @brief Takes the heap lock and the lock of the real-time pool before the process forks.
+ *
+ * A child only has the thread that called fork(), so a lock held by another thread at that moment would never be
+ * released in the child. Registered with pthread_atfork() together with `mm_postfork`.
+ */
+void mm_prefork(void)
+{
+    _mm_lock();
+    pthread_mutex_lock(&mm_rt_pool.lock);
+}
+
+/**
+ * @brief Releases the locks taken by `mm_prefork` in both the parent and the child, and caches the id of the child.
+ */
+void mm_postfork(void)
+{
+    _mm_refresh_pid();
+    pthread_mutex_unlock(&mm_rt_pool.lock);
+    _mm_unlock();
+}
+
+/**
+ * @brief Returns the record of a struct defined with MM_DEFINE_STRUCT_RECORD, creating it in the heap on first use.
+ *
+ * Nothing is registered before main(): a defined record costs nothing until it is used, and is then created without
+ * looking its name up in the private heap.
+ *
+ * @param static_record Pointer to the record definition, as returned by MM_STATIC_RECORD.
+ * @return Pointer to the record, or NULL if the struct does not fit in a VM page or no VM page could be obtained.
+ */
+mm_record_t *mm_static_record(mm_static_record_t *static_record)
+{
+    _mm_lock();
+    struct_record_t *record = _mm_materialize_static_record(static_record);
+    _mm_unlock();
+
+    return (mm_record_t *)record;
+}
+
+/**
+ * @brief Allocates memory for a structure array of a struct defined at compile time without initializing it.
+ *
+ * Behaves like `mm_record_alloc`, with the record created in, or found again in, whichever heap is attached.
+ *
+ * @param static_record Pointer to the record definition, as returned by MM_STATIC_RECORD.
+ * @param units The number of structure units to allocate.
+ * @return A pointer to the allocated memory, to be freed with `xfree`, or NULL if allocation failed.
+ */
+void *mm_static_alloc(mm_static_record_t *static_record, uint32_t units)
+{
+    _mm_lock();
+    void *app_data = NULL;
+    struct_record_t *record = _mm_materialize_static_record(static_record);
+    if (record != NULL)
+    {
+        app_data = _mm_allocate_units(record, units);
+    }
+    _mm_unlock();
+
+    return app_data;
+}
+
+/**
+ * @brief Allocates and zeroes memory for a structure array of a struct defined with MM_DEFINE_STRUCT_RECORD.
+ *
+ * Behaves like `xcalloc` without the lookup by name.
+ *
+ * @param static_record Pointer to the record definition, as returned by MM_STATIC_RECORD.
+ * @param units The number of structure units to allocate.
+ * @return A pointer to the allocated and zeroed memory, to be freed with `xfree`, or NULL if allocation failed.
+ */
+void *mm_static_xcalloc(mm_static_record_t *static_record, uint32_t units)
+{
+    _mm_lock();
+    void *app_data = NULL;
+    struct_record_t *record = _mm_materialize_static_record(static_record);
+    if (record != NULL)
+    {
+        app_data = _mm_allocate_units(record, units);
+    }
+    _mm_unlock();
+
+    if (app_data)
+    {
+        memset(app_data, 0, (size_t)units * _mm_object_stride(record));
+    }
+
+    return app_data;
+}
+
+/**
+ * @brief Allocates memory from the size class record fitting a request.
+ *
+ * Requests are rounded up to the next size class and served by a record of that size, so untyped memory can come
+ * from the allocator without registering a struct for every size. The records are named "mm_size_class_<size>" and
+ * registered on first use.
+ *
+ * @param bytes Size of the request, at most MM_SIZE_CLASS_MAX_BYTES.
+ * @param alignment Required alignment, a power of two of at most MM_SIZE_CLASS_ALIGNMENT.
+ * @return A pointer to uninitialized memory, to be freed with `xfree`, or NULL if the request is too large or too
+ *         strictly aligned or allocation failed.
+ */
+void *mm_size_class_alloc(size_t bytes, size_t alignment)
+{
+    if (bytes > MM_SIZE_CLASS_MAX_BYTES || alignment > MM_SIZE_CLASS_ALIGNMENT)
+    {
+        return NULL;
+    }
+
+    uint32_t class_size = 0;
+    uint32_t index = _mm_size_class_index(bytes, &class_size);
+
+    _mm_lock();
+    void *app_data = NULL;
+    struct_record_t *record = _mm_size_class_record(index, class_size);
+    if (record != NULL)
+    {
+        app_data = _mm_allocate_units(record, 1);
+    }
+    _mm_unlock();
+
+    return app_data;
+}
+
+/**
+ * @brief Takes a reference to an object.
+ *
+ * Every object of a record with in-band metadata starts with one reference when it is allocated. The count lives in
+ * the meta block of the object and is updated atomically without taking the allocator lock, so the caller must
+ * already hold a reference: retaining an object whose count has dropped to 0 is undefined, as the object may have
+ * been freed and reused, and is caught by an assertion when the count is still 0.
+ *
+ * @param app_data Pointer to the object, holding at least one reference.
+ * @return `app_data`, or NULL if the object has no reference count because its record keeps its metadata out of band
+ *         or is a real-time record.
+ */
+void *mm_retain(void *app_data)
+{
+    vm_page_for_data_t *data_vm_page = MM_GET_PAGE_FROM_APP_DATA(app_data);
+    if (_mm_rt_pool_owns(app_data) ||
+        (data_vm_page->layout != MM_PAGE_LAYOUT_IN_BAND && data_vm_page->layout != MM_PAGE_LAYOUT_BUDDY))
+    {
+        return NULL;
+    }
+
+    meta_block_t *meta_block_ptr = (meta_block_t *)app_data - 1;
+    uint32_t references = __atomic_fetch_add(&meta_block_ptr->refcount, 1, __ATOMIC_RELAXED);
+    assert(references != 0);
+    (void)references;
+
+    return app_data;
+}
+
+/**
+ * @brief Drops a reference to an object and frees the object with its last reference.
+ *
+ * `xfree` frees an object whatever its reference count is, so an object shared through `mm_retain` is only freed
+ * with `mm_release`. An object without a reference count is freed right away.
+ *
+ * @param app_data Pointer to the object.
+ * @return Number of references left, 0 if the object has been freed.
+ */
+uint32_t mm_release(void *app_data)
+{
+    vm_page_for_data_t *data_vm_page = MM_GET_PAGE_FROM_APP_DATA(app_data);
+    if (_mm_rt_pool_owns(app_data) ||
+        (data_vm_page->layout != MM_PAGE_LAYOUT_IN_BAND && data_vm_page->layout != MM_PAGE_LAYOUT_BUDDY))
+    {
+        xfree(app_data);
+        return 0;
+    }
+
+    meta_block_t *meta_block_ptr = (meta_block_t *)app_data - 1;
+    /* release orders this thread's writes to the object before the free, acquire orders the free after all others */
+    uint32_t references = __atomic_sub_fetch(&meta_block_ptr->refcount, 1, __ATOMIC_ACQ_REL);
+    if (references == 0)
+    {
+        _mm_lock();
+        _mm_free_units(app_data);
+        _mm_unlock();
+    }
+
+    return references;
+}
+
+/**
+ * @brief Initializes a cursor over all live objects of a record.
+ *
+ * The cursor walks the data VM pages of the record without holding the allocator lock.
+ *
+ * @param cursor Pointer to the cursor to initialize.
+ * @param struct_name The name of the struct whose objects are walked.
+ * @return 0 if the cursor is initialized, -1 if the struct has not been registered.
+ */
+int8_t mm_object_cursor_init(mm_object_cursor_t *cursor, const char *struct_name)
+{
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL)
+    {
+        _mm_unlock();
+        return -1;
+    }
+
+    _mm_object_cursor_set_range(cursor, record, _mm_object_walk_first_page(record), NULL);
+    _mm_unlock();
+
+    return 0;
+}
+
+/**
+ * @brief Splits the data VM pages of a record into ranges for walking its live objects in parallel.
+ *
+ * The pages of the record are split into up to `count` consecutive ranges holding about the same number of pages,
+ * and one cursor is initialized per range. Cursors beyond the number of ranges are initialized empty, so every
+ * cursor can be handed to a worker thread.
+ *
+ * @param struct_name The name of the struct whose objects are walked.
+ * @param cursors Array of `count` cursors to initialize.
+ * @param count Number of cursors.
+ * @return Number of non-empty ranges, 0 if the struct has not been registered or has no data VM page.
+ */
+uint32_t mm_object_cursor_partition(const char *struct_name, mm_object_cursor_t *cursors, uint32_t count)
+{
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL || count == 0)
+    {
+        _mm_unlock();
+        return 0;
+    }
+
+    uint32_t page_count = 0;
+    for (void *page = _mm_object_walk_first_page(record); page != NULL; page = _mm_object_walk_next_page(record, page))
+    {
+        page_count++;
+    }
+
+    uint32_t range_count = (page_count < count ? page_count : count);
+    void *page = _mm_object_walk_first_page(record);
+    for (uint32_t range = 0; range < count; range++)
+    {
+        if (range >= range_count)
+        {
+            _mm_object_cursor_set_range(&cursors[range], record, NULL, NULL);
+            continue;
+        }
+
+        /* spread the remainder over the first ranges */
+        uint32_t pages_in_range = page_count / range_count + (range < page_count % range_count ? 1 : 0);
+        void *end_page = page;
+        for (uint32_t i = 0; i < pages_in_range; i++)
+        {
+            end_page = _mm_object_walk_next_page(record, end_page);
+        }
+        _mm_object_cursor_set_range(&cursors[range], record, page, end_page);
+        page = end_page;
+    }
+    _mm_unlock();
+
+    return range_count;
+}
+
+/**
+ * @brief Returns the next live object of a cursor.
+ *
+ * In-band blocks are followed through the meta block chain of each data VM page, and the block after the returned
+ * one is prefetched. Slots of a record with out-of-band metadata are found in the side table bitmaps, and the slot
+ * MM_OBJECT_WALK_PREFETCH_DISTANCE slots ahead is prefetched.
+ *
+ * @param cursor Pointer to the cursor.
+ * @param size Optional. Filled with the size of the object in bytes.
+ * @return Pointer to the object, or NULL when the cursor has no more objects.
+ */
+void *mm_object_cursor_next(mm_object_cursor_t *cursor, uint32_t *size)
+{
+    struct_record_t *record = (struct_record_t *)cursor->record;
+
+    /* the fields of a struct-of-arrays object are not contiguous, its pages are walked with mm_soa_cursor_next_page */
+    if (record->flags & MM_RECORD_STRUCT_OF_ARRAYS)
+    {
+        return NULL;
+    }
+
+    while (cursor->page != NULL)
+    {
+        if (record->flags & MM_RECORD_OUT_OF_BAND_META)
+        {
+            side_table_entry_t *entry = (side_table_entry_t *)cursor->page;
+            while (cursor->slot < entry->slot_count)
+            {
+                uint32_t slot = cursor->slot++;
+                if (!MM_OOB_SLOT_BIT_IS_SET(entry->head_bitmap, slot))
+                {
+                    continue;
+                }
+
+                if (slot + MM_OBJECT_WALK_PREFETCH_DISTANCE < entry->slot_count)
+                {
+                    __builtin_prefetch(MM_OOB_SLOT_ADDRESS(entry, slot + MM_OBJECT_WALK_PREFETCH_DISTANCE));
+                }
+
+                if (size != NULL)
+                {
+                    uint32_t units = 1;
+                    while (slot + units < entry->slot_count &&
+                           MM_OOB_SLOT_BIT_IS_SET(entry->used_bitmap, slot + units) &&
+                           !MM_OOB_SLOT_BIT_IS_SET(entry->head_bitmap, slot + units))
+                    {
+                        units++;
+                    }
+                    *size = units * entry->slot_size;
+                }
+                return MM_OOB_SLOT_ADDRESS(entry, slot);
+            }
+        }
+        else
+        {
+            while (cursor->block != NULL)
+            {
+                meta_block_t *meta_block_ptr = (meta_block_t *)cursor->block;
+                cursor->block = MM_NEXT_META_BLOCK(meta_block_ptr);
+                if (cursor->block != NULL)
+                {
+                    __builtin_prefetch(cursor->block);
+                }
+
+                if (meta_block_ptr->is_free == MM_ALLOCATED)
+                {
+                    if (size != NULL)
+                    {
+                        *size = meta_block_ptr->data_block_size;
+                    }
+                    return (void *)(meta_block_ptr + 1);
+                }
+            }
+        }
+
+        _mm_object_cursor_advance_page(cursor);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Calls a visitor for every remaining live object of a cursor.
+ *
+ * @param cursor Pointer to the cursor.
+ * @param visitor Function called with each object, its size and `arg`; a non-zero return value stops the walk.
+ * @param arg Argument passed to the visitor.
+ * @return Number of objects visited.
+ */
+int32_t mm_object_cursor_for_each(mm_object_cursor_t *cursor, mm_object_visitor_t visitor, void *arg)
+{
+    int32_t visited = 0;
+    uint32_t size = 0;
+    void *app_data = NULL;
+
+    while ((app_data = mm_object_cursor_next(cursor, &size)) != NULL)
+    {
+        visited++;
+        if (visitor(app_data, size, arg) != 0)
+        {
+            break;
+        }
+    }
+
+    return visited;
+}
+
+/**
+ * @brief Calls a visitor for every live object of a record.
+ *
+ * @param struct_name The name of the struct whose objects are walked.
+ * @param visitor Function called with each object, its size and `arg`; a non-zero return value stops the walk.
+ * @param arg Argument passed to the visitor.
+ * @return Number of objects visited, or -1 if the struct has not been registered.
+ */
+int32_t mm_for_each_object(const char *struct_name, mm_object_visitor_t visitor, void *arg)
+{
+    mm_object_cursor_t cursor;
+
+    if (mm_object_cursor_init(&cursor, struct_name) != 0)
+    {
+        return -1;
+    }
+
+    return mm_object_cursor_for_each(&cursor, visitor, arg);
+}
+
+/**
+ * @brief Exports the live objects of a record to a file descriptor.
+ *
+ * The objects are written with `writev` straight from the data VM pages, without copying them into an intermediate
+ * buffer. By default every live object is written together with its unit count. With MM_EXPORT_PAGES whole data VM
+ * pages are written instead, which is cheaper for densely used pages and lets `mm_import_objects` recreate the pages
+ * as they were; struct-of-arrays records can only be exported this way, and records holding arrays in buddy runs
+ * cannot.
+ *
+ * @param struct_name The name of the struct whose objects are exported.
+ * @param fd File descriptor to write the stream to.
+ * @param flags MM_EXPORT_* flags.
+ * @return Number of objects exported, or -1 if the struct has not been registered, cannot be exported with these
+ *         flags or writing failed.
+ */
+int64_t mm_export_objects(const char *struct_name, int fd, uint32_t flags)
+{
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    _mm_unlock();
+    if (record == NULL)
+    {
+        return -1;
+    }
+
+    /* objects of a struct-of-arrays record are spread over columns and only exported as whole pages */
+    if ((record->flags & MM_RECORD_STRUCT_OF_ARRAYS) && !(flags & MM_EXPORT_PAGES))
+    {
+        return -1;
+    }
+
+    /* a buddy run spans several pages, its array is only exported as an object */
+    if ((flags & MM_EXPORT_PAGES) && record->buddy_runs != 0)
+    {
+        return -1;
+    }
+
+    mm_export_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MM_EXPORT_MAGIC;
+    strncpy(header.struct_name, record->struct_name, MM_MAX_STRUCT_NAME_SIZE);
+    header.struct_size = (uint32_t)record->size;
+    header.object_stride = _mm_object_stride(record);
+    header.page_size = (uint32_t)SYSTEM_PAGE_SIZE;
+    header.export_flags = flags;
+    header.record_flags = record->flags;
+    header.metadata_version = MM_METADATA_VERSION;
+
+    struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+    if (_mm_writev_all(fd, &iov, 1) != 0)
+    {
+        return -1;
+    }
+
+    return (flags & MM_EXPORT_PAGES ? _mm_export_page_stream(record, fd) : _mm_export_object_stream(record, fd));
+}
+
+/**
+ * @brief Imports a stream written by `mm_export_objects` into a record.
+ *
+ * An object stream is read batch by batch straight into newly allocated objects. A page stream is read straight into
+ * freshly obtained data VM pages that are then linked into the record. The record must have the struct size (and,
+ * for a page stream, the layout) of the exported record.
+ *
+ * @param struct_name The name of the struct to import the objects into.
+ * @param fd File descriptor to read the stream from.
+ * @return Number of objects imported, or -1 if the struct has not been registered, the stream does not match it or
+ *         reading or allocating failed.
+ */
+int64_t mm_import_objects(const char *struct_name, int fd)
+{
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    _mm_unlock();
+    if (record == NULL)
+    {
+        return -1;
+    }
+
+    mm_export_header_t header;
+    if (_mm_read_item(fd, &header, sizeof(header)) != 0 || header.magic != MM_EXPORT_MAGIC ||
+        header.struct_size != record->size || header.object_stride != _mm_object_stride(record))
+    {
+        return -1;
+    }
+
+    if (header.export_flags & MM_EXPORT_PAGES)
+    {
+        if (header.page_size != SYSTEM_PAGE_SIZE || header.metadata_version != MM_METADATA_VERSION ||
+            (header.record_flags & MM_RECORD_LAYOUT_FLAGS) != (record->flags & MM_RECORD_LAYOUT_FLAGS))
+        {
+            return -1;
+        }
+        return _mm_import_page_stream(record, fd);
+    }
+
+    return _mm_import_object_stream(record, fd);
+}
+
+/**
+ * @brief Allocates an object of a struct-of-arrays record.
+ *
+ * The object takes one slot of a data VM page of the record and all of its fields are zeroed.
+ *
+ * @param struct_name The name of the struct to allocate.
+ * @param ref Filled with the reference to the new object.
+ * @return 0 if the object is allocated, -1 if the struct has not been registered as a struct of arrays or allocation
+ *         failed.
+ */
+int8_t mm_soa_alloc(const char *struct_name, mm_soa_ref_t *ref)
+{
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL || !(record->flags & MM_RECORD_STRUCT_OF_ARRAYS))
+    {
+        _mm_unlock();
+        return -1;
+    }
+
+    uint32_t slot = 0;
+    side_table_entry_t *entry = _mm_allocate_side_table_slots(record, 1, &slot);
+    if (entry == NULL)
+    {
+        _mm_unlock();
+        return -1;
+    }
+    ref->columns = MM_SOA_COLUMNS_OF_PAGE(MM_REL_PTR_GET(vm_page_for_data_t, entry->data_page));
+    ref->slot = slot;
+    _mm_unlock();
+
+    for (uint32_t i = 0; i < ref->columns->field_count; i++)
+    {
+        uint32_t field_size = ref->columns->fields[i].size;
+        memset(MM_SOA_COLUMN(ref->columns, i, uint8_t) + (size_t)slot * field_size, 0, field_size);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Frees an object of a struct-of-arrays record.
+ *
+ * @param ref Reference to the object, as filled by `mm_soa_alloc`.
+ */
+void mm_soa_free(mm_soa_ref_t ref)
+{
+    _mm_lock();
+    _mm_free_side_table_slots(MM_GET_PAGE_FROM_SOA_COLUMNS(ref.columns), ref.slot);
+    _mm_unlock();
+}
+
+/**
+ * @brief Scatters a struct into the columns of a struct-of-arrays object.
+ *
+ * Only the fields registered for the record are copied; padding and unregistered members of the struct are ignored.
+ *
+ * @param ref Reference to the object.
+ * @param object Pointer to the struct to copy from.
+ */
+void mm_soa_store(mm_soa_ref_t ref, const void *object)
+{
+    for (uint32_t i = 0; i < ref.columns->field_count; i++)
+    {
+        mm_field_t field = ref.columns->fields[i];
+        memcpy(MM_SOA_COLUMN(ref.columns, i, uint8_t) + (size_t)ref.slot * field.size,
+               (const uint8_t *)object + field.offset, field.size);
+    }
+}
+
+/**
+ * @brief Gathers the columns of a struct-of-arrays object into a struct.
+ *
+ * @param ref Reference to the object.
+ * @param object Pointer to the struct to copy to. Members that are not registered fields are left untouched.
+ */
+void mm_soa_load(mm_soa_ref_t ref, void *object)
+{
+    for (uint32_t i = 0; i < ref.columns->field_count; i++)
+    {
+        mm_field_t field = ref.columns->fields[i];
+        memcpy((uint8_t *)object + field.offset,
+               MM_SOA_COLUMN(ref.columns, i, uint8_t) + (size_t)ref.slot * field.size, field.size);
+    }
+}
+
+/**
+ * @brief Returns the next data VM page of a cursor over a struct-of-arrays record.
+ *
+ * The cursor is initialized with `mm_object_cursor_init` or `mm_object_cursor_partition`. Each call hands out the
+ * column table of one page together with the bitmap of its used slots, so that a loop can run over whole columns
+ * with MM_SOA_COLUMN and skip free slots by the bitmap.
+ *
+ * @param cursor Pointer to the cursor.
+ * @param used_bitmap Filled with the bitmap of the used slots of the page, bit `slot % 64` of word `slot / 64`.
+ * @return Pointer to the column table of the page, or NULL when the cursor has no more pages or the record is not a
+ *         struct-of-arrays record.
+ */
+mm_soa_columns_t *mm_soa_cursor_next_page(mm_object_cursor_t *cursor, const uint64_t **used_bitmap)
+{
+    struct_record_t *record = (struct_record_t *)cursor->record;
+    if (cursor->page == NULL || !(record->flags & MM_RECORD_STRUCT_OF_ARRAYS))
+    {
+        return NULL;
+    }
+
+    side_table_entry_t *entry = (side_table_entry_t *)cursor->page;
+    _mm_object_cursor_advance_page(cursor);
+
+    *used_bitmap = entry->used_bitmap;
+
+    return MM_SOA_COLUMNS_OF_PAGE(MM_REL_PTR_GET(vm_page_for_data_t, entry->data_page));
+}
+
+/**
+ * @brief Returns the handle table of a record.
+ *
+ * The table is looked up once and then passed to the other handle functions, which resolve handles without looking
+ * up the record by name.
+ *
+ * @param struct_name The name of the struct.
+ * @return Pointer to the handle table, or NULL if the struct has not been registered.
+ */
+mm_handle_table_t *mm_handle_table(const char *struct_name)
+{
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    _mm_unlock();
+
+    return (mm_handle_table_t *)record;
+}
+
+/**
+ * @brief Allocates zeroed units of a record and returns a handle to them.
  *
- * @param app_data_meta_block Pointer to the meta block of the data block to be freed.
+ * The handle stays valid until the object is freed, wherever the allocator moves the object in the meantime. Objects
+ * allocated by handle are freed with `mm_handle_free`; an in-band object freed with `xfree` also invalidates its
+ * handle.
+ *
+ * @param table Pointer to the handle table of the record.
+ * @param units The number of structure units to allocate.
+ * @return Handle to the object, or MM_HANDLE_NULL if allocation failed or the handle table is full.
  */
-static void _mm_free_data_block(meta_block_t *app_data_meta_block)
+mm_handle_t mm_handle_alloc(mm_handle_table_t *table, uint32_t units)
 {
-    vm_page_for_data_t *hosting_data_vm_page = (vm_page_for_data_t *)MM_GET_PAGE_FROM_META_BLOCK(app_data_meta_block);
+    struct_record_t *record = (struct_record_t *)table;
 
-    app_data_meta_block->is_free = MM_FREE;
+    _mm_lock();
 
-    meta_block_t *next_meta_block = MM_NEXT_META_BLOCK(app_data_meta_block);
-    if(next_meta_block != NULL)     /* case 1: if the meta block is not the last block in the VM page, also handling hard IF memory if present */
+    uint32_t index = 0;
+    mm_handle_entry_t *entry = _mm_take_handle_entry(record, &index);
+    if (entry == NULL)
     {
-        app_data_meta_block->data_block_size += _mm_get_hard_internal_frag_size(app_data_meta_block, next_meta_block);
+        _mm_unlock();
+        return MM_HANDLE_NULL;
     }
-    else    /* case 2: if the meta block is the last block in the VM page, also handling hard IF memory if present */
+
+    void *app_data = _mm_allocate_units(record, units);
+    if (app_data == NULL)
     {
-        uint8_t *data_vm_page_end = (uint8_t *)((uint8_t *)hosting_data_vm_page + SYSTEM_PAGE_SIZE);
-        uint8_t *app_data_block_end = (uint8_t *)app_data_meta_block + sizeof(meta_block_t) + app_data_meta_block->data_block_size;
-        app_data_meta_block->data_block_size += (uint32_t)((uintptr_t)((void *)data_vm_page_end) - (uintptr_t)((void *)app_data_block_end));
+        _mm_release_handle_entry(record, index);
+        _mm_unlock();
+        return MM_HANDLE_NULL;
     }
 
-    meta_block_t *final_merged_meta_block = app_data_meta_block;
-
-    /* perform block merging */
-    if(next_meta_block != NULL && next_meta_block->is_free == MM_FREE)
+    MM_REL_PTR_SET(entry->object, app_data);
+    entry->units = units;
+    if (!MM_RECORD_USES_SIDE_TABLE(record))
     {
-        _mm_merge_free_blocks(app_data_meta_block, next_meta_block);
+        ((meta_block_t *)app_data - 1)->handle = index + 1;
     }
+    mm_handle_t handle = MM_MAKE_HANDLE(index, entry->generation);
 
-    meta_block_t *prev_meta_block = MM_PREV_META_BLOCK(app_data_meta_block);
-    if(prev_meta_block != NULL && prev_meta_block->is_free == MM_FREE)
+    _mm_unlock();
+
+    memset(app_data, 0, (size_t)units * _mm_object_stride(record));
+
+    return handle;
+}
+
+/**
+ * @brief Resolves a handle to the current address of its object.
+ *
+ * The lookup takes no lock: it reads the entry of the handle and compares its generation with the one in the handle,
+ * so a handle whose object has been freed is detected in constant time. The address must not be used across a call
+ * that may free or move the object.
+ *
+ * @param table Pointer to the handle table of the record.
+ * @param handle The handle.
+ * @return Pointer to the object, or NULL if the handle is stale or invalid.
+ */
+void *mm_handle_get(mm_handle_table_t *table, mm_handle_t handle)
+{
+    struct_record_t *record = (struct_record_t *)table;
+    uint32_t index = MM_HANDLE_INDEX(handle);
+
+    if (handle == MM_HANDLE_NULL || index >= record->handle_count)
     {
-        _mm_merge_free_blocks(prev_meta_block, app_data_meta_block);
-        final_merged_meta_block = prev_meta_block;
+        return NULL;
     }
 
-    /* check if the data VM page empty */
-    if(_mm_is_data_vm_page_empty(hosting_data_vm_page) == MM_FREE)
+    mm_handle_entry_t *entry = _mm_handle_entry(record, index);
+    if (entry->generation != MM_HANDLE_GENERATION(handle))
     {
-        _mm_delete_and_free_data_vm_page(hosting_data_vm_page);
-        return;
+        return NULL;
     }
 
-    /* add the final meta block to the free meta block PQ */
-    _mm_add_free_data_block_meta_info(hosting_data_vm_page->record, final_merged_meta_block);
+    return MM_REL_PTR_GET(void, entry->object);
 }
 
 /**
- * @brief Initializes the memory management system.
+ * @brief Frees the object behind a handle.
  *
- * This function initializes the memory management system by retrieving the system page size
- * using the `sysconf` function and storing it in the `SYSTEM_PAGE_SIZE` global variable.
- * It is typically called at the start of the program to set up the memory management system.
+ * @param table Pointer to the handle table of the record.
+ * @param handle The handle.
+ * @return 0 if the object is freed, -1 if the handle is stale or invalid.
  */
-void mm_init(void)
+int8_t mm_handle_free(mm_handle_table_t *table, mm_handle_t handle)
 {
-    SYSTEM_PAGE_SIZE = sysconf(_SC_PAGESIZE);
+    struct_record_t *record = (struct_record_t *)table;
+    uint32_t index = MM_HANDLE_INDEX(handle);
+
+    _mm_lock();
+
+    if (handle == MM_HANDLE_NULL || index >= record->handle_count)
+    {
+        _mm_unlock();
+        return -1;
+    }
+
+    mm_handle_entry_t *entry = _mm_handle_entry(record, index);
+    void *app_data = MM_REL_PTR_GET(void, entry->object);
+    if (entry->generation != MM_HANDLE_GENERATION(handle) || app_data == NULL)
+    {
+        _mm_unlock();
+        return -1;
+    }
+
+    _mm_release_handle_entry(record, index);
+    if (!MM_RECORD_USES_SIDE_TABLE(record))
+    {
+        ((meta_block_t *)app_data - 1)->handle = 0;
+    }
+    _mm_free_units(app_data);
+
+    _mm_unlock();
+
+    return 0;
 }
 
 /**
- * @brief Registers a struct record in the memory management system.
+ * @brief Calls a visitor for each live handle of a record.
  *
- * This function registers a struct record in the memory management system. The struct record
- * represents a struct with the given name and size. The function checks if the size exceeds
- * the system page size and returns -1 if it does. If the struct name already exists in the
- * record list, it returns -2. Otherwise, it creates a new virtual memory page if needed and
- * inserts the struct record into the appropriate VM page or creates a new VM page for it.
+ * The entries are visited in index order, which is a dense walk over a few VM pages.
  *
- * @param struct_name The name of the struct to register.
- * @param size The size of the struct.
- * @return 0 if the struct record is registered successfully, -1 if the size exceeds the system page size,
- *         -2 if the struct name already exists in the record list.
+ * @param table Pointer to the handle table of the record.
+ * @param visitor Function called with each live handle and the current address of its object.
+ * @param arg Argument passed through to the visitor.
+ * @return Number of handles visited.
  */
-int8_t mm_register_struct_record(const char *struct_name, size_t size)
+int32_t mm_handle_for_each(mm_handle_table_t *table, mm_handle_visitor_t visitor, void *arg)
 {
-    /* we cannot accomodate a struct whose size is greater than the page size */
-    if (size > SYSTEM_PAGE_SIZE)
-    {
-        return -1;
-    }
-    else
+    struct_record_t *record = (struct_record_t *)table;
+    int32_t visited = 0;
+
+    for (uint32_t index = 0; index < record->handle_count; index++)
     {
-        /* allocating a VM page for the first time */
-        if (!vm_page_record_head)
+        mm_handle_entry_t *entry = _mm_handle_entry(record, index);
+        if (entry->object == 0)
         {
-            vm_page_record_head = (vm_page_for_struct_records_t *)_mm_request_vm_page(1);
-            vm_page_record_head->next = NULL;
-            strncpy(vm_page_record_head->struct_record_list[0].struct_name, struct_name, MM_MAX_STRUCT_NAME_SIZE);
-            vm_page_record_head->struct_record_list[0].size = size;
-            vm_page_record_head->struct_record_list[0].first_page = NULL;
-            glthread_init(&vm_page_record_head->struct_record_list[0].free_block_priority_list);
+            continue;
         }
-        else
-        {
-            uint32_t count = 0;
-            struct_record_t *record = NULL;
-            /* iterating through records in all existing VM pages to insert a record
-             * at the end */
-            for (vm_page_for_struct_records_t *vm_page_record = vm_page_record_head; vm_page_record != NULL;
-                 vm_page_record = vm_page_record->next)
-            {
-                count = 0;
-                record = NULL;
-                MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
-                {
-                    if (strncmp(record->struct_name, struct_name, MM_MAX_STRUCT_NAME_SIZE) == 0)
-                    {
-                        /* struct name already exists in the record list */
-                        return -2;
-                    }
-                    else
-                    {
-                        count++;
-                    }
-                }
-                MM_ITERATE_STRUCT_RECORDS_END;
-            }
-
-            if (count == MM_MAX_RECORDS_PER_VM_PAGE)
-            {
-                /* the previous VM page is full, create a new VM page to add this record
-                 */
-                vm_page_for_struct_records_t *new_vm_page_record =
-                    (vm_page_for_struct_records_t *)_mm_request_vm_page(1);
-                new_vm_page_record->next = vm_page_record_head;
-                /* the record to be added will be the first record in the new VM page*/
-                record = new_vm_page_record->struct_record_list;
-                vm_page_record_head = new_vm_page_record;
-            }
 
-            strncpy(record->struct_name, struct_name, MM_MAX_STRUCT_NAME_SIZE);
-            record->size = size;
-            record->first_page = NULL;
-            glthread_init(&record->free_block_priority_list);
+        visited++;
+        if (visitor(MM_MAKE_HANDLE(index, entry->generation), MM_REL_PTR_GET(void, entry->object), arg) != 0)
+        {
+            break;
         }
-        return 0;
     }
+
+    return visited;
 }
 
 /**
- * @brief Prints the registered struct records in the memory management system.
+ * @brief Sets the relocation callback of a record.
  *
- * This function prints the registered struct records in the memory management system.
- * It iterates through the linked list of vm_page_for_struct_records_t objects and the
- * struct_record_list within each object, printing the struct name and size of each record.
+ * Compaction moves an object only if it can tell the application about it: objects allocated by handle are always
+ * movable, other objects only once the record has a relocation callback, see mm_relocation_cb_t. It is a function of
+ * the calling process, so in a shared or persistent heap it is ignored by other processes.
+ *
+ * @param struct_name The name of the struct.
+ * @param callback Function called for every moved object, or NULL to remove the callback.
+ * @param arg Argument passed through to the callback.
+ * @return 0 if the callback is set, -1 if the struct has not been registered.
  */
-void mm_print_registered_struct_records(void)
+int8_t mm_set_relocation_callback(const char *struct_name, mm_relocation_cb_t callback, void *arg)
 {
-    for (vm_page_for_struct_records_t *vm_page_record = vm_page_record_head; vm_page_record != NULL;
-         vm_page_record = vm_page_record->next)
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL)
     {
-        struct_record_t *record = NULL;
-        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
-        {
-            printf("%s: %ld\n", record->struct_name, record->size);
-        }
-        MM_ITERATE_STRUCT_RECORDS_END;
+        _mm_unlock();
+        return -1;
     }
+
+    record->relocation_callback = callback;
+    record->relocation_arg = arg;
+    record->relocation_owner = mm_pid;
+    _mm_unlock();
+
+    return 0;
 }
 
 /**
- * @brief Prints memory usage statistics for registered structure records.
+ * @brief Compacts the data VM pages of a record.
  *
- * This function prints memory usage statistics for registered structure records. It first prints the page size.
- * Then, it iterates through the VM pages and structure records. If a specific struct name is provided, it prints
- * the statistics for that struct only. Otherwise, it prints the statistics for all registered structs. For each
- * struct, it iterates through the data VM pages and meta blocks to print detailed information about each block,
- * including its address, status, size, offset, previous block, and next block.
+ * Live objects are moved out of the sparsest data VM pages into free blocks of denser pages, one page at a time, as
+ * long as the denser pages have room for them. Each emptied page is released. Pages holding an object that cannot be
+ * moved are left alone. With a non-zero budget the compaction stops once the budget is used up, so that it can be
+ * run in small increments; every call starts from the pages as they are then.
  *
- * @param struct_name Optional. The name of the struct to print statistics for. If NULL, print stats for all registered structs.
+ * Records with out-of-band metadata or a struct-of-arrays layout are not compacted. Arrays held in buddy runs fill
+ * their runs and stay where they are.
+ *
+ * @param struct_name The name of the struct whose pages are compacted.
+ * @param budget_ns Time budget in nanoseconds, 0 for no limit.
+ * @return Number of data VM pages released, or -1 if the struct has not been registered or cannot be compacted.
  */
-void mm_print_mem_usage(const char *struct_name)
+int32_t mm_compact(const char *struct_name, uint64_t budget_ns)
 {
-    printf("\nPage Size = %zd\n\n", SYSTEM_PAGE_SIZE);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    for (vm_page_for_struct_records_t *vm_page_record = vm_page_record_head; vm_page_record != NULL;
-         vm_page_record = vm_page_record->next)
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL || MM_RECORD_USES_SIDE_TABLE(record))
     {
-        struct_record_t *record = NULL;
-        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
+        _mm_unlock();
+        return -1;
+    }
+
+    bool has_callback = (record->relocation_callback != NULL && record->relocation_owner == mm_pid);
+    _mm_compaction_scan_pages(record, has_callback);
+
+    int32_t released_pages = 0;
+    bool stop = false;
+    vm_page_for_data_t *source_page = NULL;
+    while (!stop && (source_page = _mm_compaction_pick_source_page(record)) != NULL)
+    {
+        source_page->compaction_draining = 1;
+
+        /* allocated blocks are not touched by the merging of the freed ones, so the next one stays valid */
+        meta_block_t *meta_block_ptr = &source_page->meta_block_info;
+        while (meta_block_ptr != NULL &&
+               (meta_block_ptr->is_free == MM_FREE || meta_block_ptr->is_free == MM_PADDING))
         {
-            vm_page_for_data_t *data_vm_page_ptr = NULL;
-            if(struct_name != NULL) /* print stats of specified struct */
+            meta_block_ptr = MM_NEXT_META_BLOCK(meta_block_ptr);
+        }
+
+        while (meta_block_ptr != NULL)
+        {
+            meta_block_t *next_meta_block = MM_NEXT_META_BLOCK(meta_block_ptr);
+            while (next_meta_block != NULL && next_meta_block->is_free == MM_FREE)
             {
-                if(strncmp(record->struct_name, struct_name, MM_MAX_STRUCT_NAME_SIZE) == 0)
-                {
-                    printf("%s: %ld\n", record->struct_name, record->size);
-                    uint32_t page_num = 0;
-                    MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page_ptr)
-                    {
-                        meta_block_t *meta_block_ptr = NULL;
-                        uint32_t block_count = 0;
-                        printf("\tPage Number: %d\n", page_num++);
-                        MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(data_vm_page_ptr, meta_block_ptr)
-                        {
-                            printf("\t\t\t%14p\tBlock: %5d\tStatus: %s\tBlock Size: %5d\tOffset: %5d\tPrev: %14p\tNext: %14p\n", (void *)meta_block_ptr, block_count, meta_block_ptr->is_free ? "ALLOCATED" : "F R E E D", meta_block_ptr->data_block_size, meta_block_ptr->offset, (void *)meta_block_ptr->prev, (void *)meta_block_ptr->next);
-                            block_count++;
-                        }MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END;
-                    }
-                    MM_ITERATE_DATA_VM_PAGES_END;
-                    
-                    return;
-                }
+                next_meta_block = MM_NEXT_META_BLOCK(next_meta_block);
             }
-            else /* print stats of all registered structs */
+
+            meta_block_t *destination =
+                _mm_compaction_find_destination(record, source_page, meta_block_ptr->data_block_size);
+            if (destination == NULL)
             {
-                printf("%s: %ld\n", record->struct_name, record->size);
-                uint32_t page_num = 0;
-                MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page_ptr)
+                /* the free bytes of the denser pages are too fragmented, the page stays partly drained */
+                stop = true;
+                break;
+            }
+
+            source_page->compaction_live_bytes -= (uint32_t)sizeof(meta_block_t) + meta_block_ptr->data_block_size;
+            _mm_compaction_move_block(record, meta_block_ptr, destination, has_callback);
+            meta_block_ptr = next_meta_block;
+
+            if (meta_block_ptr == NULL)
+            {
+                /* the last block is gone and so is the page */
+                released_pages++;
+                break;
+            }
+
+            if (budget_ns != 0)
+            {
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                uint64_t elapsed_ns = (uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ULL + (uint64_t)now.tv_nsec -
+                                      (uint64_t)start.tv_nsec;
+                if (elapsed_ns >= budget_ns)
                 {
-                    meta_block_t *meta_block_ptr = NULL;
-                    uint32_t block_count = 0;
-                    printf("\tPage Number: %d\n", page_num++);
-                    MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(data_vm_page_ptr, meta_block_ptr)
-                    {
-                        printf("\t\t\t%14p\tBlock: %5d\tStatus: %s\tBlock Size: %5d\tOffset: %5d\tPrev: %14p\tNext: %14p\n", (void *)meta_block_ptr, block_count, meta_block_ptr->is_free ? "ALLOCATED" : "F R E E D", meta_block_ptr->data_block_size, meta_block_ptr->offset, (void *)meta_block_ptr->prev, (void *)meta_block_ptr->next);
-                        block_count++;
-                    }MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END;
+                    stop = true;
+                    break;
                 }
-                MM_ITERATE_DATA_VM_PAGES_END;
             }
         }
-        MM_ITERATE_STRUCT_RECORDS_END;
     }
+
+    /* pages left partly drained take allocations again */
+    vm_page_for_data_t *data_vm_page = NULL;
+    MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page)
+    {
+        data_vm_page->compaction_draining = 0;
+    }
+    MM_ITERATE_DATA_VM_PAGES_END;
+
+    _mm_unlock();
+
+    return released_pages;
 }
 
 /**
- * @brief Prints the block usage statistics for all registered structure records.
+ * @brief Sets the constructor and destructor of the object cache of a record.
  *
- * This function prints the block usage statistics for all registered structure records. It iterates through
- * the VM pages and structure records, and for each record, it iterates through the data VM pages and meta blocks
- * to calculate the number of allocated blocks and free blocks. It also calculates the application memory usage
- * by multiplying the number of allocated blocks with the size of each block. The statistics are then printed
- * for each structure record.
+ * Objects allocated with `mm_cache_alloc` are constructed once and stay constructed while they sit in the cache
+ * after `mm_cache_free`. The destructor runs only when `mm_cache_reap` releases a page of cached objects. The
+ * constructor runs without the allocator lock, the destructor with the lock held, so it must not call into the
+ * allocator. Both are functions of the calling process, so in a shared or persistent heap other processes cannot
+ * construct or reap objects of the record.
+ *
+ * Only records with in-band metadata have an object cache.
+ *
+ * @param struct_name The name of the struct.
+ * @param ctor Function constructing a zeroed object, or NULL.
+ * @param dtor Function destroying a constructed object, or NULL.
+ * @param arg Argument passed through to both functions.
+ * @return 0 if the functions are set, -1 if the struct has not been registered or has no object cache.
  */
-void mm_print_block_usage(void)
+int8_t mm_set_object_constructor(const char *struct_name, mm_object_ctor_t ctor, mm_object_dtor_t dtor, void *arg)
 {
-    printf("\n");
-    for (vm_page_for_struct_records_t *vm_page_record = vm_page_record_head; vm_page_record != NULL;
-         vm_page_record = vm_page_record->next)
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL || MM_RECORD_USES_SIDE_TABLE(record))
     {
-        struct_record_t *record = NULL;
-        MM_ITERATE_STRUCT_RECORDS_BEGIN(vm_page_record->struct_record_list, record)
-        {
-            printf("%-20s\t", record->struct_name);
-            vm_page_for_data_t *data_vm_page_ptr = NULL;
-            uint32_t allocated_block_count = 0;
-            uint32_t free_block_count = 0;
-            MM_ITERATE_DATA_VM_PAGES_BEGIN(record, data_vm_page_ptr)
-            {
-                meta_block_t *meta_block_ptr = NULL;
-                MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(data_vm_page_ptr, meta_block_ptr)
-                {
-                    if(meta_block_ptr->is_free == MM_ALLOCATED)
-                    {
-                        allocated_block_count++;
-                    }
-                    else
-                    {
-                        free_block_count++;
-                    }
-                }
-                MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END;
-            }
-            MM_ITERATE_DATA_VM_PAGES_END;
-            printf("TBC: %5d\tFBC: %5d\tABC: %5d\tAppMemUsage: %10ld\n", allocated_block_count + free_block_count, free_block_count, allocated_block_count, allocated_block_count * (sizeof(meta_block_t) + record->size));
-        }
-        MM_ITERATE_STRUCT_RECORDS_END;
+        _mm_unlock();
+        return -1;
     }
+
+    record->object_ctor = ctor;
+    record->object_dtor = dtor;
+    record->object_ctor_arg = arg;
+    record->object_ctor_owner = mm_pid;
+    _mm_unlock();
+
+    return 0;
 }
 
 /**
- * @brief Allocates and initializes memory for a structure array.
+ * @brief Allocates a constructed object from the object cache of a record.
  *
- * This function allocates and initializes memory for a structure array of the specified size.
- * It performs checks to ensure that the structure has been registered and that the requested
- * memory size is within the available memory in a completely free VM data page. It then finds
- * a suitable data block to satisfy the memory request and initializes it with zeros. Finally,
- * it returns a pointer to the allocated and initialized memory.
+ * The most recently cached object is reused as it is, without being zeroed or constructed again. If the cache is
+ * empty a new object is zeroed and constructed.
  *
- * @param struct_name The name of the structure to allocate memory for.
- * @param units The number of structure units to allocate.
- * @return A pointer to the allocated and initialized memory, or NULL if allocation failed or
- *         the structure is not registered.
+ * @param struct_name The name of the struct to allocate.
+ * @return Pointer to the constructed object, or NULL if the struct has not been registered, has no object cache,
+ *         its constructor was set by another process or allocation failed.
  */
-void *xcalloc(const char *struct_name, uint32_t units)
+void *mm_cache_alloc(const char *struct_name)
 {
-    /* we cannot allocate memory for a struct that has not been registered */
+    _mm_lock();
     struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
-    if (record == NULL)
+    if (record == NULL || MM_RECORD_USES_SIDE_TABLE(record))
     {
+        _mm_unlock();
         return NULL;
     }
 
-    /* we cannot allocate memory that is greater than the memory available in a completely free VM data page */
-    if (units * record->size > _mm_max_vm_page_memory_available(1))
+    glthread_node_t *cached_node = GLTHREAD_HEAD(&record->constructed_objects);
+    if (cached_node != NULL)
+    {
+        meta_block_t *meta_block_ptr =
+            (meta_block_t *)GLTHREAD_BASEOF(cached_node, MM_BLOCK_OFFSETOF(meta_block_t, glue_node));
+        glthread_remove_node(&record->constructed_objects, cached_node);
+        meta_block_ptr->is_free = MM_ALLOCATED;
+        meta_block_ptr->refcount = 1;
+        _mm_unlock();
+        return (void *)(meta_block_ptr + 1);
+    }
+
+    if (record->object_ctor != NULL && record->object_ctor_owner != mm_pid)
     {
+        _mm_unlock();
         return NULL;
     }
 
-    /* find a data block that can satisfy the memory request from the application */
-    meta_block_t *free_meta_block = _mm_allocate_free_data_block(record, record->size * units);
+    mm_object_ctor_t ctor = record->object_ctor;
+    void *ctor_arg = record->object_ctor_arg;
+    void *app_data = _mm_allocate_units(record, 1);
+    _mm_unlock();
 
-    if (free_meta_block)
+    if (app_data == NULL)
     {
-        memset((uint8_t *)(free_meta_block + 1), 0, free_meta_block->data_block_size);
-        return (void *)(free_meta_block + 1);
+        return NULL;
     }
-    else
+
+    memset(app_data, 0, record->size);
+    if (ctor != NULL)
     {
-        return NULL;
+        ctor(app_data, ctor_arg);
     }
+
+    return app_data;
 }
 
 /**
- * @brief Frees a dynamically allocated memory block.
+ * @brief Gives a constructed object back to the object cache of its record.
  *
- * The `xfree` function frees the memory block pointed to by `app_data`. It calculates the pointer to the meta block
- * corresponding to the data block by subtracting the size of the meta block from the `app_data` pointer. The function
- * asserts that the meta block's `is_free` field is already set to `MM_FREE` to ensure that the block is not already freed.
+ * The object keeps its memory and its constructed state until `mm_cache_reap` destroys it.
  *
- * After the assertion, the function calls `_mm_free_data_block` to perform the actual freeing of the data block,
- * including block merging and memory management operations.
+ * @param app_data Pointer to an object allocated with `mm_cache_alloc`.
+ */
+void mm_cache_free(void *app_data)
+{
+    meta_block_t *meta_block_ptr = (meta_block_t *)app_data - 1;
+    struct_record_t *record = MM_DATA_VM_PAGE_RECORD(MM_GET_PAGE_FROM_META_BLOCK(meta_block_ptr));
+
+    _mm_lock();
+
+    assert(meta_block_ptr->is_free == MM_ALLOCATED && meta_block_ptr->handle == 0);
+
+    meta_block_ptr->is_free = MM_CACHED;
+    glthread_init_node(&meta_block_ptr->glue_node);
+    glthread_add_node_at_head(&record->constructed_objects, &meta_block_ptr->glue_node);
+
+    _mm_unlock();
+}
+
+/**
+ * @brief Releases the data VM pages of a record that only hold cached objects.
  *
- * @param app_data Pointer to the dynamically allocated memory block to be freed.
+ * Every cached object of such a page is destroyed and freed, and the page is released once its last object is gone.
+ * Cached objects sharing a page with objects in use stay constructed in the cache.
+ *
+ * @param struct_name The name of the struct whose object cache is reaped.
+ * @return Number of data VM pages released, or -1 if the struct has not been registered, has no object cache or its
+ *         destructor was set by another process.
  */
-void xfree(void *app_data)
+int32_t mm_cache_reap(const char *struct_name)
 {
-    meta_block_t *app_data_meta_block = (meta_block_t *)((uint8_t *)app_data - sizeof(meta_block_t));
+    _mm_lock();
+    struct_record_t *record = _mm_lookup_struct_record_by_name(struct_name);
+    if (record == NULL || MM_RECORD_USES_SIDE_TABLE(record) ||
+        (record->object_dtor != NULL && record->object_ctor_owner != mm_pid))
+    {
+        _mm_unlock();
+        return -1;
+    }
 
-    assert(app_data_meta_block->is_free == MM_ALLOCATED);
+    int32_t released_pages = 0;
+    vm_page_for_data_t *data_vm_page = MM_FIRST_DATA_VM_PAGE(record);
+    while (data_vm_page != NULL)
+    {
+        /* the page may be released below */
+        vm_page_for_data_t *next_data_vm_page = MM_NEXT_DATA_VM_PAGE(data_vm_page);
 
-    _mm_free_data_block(app_data_meta_block);
+        bool only_cached = true;
+        meta_block_t *meta_block_ptr = NULL;
+        MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_BEGIN(data_vm_page, meta_block_ptr)
+        {
+            if (meta_block_ptr->is_free == MM_ALLOCATED)
+            {
+                only_cached = false;
+                break;
+            }
+        }
+        MM_ITERATE_ALL_BLOCKS_OF_SINGLE_DATA_VM_PAGE_END;
+
+        if (only_cached)
+        {
+            /* cached blocks are not merged with the freed ones, so the next one stays valid */
+            meta_block_ptr = &data_vm_page->meta_block_info;
+            while (meta_block_ptr != NULL)
+            {
+                meta_block_t *next_meta_block = MM_NEXT_META_BLOCK(meta_block_ptr);
+                while (next_meta_block != NULL && next_meta_block->is_free == MM_FREE)
+                {
+                    next_meta_block = MM_NEXT_META_BLOCK(next_meta_block);
+                }
+                if (meta_block_ptr->is_free == MM_CACHED)
+                {
+                    glthread_remove_node(&record->constructed_objects, &meta_block_ptr->glue_node);
+                    if (record->object_dtor != NULL)
+                    {
+                        mm_in_locked_callback = true;
+                        record->object_dtor((void *)(meta_block_ptr + 1), record->object_ctor_arg);
+                        mm_in_locked_callback = false;
+                    }
+                    meta_block_ptr->is_free = MM_ALLOCATED;
+                    _mm_free_data_block(meta_block_ptr);
+                }
+                meta_block_ptr = next_meta_block;
+            }
+            released_pages++;
+        }
+
+        data_vm_page = next_data_vm_page;
+    }
+
+    _mm_unlock();
+
+    return released_pages;
 }
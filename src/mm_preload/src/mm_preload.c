@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+
+#include "uapi_mm.h"
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Replaces the malloc family of the C library when loaded with LD_PRELOAD:
+ *
+ *     LD_PRELOAD=libs/libmm_preload.so ./program
+ *
+ * Requests of up to MM_SIZE_CLASS_MAX_BYTES bytes aligned to at most MM_SIZE_CLASS_ALIGNMENT come from the size class
+ * records. Everything else gets a mapping of its own, with a header in the 16 bytes in front of the returned pointer.
+ * Size class objects never start in the first 16 bytes of a VM page, and mapped ones always do, so free() tells them
+ * apart by the offset of the pointer in its page.
+ */
+
+/* the library is built with hidden visibility, so that only these functions are exported and the calls of the
+ * allocator to itself cannot be bound to functions of the same name in the program, e.g. the xfree() of bash */
+#define MM_PRELOAD_EXPORT __attribute__((visibility("default")))
+
+/* alignment malloc() guarantees */
+#define MM_PRELOAD_MIN_ALIGNMENT 16
+
+/* header in front of a mapped allocation */
+typedef struct mm_preload_mapping
+{
+    void *base;
+    size_t length;
+} mm_preload_mapping_t;
+
+/* size of a VM page, set by _mm_preload_init() */
+static size_t mm_preload_page_size = 0;
+
+/* set by the thread initializing the allocator */
+static int mm_preload_initializing = 0;
+
+/**
+ * @brief Sets up the allocator on the first request.
+ *
+ * The loader and the constructors of other libraries may allocate before any constructor of this library runs, so
+ * every entry point calls this first. The page size is published before the fork handlers are registered, since
+ * registering them may allocate; other threads wait for it.
+ */
+static void _mm_preload_init(void)
+{
+    if (__atomic_load_n(&mm_preload_page_size, __ATOMIC_ACQUIRE) != 0)
+    {
+        return;
+    }
+
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&mm_preload_initializing, &expected, 1, false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE))
+    {
+        while (__atomic_load_n(&mm_preload_page_size, __ATOMIC_ACQUIRE) == 0)
+        {
+            sched_yield();
+        }
+        return;
+    }
+
+    mm_init();
+    __atomic_store_n(&mm_preload_page_size, (size_t)sysconf(_SC_PAGESIZE), __ATOMIC_RELEASE);
+    pthread_atfork(mm_prefork, mm_postfork, mm_postfork);
+}
+
+/**
+ * @brief Checks whether a pointer was returned by `_mm_preload_map`.
+ *
+ * @param ptr Pointer returned by this library.
+ * @return true if the pointer starts a mapped allocation, false if it is a size class object.
+ */
+static bool _mm_preload_is_mapped(const void *ptr)
+{
+    return ((uintptr_t)ptr & (mm_preload_page_size - 1)) <= sizeof(mm_preload_mapping_t);
+}
+
+/**
+ * @brief Maps an allocation of its own.
+ *
+ * The returned pointer is `sizeof(mm_preload_mapping_t)` bytes into a page, or at the start of a page when the
+ * alignment asks for more than that, with the header right in front of it.
+ *
+ * @param size Size of the request.
+ * @param alignment Required alignment, a power of two.
+ * @return Pointer to the allocation, or NULL if it could not be mapped.
+ */
+static void *_mm_preload_map(size_t size, size_t alignment)
+{
+    size_t lead = (alignment <= sizeof(mm_preload_mapping_t) ? sizeof(mm_preload_mapping_t)
+                                                              : (alignment < mm_preload_page_size ? mm_preload_page_size
+                                                                                                  : alignment));
+    if (size > SIZE_MAX - lead - alignment - mm_preload_page_size)
+    {
+        return NULL;
+    }
+
+    /* alignments beyond a page need slack to find an aligned address in the mapping */
+    size_t slack = (alignment > mm_preload_page_size ? alignment : 0);
+    size_t length = (lead + size + slack + mm_preload_page_size - 1) & ~(mm_preload_page_size - 1);
+    uint8_t *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    uint8_t *ptr = base + lead;
+    if (slack != 0)
+    {
+        ptr = (uint8_t *)(((uintptr_t)ptr + alignment - 1) & ~(alignment - 1));
+    }
+
+    mm_preload_mapping_t *mapping = (mm_preload_mapping_t *)ptr - 1;
+    mapping->base = base;
+    mapping->length = length;
+
+    return ptr;
+}
+
+/**
+ * @brief Allocates memory, from a size class record when the request fits one.
+ *
+ * @param size Size of the request.
+ * @param alignment Required alignment, a power of two of at least MM_PRELOAD_MIN_ALIGNMENT.
+ * @return Pointer to uninitialized memory, or NULL with errno set to ENOMEM.
+ */
+static void *_mm_preload_alloc(size_t size, size_t alignment)
+{
+    _mm_preload_init();
+
+    void *ptr = NULL;
+    if (size <= MM_SIZE_CLASS_MAX_BYTES && alignment <= MM_SIZE_CLASS_ALIGNMENT)
+    {
+        ptr = mm_size_class_alloc(size, alignment);
+    }
+    else
+    {
+        ptr = _mm_preload_map(size, alignment);
+    }
+
+    if (ptr == NULL)
+    {
+        errno = ENOMEM;
+    }
+
+    return ptr;
+}
+
+/**
+ * @brief Calculates how many bytes an allocation of this library can use.
+ *
+ * @param ptr Pointer returned by this library.
+ * @return Number of usable bytes.
+ */
+static size_t _mm_preload_usable_size(const void *ptr)
+{
+    if (_mm_preload_is_mapped(ptr))
+    {
+        const mm_preload_mapping_t *mapping = (const mm_preload_mapping_t *)ptr - 1;
+        return mapping->length - (size_t)((const uint8_t *)ptr - (const uint8_t *)mapping->base);
+    }
+
+    return mm_usable_size(ptr);
+}
+
+MM_PRELOAD_EXPORT void *malloc(size_t size)
+{
+    return _mm_preload_alloc(size, MM_PRELOAD_MIN_ALIGNMENT);
+}
+
+MM_PRELOAD_EXPORT void free(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    if (_mm_preload_is_mapped(ptr))
+    {
+        mm_preload_mapping_t *mapping = (mm_preload_mapping_t *)ptr - 1;
+        munmap(mapping->base, mapping->length);
+        return;
+    }
+
+    xfree(ptr);
+}
+
+MM_PRELOAD_EXPORT void *calloc(size_t count, size_t size)
+{
+    size_t total = 0;
+    if (__builtin_mul_overflow(count, size, &total))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *ptr = _mm_preload_alloc(total, MM_PRELOAD_MIN_ALIGNMENT);
+    /* fresh mappings are already zero */
+    if (ptr != NULL && !_mm_preload_is_mapped(ptr))
+    {
+        memset(ptr, 0, total);
+    }
+
+    return ptr;
+}
+
+MM_PRELOAD_EXPORT void *realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return malloc(size);
+    }
+    if (size == 0)
+    {
+        free(ptr);
+        return NULL;
+    }
+
+    size_t usable_size = _mm_preload_usable_size(ptr);
+
+    if (_mm_preload_is_mapped(ptr))
+    {
+        mm_preload_mapping_t *mapping = (mm_preload_mapping_t *)ptr - 1;
+        /* only mappings of the plain layout can move, an aligned pointer would lose its alignment */
+        if (size > MM_SIZE_CLASS_MAX_BYTES && (uint8_t *)mapping == (uint8_t *)mapping->base)
+        {
+            size_t length = (sizeof(mm_preload_mapping_t) + size + mm_preload_page_size - 1) &
+                            ~(mm_preload_page_size - 1);
+            if (length < size)
+            {
+                errno = ENOMEM;
+                return NULL;
+            }
+            void *base = mremap(mapping->base, mapping->length, length, MREMAP_MAYMOVE);
+            if (base == MAP_FAILED)
+            {
+                errno = ENOMEM;
+                return NULL;
+            }
+            mapping = base;
+            mapping->length = length;
+            mapping->base = base;
+            return mapping + 1;
+        }
+    }
+    else if (size <= usable_size && size > usable_size / 2)
+    {
+        /* shrinking within the size class, or close to it, keeps the object where it is */
+        return ptr;
+    }
+
+    void *new_ptr = malloc(size);
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, (size < usable_size ? size : usable_size));
+    free(ptr);
+
+    return new_ptr;
+}
+
+MM_PRELOAD_EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+
+    void *ptr = _mm_preload_alloc(size, (alignment < MM_PRELOAD_MIN_ALIGNMENT ? MM_PRELOAD_MIN_ALIGNMENT : alignment));
+    if (ptr == NULL)
+    {
+        return ENOMEM;
+    }
+
+    *memptr = ptr;
+    return 0;
+}
+
+MM_PRELOAD_EXPORT void *aligned_alloc(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return _mm_preload_alloc(size, (alignment < MM_PRELOAD_MIN_ALIGNMENT ? MM_PRELOAD_MIN_ALIGNMENT : alignment));
+}
+
+/* the obsolete aligned allocators are replaced too, so that their memory is never handed to the free() above */
+MM_PRELOAD_EXPORT void *memalign(size_t alignment, size_t size)
+{
+    return aligned_alloc(alignment, size);
+}
+
+MM_PRELOAD_EXPORT void *valloc(size_t size)
+{
+    _mm_preload_init();
+    return _mm_preload_alloc(size, mm_preload_page_size);
+}
+
+MM_PRELOAD_EXPORT void *pvalloc(size_t size)
+{
+    _mm_preload_init();
+    return _mm_preload_alloc((size + mm_preload_page_size - 1) & ~(mm_preload_page_size - 1), mm_preload_page_size);
+}
+
+MM_PRELOAD_EXPORT size_t malloc_usable_size(void *ptr)
+{
+    return (ptr != NULL ? _mm_preload_usable_size(ptr) : 0);
+}
@@ -1,6 +1,25 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "test_app.h"
 #include "uapi_mm.h"
 
+uint32_t failed_checks = 0;
+
 typedef struct emp
 {
     char name[32];
@@ -15,8 +34,2004 @@ typedef struct student
     uint8_t grade;
 } student_t;
 
+typedef struct shared_msg
+{
+    uint32_t seq;
+    char text[28];
+} shared_msg_t;
+
+/* keeps calling into the allocator until told to stop, whichever heap is attached */
+static void *hammer_heap_lock(void *arg)
+{
+    uint32_t *stop = arg;
+    uint64_t calls = 0;
+    while (!__atomic_load_n(stop, __ATOMIC_ACQUIRE))
+    {
+        mm_budget_usage("shared_msg_t");
+        mm_get_heap_root();
+        calls++;
+    }
+
+    return (void *)(uintptr_t)calls;
+}
+
+static void test_shared_heap(void)
+{
+    printf("\n******************** TEST 4: shared heap ********************");
+
+    int fd = memfd_create("test_app_heap", 0);
+    CHECK(fd != -1);
+    CHECK(mm_init_shared(fd, 1 << 20) == 0);
+    CHECK(MM_REG_STRUCT(shared_msg_t) == 0);
+
+    shared_msg_t *msg = xcalloc("shared_msg_t", 1);
+    CHECK(msg != NULL);
+    msg->seq = 42;
+    strcpy(msg->text, "hello");
+    uint64_t offset = mm_shared_offset(msg);
+    CHECK(offset != 0);
+    CHECK(mm_shared_ptr(offset) == msg);
+
+    /* a second heap cannot be attached on top of the first one */
+    int other_fd = memfd_create("test_app_other_heap", 0);
+    CHECK(mm_init_shared(other_fd, 1 << 20) == -3);
+    CHECK(mm_init_persistent("test_app_heap.img", 1 << 20) == -3);
+    close(other_fd);
+
+    /* another process maps the heap at another address and finds the object at the same offset */
+    pid_t child = fork();
+    if (child == 0)
+    {
+        mm_detach_shared();
+        if (mm_init_shared(fd, 0) != 0)
+        {
+            _exit(1);
+        }
+        shared_msg_t *seen = mm_shared_ptr(offset);
+        _exit(seen != NULL && seen->seq == 42 && strcmp(seen->text, "hello") == 0 ? 0 : 2);
+    }
+    int status = 0;
+    CHECK(waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* offsets never name the heap header or memory outside of the heap */
+    CHECK(mm_shared_offset(&status) == 0);
+    CHECK(mm_shared_ptr(0) == NULL);
+    CHECK(mm_shared_ptr(8) == NULL);
+    xfree(msg);
+    mm_detach_shared();
+    CHECK(mm_shared_ptr(offset) == NULL);
+
+    /* an object that does not hold a heap is refused */
+    int junk_fd = memfd_create("test_app_junk", 0);
+    char junk[4096];
+    memset(junk, 0x5a, sizeof(junk));
+    CHECK(write(junk_fd, junk, sizeof(junk)) == sizeof(junk));
+    CHECK(mm_init_shared(junk_fd, 0) == -2);
+    CHECK(mm_init_shared(-1, 1 << 20) == -1);
+    close(junk_fd);
+    close(fd);
+
+    /* a process killed while formatting leaves a heap that is refused rather than waited for */
+    int torn_fd = memfd_create("test_app_torn", 0);
+    CHECK(ftruncate(torn_fd, 1 << 20) == 0);
+    uint32_t *torn = mmap(NULL, 1 << 20, PROT_READ | PROT_WRITE, MAP_SHARED, torn_fd, 0);
+    CHECK(torn != MAP_FAILED);
+    torn[2] = 1; /* state of the heap header, MM_HEAP_FORMATTING */
+    munmap(torn, 1 << 20);
+    CHECK(mm_init_shared(torn_fd, 0) == -2);
+    close(torn_fd);
+
+    /* processes attaching at the same time to an empty object format it once */
+    int raced_fd = memfd_create("test_app_raced", 0);
+    pid_t racers[4];
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        racers[i] = fork();
+        if (racers[i] == 0)
+        {
+            mm_detach_shared();
+            /* whichever process comes second finds the record of the first one */
+            if (mm_init_shared(raced_fd, 1 << 20) != 0 || MM_REG_STRUCT(shared_msg_t) == -1)
+            {
+                _exit(1);
+            }
+            shared_msg_t *mine = xcalloc("shared_msg_t", 1);
+            _exit(mine != NULL && mm_shared_offset(mine) != 0 ? 0 : 2);
+        }
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        CHECK(waitpid(racers[i], &status, 0) == racers[i] && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    CHECK(mm_init_shared(raced_fd, 0) == 0);
+    CHECK(mm_get_struct_record("shared_msg_t") != NULL);
+    mm_detach_shared();
+
+    /* detaching while other threads are inside the allocator switches them over to the private heap */
+    for (uint32_t round = 0; round < 20; round++)
+    {
+        static uint32_t stop;
+        pthread_t threads[4];
+        CHECK(mm_init_shared(raced_fd, 0) == 0);
+        stop = 0;
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            pthread_create(&threads[i], NULL, hammer_heap_lock, &stop);
+        }
+        usleep(1000);
+        mm_detach_shared();
+        usleep(1000);
+        __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    CHECK(mm_shared_offset(&status) == 0);
+    close(raced_fd);
+}
+
+typedef struct journal
+{
+    uint64_t entries;
+    char last[24];
+} journal_t;
+
+static void test_persistent_heap(void)
+{
+    printf("\n******************** TEST 5: persistent heap ********************");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_app_heap_%d.img", (int)getpid());
+    unlink(path);
+
+    CHECK(mm_init_persistent(path, 1 << 20) == 0);
+    CHECK(MM_REG_STRUCT(journal_t) == 0);
+    journal_t *journal = xcalloc("journal_t", 1);
+    CHECK(journal != NULL);
+    journal->entries = 7;
+    mm_set_heap_root(journal);
+    CHECK(mm_close_persistent() == 0);
+    CHECK(mm_close_persistent() == -1);
+
+    /* a clean reopen finds the root object in place */
+    CHECK(mm_init_persistent(path, 0) == 0);
+    journal = mm_get_heap_root();
+    CHECK(journal != NULL && journal->entries == 7);
+
+    /* the file stays locked while the heap is open */
+    int fd = open(path, O_RDWR);
+    CHECK(flock(fd, LOCK_EX | LOCK_NB) != 0);
+    close(fd);
+    CHECK(mm_close_persistent() == 0);
+    fd = open(path, O_RDWR);
+    CHECK(flock(fd, LOCK_EX | LOCK_NB) == 0);
+    CHECK(mm_init_persistent(path, 0) == -4);
+    close(fd);
+
+    /* a process that exits without closing the heap leaves it dirty, with its updates in place */
+    pid_t child = fork();
+    if (child == 0)
+    {
+        if (mm_init_persistent(path, 0) != 0)
+        {
+            _exit(1);
+        }
+        journal_t *seen = mm_get_heap_root();
+        seen->entries++;
+        strcpy(seen->last, "crashed");
+        _exit(0);
+    }
+    int status = 0;
+    CHECK(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK(mm_init_persistent(path, 0) == 1);
+    journal = mm_get_heap_root();
+    CHECK(journal != NULL && journal->entries == 8 && strcmp(journal->last, "crashed") == 0);
+    xfree(journal);
+    mm_set_heap_root(NULL);
+    CHECK(mm_close_persistent() == 0);
+    CHECK(mm_init_persistent(path, 0) == 0);
+    CHECK(mm_get_heap_root() == NULL);
+    CHECK(mm_close_persistent() == 0);
+
+    /* closing the heap while other threads are inside the allocator neither crashes them nor leaves it dirty */
+    for (uint32_t round = 0; round < 20; round++)
+    {
+        static uint32_t stop;
+        pthread_t threads[4];
+        CHECK(mm_init_persistent(path, 0) == 0);
+        stop = 0;
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            pthread_create(&threads[i], NULL, hammer_heap_lock, &stop);
+        }
+        usleep(1000);
+        CHECK(mm_close_persistent() == 0);
+        usleep(1000);
+        __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    CHECK(mm_init_persistent(path, 0) == 0);
+    CHECK(mm_close_persistent() == 0);
+    unlink(path);
+
+    /* files that cannot hold or do not hold a heap are refused */
+    CHECK(mm_init_persistent("/nonexistent/test_app_heap.img", 1 << 20) == -1);
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    char junk[4096];
+    memset(junk, 0x5a, sizeof(junk));
+    CHECK(write(fd, junk, sizeof(junk)) == sizeof(junk));
+    close(fd);
+    CHECK(mm_init_persistent(path, 0) == -2);
+    unlink(path);
+
+    /* a file whose word at the state of a heap header happens to be 0 is refused and left as it was */
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    memset(junk + 8, 0, 4);
+    CHECK(write(fd, junk, sizeof(junk)) == sizeof(junk));
+    CHECK(mm_init_persistent(path, 1 << 20) == -2);
+    char reread[4096];
+    CHECK(pread(fd, reread, sizeof(reread), 0) == sizeof(reread) && memcmp(reread, junk, sizeof(junk)) == 0);
+    struct stat file_stat;
+    CHECK(fstat(fd, &file_stat) == 0 && file_stat.st_size == sizeof(junk));
+    close(fd);
+    unlink(path);
+}
+
+typedef struct session
+{
+    uint64_t id;
+    char user[56];
+} session_t;
+
+static void test_out_of_band_records(void)
+{
+    printf("\n******************** TEST 6: out-of-band metadata ********************");
+
+    CHECK(MM_REG_STRUCT_WITH_FLAGS(session_t, MM_RECORD_OUT_OF_BAND_META) == 0);
+    CHECK(MM_REG_STRUCT_WITH_FLAGS(session_t, MM_RECORD_OUT_OF_BAND_META) == -2);
+    mm_record_t *record = mm_get_struct_record("session_t");
+    uint32_t slots = mm_record_max_units(record);
+    CHECK(slots > 1);
+
+    /* the slots of a page are packed back to back, with no metadata between them */
+    session_t *sessions[128];
+    for (uint32_t i = 0; i < 128; i++)
+    {
+        sessions[i] = xcalloc("session_t", 1);
+        CHECK(sessions[i] != NULL && sessions[i]->id == 0);
+        sessions[i]->id = i;
+    }
+    CHECK(sessions[1] == sessions[0] + 1);
+    CHECK(mm_usable_size(sessions[0]) >= sizeof(session_t));
+
+    /* freeing a slot leaves the bytes of its neighbours and of the freed object alone */
+    xfree(sessions[1]);
+    CHECK(sessions[0]->id == 0 && sessions[2]->id == 2 && sessions[1]->id == 1);
+    sessions[1] = xcalloc("session_t", 1);
+    CHECK(sessions[1] != NULL && sessions[1]->id == 0);
+    sessions[1]->id = 1;
+    for (uint32_t i = 0; i < 128; i++)
+    {
+        CHECK(sessions[i]->id == i);
+    }
+
+    /* a run of slots must fit in one page */
+    session_t *run = xcalloc("session_t", slots);
+    CHECK(run != NULL);
+    xfree(run);
+    CHECK(xcalloc("session_t", slots + 1) == NULL);
+
+    for (uint32_t i = 0; i < 128; i++)
+    {
+        xfree(sessions[i]);
+    }
+}
+
+typedef struct reading
+{
+    uint32_t sensor;
+    uint32_t value;
+    char unit[56];
+} reading_t;
+
+static int8_t sum_reading_values(void *app_data, uint32_t size, void *arg)
+{
+    *(uint64_t *)arg += ((reading_t *)app_data)->value;
+    return 0;
+}
+
+static int8_t stop_at_first_reading(void *app_data, uint32_t size, void *arg)
+{
+    return 1;
+}
+
+static void test_object_cursors(void)
+{
+    printf("\n******************** TEST 7: object cursors ********************");
+
+    CHECK(MM_REG_STRUCT(reading_t) == 0);
+    reading_t *readings[300];
+    uint64_t expected_sum = 0;
+    for (uint32_t i = 0; i < 300; i++)
+    {
+        readings[i] = xcalloc("reading_t", 1);
+        readings[i]->value = i;
+    }
+    for (uint32_t i = 0; i < 300; i++)
+    {
+        if (i % 3 == 0)
+        {
+            xfree(readings[i]);
+            readings[i] = NULL;
+        }
+        else
+        {
+            expected_sum += i;
+        }
+    }
+
+    /* a cursor sees every live object once, and none of the freed ones */
+    mm_object_cursor_t cursor;
+    CHECK(mm_object_cursor_init(&cursor, "reading_t") == 0);
+    uint32_t size = 0;
+    uint32_t seen = 0;
+    uint64_t sum = 0;
+    reading_t *reading = NULL;
+    while ((reading = mm_object_cursor_next(&cursor, &size)) != NULL)
+    {
+        CHECK(size == sizeof(reading_t));
+        sum += reading->value;
+        seen++;
+    }
+    CHECK(seen == 200 && sum == expected_sum);
+
+    sum = 0;
+    CHECK(mm_for_each_object("reading_t", sum_reading_values, &sum) == 200);
+    CHECK(sum == expected_sum);
+    CHECK(mm_for_each_object("reading_t", stop_at_first_reading, NULL) == 1);
+
+    /* the ranges of a partition cover every live object exactly once */
+    mm_object_cursor_t cursors[4];
+    uint32_t ranges = mm_object_cursor_partition("reading_t", cursors, 4);
+    CHECK(ranges > 1 && ranges <= 4);
+    sum = 0;
+    int32_t visited = 0;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        visited += mm_object_cursor_for_each(&cursors[i], sum_reading_values, &sum);
+    }
+    CHECK(visited == 200 && sum == expected_sum);
+
+    /* unregistered structs cannot be walked */
+    CHECK(mm_object_cursor_init(&cursor, "no_such_t") == -1);
+    CHECK(mm_for_each_object("no_such_t", sum_reading_values, &sum) == -1);
+    CHECK(mm_object_cursor_partition("no_such_t", cursors, 4) == 0);
+
+    for (uint32_t i = 0; i < 300; i++)
+    {
+        if (readings[i] != NULL)
+        {
+            xfree(readings[i]);
+        }
+    }
+    CHECK(mm_for_each_object("reading_t", sum_reading_values, &sum) == 0);
+}
+
+typedef struct quote
+{
+    uint64_t id;
+    char symbol[24];
+} quote_t;
+
+typedef struct quote_copy
+{
+    uint64_t id;
+    char symbol[24];
+} quote_copy_t;
+
+typedef struct quote_page_copy
+{
+    uint64_t id;
+    char symbol[24];
+} quote_page_copy_t;
+
+static int8_t count_objects(void *app_data, uint32_t size, void *arg)
+{
+    (*(uint32_t *)arg)++;
+    return 0;
+}
+
+static int8_t sum_quote_ids(void *app_data, uint32_t size, void *arg)
+{
+    *(uint64_t *)arg += ((quote_t *)app_data)->id;
+    return 0;
+}
+
+static uint32_t live_objects(const char *struct_name)
+{
+    uint32_t count = 0;
+    mm_for_each_object(struct_name, count_objects, &count);
+    return count;
+}
+
+static void test_export_import(void)
+{
+    printf("\n******************** TEST 8: export and import ********************");
+
+    CHECK(MM_REG_STRUCT(quote_t) == 0);
+    CHECK(MM_REG_STRUCT(quote_copy_t) == 0);
+    CHECK(MM_REG_STRUCT(quote_page_copy_t) == 0);
+    CHECK(MM_REG_STRUCT(empt_t) == -2);
+
+    /* an empty record exports a bare header followed by the 4-byte end of the stream */
+    int fd = memfd_create("test_app_export", 0);
+    CHECK(mm_export_objects("quote_t", fd, 0) == 0);
+    off_t header_size = lseek(fd, 0, SEEK_CUR) - 4;
+
+    quote_t *quotes[20];
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        quotes[i] = xcalloc("quote_t", 1);
+        quotes[i]->id = i + 1;
+    }
+
+    /* object stream: the objects land in the record of another struct of the same size */
+    CHECK(ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0);
+    CHECK(mm_export_objects("quote_t", fd, 0) == 20);
+    off_t stream_size = lseek(fd, 0, SEEK_CUR);
+    lseek(fd, 0, SEEK_SET);
+    CHECK(mm_import_objects("quote_copy_t", fd) == 20);
+    uint64_t sum = 0;
+    mm_for_each_object("quote_copy_t", sum_quote_ids, &sum);
+    CHECK(sum == 20 * 21 / 2);
+
+    /* a stream cut short inside a batch imports nothing and keeps no half-read objects */
+    CHECK(ftruncate(fd, stream_size - 10) == 0 && lseek(fd, 0, SEEK_SET) == 0);
+    CHECK(mm_import_objects("quote_copy_t", fd) == -1);
+    CHECK(live_objects("quote_copy_t") == 20);
+
+    /* a stream of another struct size is refused */
+    lseek(fd, 0, SEEK_SET);
+    CHECK(mm_import_objects("student_t", fd) == -1);
+    CHECK(mm_import_objects("no_such_t", fd) == -1);
+    CHECK(mm_export_objects("no_such_t", fd, 0) == -1);
+
+    /* page stream: whole page images are linked into the importing record */
+    CHECK(ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0);
+    CHECK(mm_export_objects("quote_t", fd, MM_EXPORT_PAGES) == 20);
+    stream_size = lseek(fd, 0, SEEK_CUR);
+    lseek(fd, 0, SEEK_SET);
+    CHECK(mm_import_objects("quote_page_copy_t", fd) == 20);
+    sum = 0;
+    mm_for_each_object("quote_page_copy_t", sum_quote_ids, &sum);
+    CHECK(sum == 20 * 21 / 2);
+
+    /* page images are only imported by the metadata version that wrote them, which closes the header */
+    uint32_t version = 0;
+    CHECK(pread(fd, &version, sizeof(version), header_size - 4) == sizeof(version));
+    version++;
+    CHECK(pwrite(fd, &version, sizeof(version), header_size - 4) == sizeof(version));
+    lseek(fd, 0, SEEK_SET);
+    CHECK(mm_import_objects("quote_page_copy_t", fd) == -1);
+    version--;
+    CHECK(pwrite(fd, &version, sizeof(version), header_size - 4) == sizeof(version));
+
+    /* a page image whose block chain does not describe the page is refused before it is linked */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    char *junk = malloc(page_size);
+    memset(junk, 0x5a, page_size);
+    off_t page_image = header_size + 4;
+    CHECK(pwrite(fd, junk, page_size, page_image) == (ssize_t)page_size);
+    lseek(fd, 0, SEEK_SET);
+    CHECK(mm_import_objects("quote_page_copy_t", fd) == -1);
+    CHECK(live_objects("quote_page_copy_t") == 20);
+
+    /* the page image of an out-of-band record is followed by its slot bitmaps, which must fit the page */
+    typedef session_t session_copy_t;
+    CHECK(MM_REG_STRUCT_WITH_FLAGS(session_copy_t, MM_RECORD_OUT_OF_BAND_META) == 0);
+    session_t *session = xcalloc("session_t", 3);
+    CHECK(ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0);
+    CHECK(mm_export_objects("session_t", fd, MM_EXPORT_PAGES) == 1);
+    lseek(fd, 0, SEEK_SET);
+    CHECK(mm_import_objects("session_copy_t", fd) == 1);
+    CHECK(pwrite(fd, junk, 128, page_image + page_size) == 128);
+    lseek(fd, 0, SEEK_SET);
+    CHECK(mm_import_objects("session_copy_t", fd) == -1);
+    CHECK(live_objects("session_copy_t") == 1);
+    xfree(session);
+    free(junk);
+    close(fd);
+
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        xfree(quotes[i]);
+    }
+}
+
+typedef struct particle
+{
+    float x;
+    float y;
+    uint32_t flags;
+    char label[20];
+} particle_t;
+
+static void test_struct_of_arrays(void)
+{
+    printf("\n******************** TEST 9: struct of arrays ********************");
+
+    mm_field_t fields[] = {MM_SOA_FIELD_DESC(particle_t, x), MM_SOA_FIELD_DESC(particle_t, y),
+                           MM_SOA_FIELD_DESC(particle_t, flags), MM_SOA_FIELD_DESC(particle_t, label)};
+    CHECK(MM_REG_SOA_STRUCT(particle_t, fields) == 0);
+    CHECK(MM_REG_SOA_STRUCT(particle_t, fields) == -2);
+    mm_field_t outside[] = {{(uint32_t)sizeof(particle_t) - 2, 4}};
+    CHECK(mm_register_soa_struct_record("bad_particle_t", sizeof(particle_t), outside, 1) == -1);
+    CHECK(mm_register_soa_struct_record("bad_particle_t", sizeof(particle_t), fields, 0) == -1);
+
+    mm_soa_ref_t refs[200];
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        CHECK(mm_soa_alloc("particle_t", &refs[i]) == 0);
+        particle_t particle = {(float)i, -(float)i, i, "p"};
+        mm_soa_store(refs[i], &particle);
+    }
+
+    /* single fields are read in place, whole objects are gathered back from the columns */
+    CHECK(MM_SOA_FIELD(refs[7], 0, float) == 7.0f && MM_SOA_FIELD(refs[7], 2, uint32_t) == 7);
+    particle_t loaded;
+    mm_soa_load(refs[9], &loaded);
+    CHECK(loaded.x == 9.0f && loaded.y == -9.0f && loaded.flags == 9 && strcmp(loaded.label, "p") == 0);
+
+    /* a page walk hands out whole columns; the flags column sums to the same as the objects stored */
+    mm_soa_free(refs[0]);
+    mm_object_cursor_t cursor;
+    CHECK(mm_object_cursor_init(&cursor, "particle_t") == 0);
+    const uint64_t *used_bitmap = NULL;
+    mm_soa_columns_t *columns = NULL;
+    uint64_t flags_sum = 0;
+    uint32_t pages = 0;
+    while ((columns = mm_soa_cursor_next_page(&cursor, &used_bitmap)) != NULL)
+    {
+        uint32_t *flags = MM_SOA_COLUMN(columns, 2, uint32_t);
+        for (uint32_t slot = 0; slot < columns->slot_count; slot++)
+        {
+            if ((used_bitmap[slot / 64] >> (slot % 64)) & 1)
+            {
+                flags_sum += flags[slot];
+            }
+        }
+        pages++;
+    }
+    CHECK(pages > 1 && flags_sum == 199 * 200 / 2);
+
+    /* only struct-of-arrays records are allocated or walked this way */
+    mm_soa_ref_t ref;
+    CHECK(mm_soa_alloc("empt_t", &ref) == -1);
+    CHECK(mm_soa_alloc("no_such_t", &ref) == -1);
+    CHECK(mm_object_cursor_init(&cursor, "empt_t") == 0);
+    CHECK(mm_soa_cursor_next_page(&cursor, &used_bitmap) == NULL);
+
+    for (uint32_t i = 1; i < 200; i++)
+    {
+        mm_soa_free(refs[i]);
+    }
+}
+
+typedef struct texture
+{
+    uint32_t width;
+    uint32_t height;
+    char path[40];
+} texture_t;
+
+static int8_t count_handles(mm_handle_t handle, void *app_data, void *arg)
+{
+    (*(uint32_t *)arg)++;
+    return 0;
+}
+
+static void test_handles(void)
+{
+    printf("\n******************** TEST 10: handles ********************");
+
+    CHECK(MM_REG_STRUCT(texture_t) == 0);
+    CHECK(mm_handle_table("no_such_t") == NULL);
+    mm_handle_table_t *table = mm_handle_table("texture_t");
+    CHECK(table != NULL && mm_handle_table("texture_t") == table);
+
+    mm_handle_t handles[10];
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        handles[i] = mm_handle_alloc(table, 1);
+        CHECK(handles[i] != MM_HANDLE_NULL);
+        texture_t *texture = mm_handle_get(table, handles[i]);
+        CHECK(texture != NULL && texture->width == 0);
+        texture->width = i;
+    }
+    CHECK(((texture_t *)mm_handle_get(table, handles[4]))->width == 4);
+    uint32_t live = 0;
+    CHECK(mm_handle_for_each(table, count_handles, &live) == 10 && live == 10);
+
+    /* a freed handle goes stale, and stays stale after its entry is reused with a new generation */
+    mm_handle_t stale = handles[3];
+    CHECK(mm_handle_free(table, stale) == 0);
+    CHECK(mm_handle_get(table, stale) == NULL);
+    CHECK(mm_handle_free(table, stale) == -1);
+    handles[3] = mm_handle_alloc(table, 1);
+    CHECK(handles[3] != MM_HANDLE_NULL && handles[3] != stale);
+    CHECK((uint32_t)handles[3] == (uint32_t)stale);
+    CHECK(mm_handle_get(table, stale) == NULL && mm_handle_get(table, handles[3]) != NULL);
+
+    /* null handles and indices past the table resolve to nothing */
+    CHECK(mm_handle_get(table, MM_HANDLE_NULL) == NULL);
+    CHECK(mm_handle_get(table, handles[9] + 1000) == NULL);
+    CHECK(mm_handle_free(table, MM_HANDLE_NULL) == -1);
+
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        CHECK(mm_handle_free(table, handles[i]) == 0);
+    }
+    live = 0;
+    CHECK(mm_handle_for_each(table, count_handles, &live) == 0);
+}
+
+typedef struct route
+{
+    uint64_t id;
+    char stops[200];
+} route_t;
+
+typedef struct route_table
+{
+    route_t *routes[120];
+    uint32_t moves;
+} route_table_t;
+
+static void track_moved_route(void *old_app_data, void *new_app_data, uint32_t size, void *arg)
+{
+    route_table_t *table = arg;
+    for (uint32_t i = 0; i < 120; i++)
+    {
+        if (table->routes[i] == old_app_data)
+        {
+            table->routes[i] = new_app_data;
+        }
+    }
+    table->moves++;
+}
+
+static void allocate_while_moving(void *old_app_data, void *new_app_data, uint32_t size, void *arg)
+{
+    xcalloc("route_t", 1);
+}
+
+static void test_compaction(void)
+{
+    printf("\n******************** TEST 11: compaction ********************");
+
+    static route_table_t table;
+    CHECK(MM_REG_STRUCT(route_t) == 0);
+    for (uint32_t i = 0; i < 120; i++)
+    {
+        table.routes[i] = xcalloc("route_t", 1);
+        table.routes[i]->id = i;
+    }
+    /* keep one object in three, spread over every page */
+    for (uint32_t i = 0; i < 120; i++)
+    {
+        if (i % 3 != 0)
+        {
+            xfree(table.routes[i]);
+            table.routes[i] = NULL;
+        }
+    }
+
+    /* without a callback only objects allocated by handle may move */
+    CHECK(mm_compact("route_t", 0) == 0);
+    CHECK(mm_set_relocation_callback("route_t", track_moved_route, &table) == 0);
+    int32_t released = mm_compact("route_t", 0);
+    CHECK(released > 0 && table.moves > 0);
+    for (uint32_t i = 0; i < 120; i += 3)
+    {
+        CHECK(table.routes[i]->id == i);
+    }
+
+    /* a callback calling back into the allocator is stopped instead of deadlocking on the heap lock */
+    for (uint32_t i = 0; i < 120; i += 3)
+    {
+        xfree(table.routes[i]);
+        table.routes[i] = NULL;
+    }
+    route_t *routes[60];
+    for (uint32_t i = 0; i < 60; i++)
+    {
+        routes[i] = xcalloc("route_t", 1);
+    }
+    for (uint32_t i = 0; i < 60; i++)
+    {
+        if (i % 4 != 0)
+        {
+            xfree(routes[i]);
+        }
+    }
+    pid_t child = fork();
+    if (child == 0)
+    {
+        alarm(5);
+        mm_set_relocation_callback("route_t", allocate_while_moving, NULL);
+        freopen("/dev/null", "w", stderr);
+        mm_compact("route_t", 0);
+        _exit(0);
+    }
+    int status = 0;
+    CHECK(waitpid(child, &status, 0) == child && WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+    for (uint32_t i = 0; i < 60; i += 4)
+    {
+        xfree(routes[i]);
+    }
+
+    CHECK(mm_set_relocation_callback("no_such_t", track_moved_route, NULL) == -1);
+    CHECK(mm_compact("no_such_t", 0) == -1);
+    CHECK(mm_compact("session_t", 0) == -1);
+}
+
+typedef struct connection
+{
+    int32_t socket;
+    uint32_t uses;
+    char peer[56];
+} connection_t;
+
+typedef struct lifecycle
+{
+    uint32_t constructed;
+    uint32_t destroyed;
+} lifecycle_t;
+
+static void construct_connection(void *app_data, void *arg)
+{
+    ((connection_t *)app_data)->socket = 3;
+    ((lifecycle_t *)arg)->constructed++;
+}
+
+static void destroy_connection(void *app_data, void *arg)
+{
+    ((lifecycle_t *)arg)->destroyed++;
+}
+
+static void free_while_destroying(void *app_data, void *arg)
+{
+    xfree(app_data);
+}
+
+static void test_object_cache(void)
+{
+    printf("\n******************** TEST 12: object cache ********************");
+
+    static lifecycle_t lifecycle;
+    CHECK(MM_REG_STRUCT(connection_t) == 0);
+    CHECK(mm_set_object_constructor("connection_t", construct_connection, destroy_connection, &lifecycle) == 0);
+
+    /* a cached object comes back still constructed, with its state, and is not constructed again */
+    connection_t *connection = mm_cache_alloc("connection_t");
+    CHECK(connection != NULL && connection->socket == 3 && lifecycle.constructed == 1);
+    connection->uses = 5;
+    mm_cache_free(connection);
+    connection_t *reused = mm_cache_alloc("connection_t");
+    CHECK(reused == connection && reused->uses == 5 && lifecycle.constructed == 1);
+
+    /* reaping destroys only the cached objects of pages holding nothing else */
+    connection_t *connections[200];
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        connections[i] = mm_cache_alloc("connection_t");
+    }
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        mm_cache_free(connections[i]);
+    }
+    int32_t released = mm_cache_reap("connection_t");
+    CHECK(released > 0 && lifecycle.destroyed > 0 && lifecycle.destroyed < 200);
+    CHECK(reused->uses == 5);
+    mm_cache_free(reused);
+
+    /* a destructor calling back into the allocator is stopped instead of deadlocking on the heap lock */
+    pid_t child = fork();
+    if (child == 0)
+    {
+        alarm(5);
+        mm_set_object_constructor("connection_t", construct_connection, free_while_destroying, &lifecycle);
+        freopen("/dev/null", "w", stderr);
+        mm_cache_reap("connection_t");
+        _exit(0);
+    }
+    int status = 0;
+    CHECK(waitpid(child, &status, 0) == child && WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+    CHECK(mm_cache_reap("connection_t") > 0);
+
+    CHECK(mm_set_object_constructor("no_such_t", construct_connection, NULL, NULL) == -1);
+    CHECK(mm_set_object_constructor("session_t", construct_connection, NULL, NULL) == -1);
+    CHECK(mm_cache_alloc("no_such_t") == NULL);
+    CHECK(mm_cache_reap("session_t") == -1);
+}
+
+typedef struct document
+{
+    uint64_t version;
+    char title[48];
+} document_t;
+
+typedef struct reference_worker
+{
+    document_t *document;
+    uint32_t rounds;
+} reference_worker_t;
+
+static void *retain_and_release(void *arg)
+{
+    reference_worker_t *worker = arg;
+    for (uint32_t i = 0; i < worker->rounds; i++)
+    {
+        mm_retain(worker->document);
+        mm_release(worker->document);
+    }
+    return NULL;
+}
+
+static void test_reference_counts(void)
+{
+    printf("\n******************** TEST 13: reference counts ********************");
+
+    CHECK(MM_REG_STRUCT(document_t) == 0);
+    document_t *document = xcalloc("document_t", 1);
+    CHECK(mm_retain(document) == document);
+    CHECK(mm_retain(document) == document);
+    CHECK(mm_release(document) == 2);
+    CHECK(mm_release(document) == 1);
+    CHECK(live_objects("document_t") == 1);
+
+    /* concurrent retains and releases leave the count where it was */
+    pthread_t threads[4];
+    reference_worker_t worker = {document, 100000};
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        pthread_create(&threads[i], NULL, retain_and_release, &worker);
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK(mm_retain(document) == document && mm_release(document) == 1);
+
+    /* the last reference frees the object */
+    CHECK(mm_release(document) == 0);
+    CHECK(live_objects("document_t") == 0);
+
+    /* retaining an object whose last reference is gone is caught, as long as its block has not been reused */
+    pid_t child = fork();
+    if (child == 0)
+    {
+        document_t *kept = xcalloc("document_t", 1);
+        document_t *dropped = xcalloc("document_t", 1);
+        mm_release(dropped);
+        signal(SIGABRT, SIG_DFL);
+        mm_retain(dropped);
+        _exit(kept != NULL ? 0 : 1);
+    }
+    int status = 0;
+    CHECK(waitpid(child, &status, 0) == child && WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+
+    /* out-of-band objects have no count and are freed right away */
+    session_t *session = xcalloc("session_t", 1);
+    CHECK(mm_retain(session) == NULL);
+    CHECK(mm_release(session) == 0);
+    CHECK(live_objects("session_t") == 0);
+}
+
+typedef struct ticket
+{
+    uint64_t number;
+    char owner[24];
+} ticket_t;
+
+typedef struct oversized
+{
+    char bytes[1 << 16];
+} oversized_t;
+
+MM_DEFINE_STRUCT_RECORD(ticket_t, 0);
+MM_DEFINE_STRUCT_RECORD(oversized_t, 0);
+
+static void test_static_records(void)
+{
+    printf("\n******************** TEST 16: static records ********************");
+
+    /* a defined record is created on first use, by lookup or by name, without being registered */
+    ticket_t *ticket = MM_STATIC_XCALLOC(ticket_t, 2);
+    CHECK(ticket != NULL && ticket[1].number == 0);
+    mm_record_t *record = mm_static_record(MM_STATIC_RECORD(ticket_t));
+    CHECK(record != NULL && mm_get_struct_record("ticket_t") == record);
+    ticket_t *by_name = xcalloc("ticket_t", 1);
+    CHECK(by_name != NULL && live_objects("ticket_t") == 2);
+    CHECK(MM_REG_STRUCT(ticket_t) == -2);
+    xfree(by_name);
+
+    /* attaching another heap creates the record again inside that heap */
+    int fd = memfd_create("test_app_static", 0);
+    CHECK(mm_init_shared(fd, 1 << 20) == 0);
+    ticket_t *shared_ticket = MM_STATIC_XCALLOC(ticket_t, 1);
+    CHECK(shared_ticket != NULL && mm_shared_offset(shared_ticket) != 0);
+    CHECK(mm_static_record(MM_STATIC_RECORD(ticket_t)) != record);
+    xfree(shared_ticket);
+    mm_detach_shared();
+    close(fd);
+    CHECK(mm_static_record(MM_STATIC_RECORD(ticket_t)) == record);
+    xfree(ticket);
+
+    /* a struct that does not fit in a VM page has no record */
+    CHECK(mm_static_record(MM_STATIC_RECORD(oversized_t)) == NULL);
+    CHECK(MM_STATIC_XCALLOC(oversized_t, 1) == NULL);
+}
+
+typedef struct lease
+{
+    uint64_t expiry;
+    char holder[40];
+} lease_t;
+
+static void test_page_release(void)
+{
+    printf("\n******************** TEST 19: page release ********************");
+
+    /* a record gives its last data VM page back with its last object; the page_cache option keeps pages instead */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    CHECK(MM_REG_STRUCT(lease_t) == 0);
+    CHECK(mm_budget_usage("lease_t") == 0);
+    lease_t *lease = xcalloc("lease_t", 1);
+    CHECK(mm_budget_usage("lease_t") == page_size);
+    xfree(lease);
+    CHECK(mm_budget_usage("lease_t") == 0);
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        lease = xcalloc("lease_t", 1);
+        CHECK(lease != NULL);
+        xfree(lease);
+    }
+    CHECK(mm_budget_usage("lease_t") == 0);
+}
+
+typedef struct setting
+{
+    uint32_t key;
+    char value[60];
+} setting_t;
+
+/**
+ * @brief Runs mm_configure() with stderr redirected to a pipe.
+ *
+ * @param conf The configuration string.
+ * @param output Filled with what the allocator wrote to stderr.
+ * @param size Size of `output`.
+ * @return The return value of mm_configure().
+ */
+static int8_t configure_capturing_stderr(const char *conf, char *output, size_t size)
+{
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    int saved_stderr = dup(STDERR_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    int8_t rc = mm_configure(conf);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    close(fds[1]);
+    ssize_t length = read(fds[0], output, size - 1);
+    output[length > 0 ? length : 0] = '\0';
+    close(fds[0]);
+
+    return rc;
+}
+
+static void test_configuration(void)
+{
+    printf("\n******************** TEST 22: runtime settings ********************");
+
+    char output[512];
+    CHECK(configure_capturing_stderr("span:1,huge_pages:false,stats_print:false,coloring:true", output,
+                                     sizeof(output)) == 0);
+    CHECK(output[0] == '\0');
+    CHECK(configure_capturing_stderr("", output, sizeof(output)) == 0);
+
+    /* invalid pairs are reported and skipped, the valid ones are still applied */
+    CHECK(configure_capturing_stderr("bogus:1,span:0,trace:yes,page_cache,trace:true", output, sizeof(output)) == -1);
+    CHECK(strstr(output, "\"bogus:1\"") != NULL && strstr(output, "\"span:0\"") != NULL);
+    CHECK(strstr(output, "\"trace:yes\"") != NULL && strstr(output, "\"page_cache\"") != NULL);
+    CHECK(configure_capturing_stderr("page_cache:99999999999", output, sizeof(output)) == -1);
+
+    /* trace:true was applied above, so an allocation and a free each write a line */
+    CHECK(MM_REG_STRUCT(setting_t) == 0);
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    int saved_stderr = dup(STDERR_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    setting_t *setting = xcalloc("setting_t", 1);
+    xfree(setting);
+    CHECK(mm_configure("trace:false") == 0);
+    setting = xcalloc("setting_t", 1);
+    xfree(setting);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    close(fds[1]);
+    ssize_t length = read(fds[0], output, sizeof(output) - 1);
+    output[length > 0 ? length : 0] = '\0';
+    close(fds[0]);
+    CHECK(strstr(output, "mm: alloc setting_t") != NULL && strstr(output, "mm: free setting_t") != NULL);
+    CHECK(strstr(strstr(output, "mm: free setting_t"), "mm: alloc") == NULL);
+
+    /* without a page cache an empty data VM page is unmapped, with one it stays mapped for reuse */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    unsigned char resident = 0;
+    setting = xcalloc("setting_t", 1);
+    void *page = (void *)((uintptr_t)setting & ~(uintptr_t)(page_size - 1));
+    xfree(setting);
+    CHECK(mincore(page, page_size, &resident) == -1 && errno == ENOMEM);
+    CHECK(mm_configure("page_cache:4") == 0);
+    setting = xcalloc("setting_t", 1);
+    page = (void *)((uintptr_t)setting & ~(uintptr_t)(page_size - 1));
+    xfree(setting);
+    CHECK(mincore(page, page_size, &resident) == 0);
+    setting = xcalloc("setting_t", 1);
+    CHECK((void *)((uintptr_t)setting & ~(uintptr_t)(page_size - 1)) == page);
+    xfree(setting);
+    CHECK(mm_configure("page_cache:0") == 0);
+}
+
+typedef struct graph_node
+{
+    uint64_t value;
+    mm_cref_t next;
+    mm_cref_t other;
+} graph_node_t;
+
+static void test_compressed_heap(void)
+{
+    printf("\n******************** TEST 23: compressed references ********************");
+
+    static uint64_t sum_of_nothing;
+
+    CHECK(mm_init_compressed(0) == -1);
+    CHECK(mm_init_compressed(MM_CREF_REGION_SIZE + 1) == -1);
+    CHECK(mm_cref_decode(1) == NULL);
+
+    CHECK(mm_cref_encode(&sum_of_nothing) == MM_CREF_NULL);
+
+    CHECK(mm_init_compressed(1 << 20) == 0);
+    CHECK(mm_init_compressed(1 << 20) == -1);
+    CHECK(MM_REG_STRUCT(graph_node_t) == 0);
+
+    /* a list linked through 32-bit references, walked with and without a pointer into the heap at hand */
+    graph_node_t *head = NULL;
+    for (uint64_t i = 1; i <= 100; i++)
+    {
+        graph_node_t *node = xcalloc("graph_node_t", 1);
+        CHECK(node != NULL && ((uintptr_t)node & (MM_CREF_ALIGNMENT - 1)) == 0);
+        node->value = i;
+        node->next = mm_cref_encode(head);
+        head = node;
+    }
+    CHECK(mm_cref_encode(NULL) == MM_CREF_NULL);
+    CHECK(mm_cref_decode(MM_CREF_NULL) == NULL && mm_cref_decode_near(head, MM_CREF_NULL) == NULL);
+
+    /* pointers outside of the heap or off the reference alignment have no reference */
+    CHECK(mm_cref_encode(&sum_of_nothing) == MM_CREF_NULL);
+    CHECK(mm_cref_encode((char *)head + 4) == MM_CREF_NULL);
+    CHECK(mm_cref_encode((char *)head + MM_CREF_REGION_SIZE) == MM_CREF_NULL);
+    uint64_t sum = 0;
+    uint32_t nodes = 0;
+    for (graph_node_t *node = head; node != NULL; node = mm_cref_decode_near(node, node->next))
+    {
+        CHECK(mm_cref_decode(mm_cref_encode(node)) == node);
+        sum += node->value;
+        nodes++;
+    }
+    CHECK(nodes == 100 && sum == 5050);
+
+    /* the heap does not grow past its region */
+    uint32_t allocated = 0;
+    graph_node_t *last = head;
+    graph_node_t *node = NULL;
+    while ((node = xcalloc("graph_node_t", 1)) != NULL)
+    {
+        node->other = mm_cref_encode(last);
+        last = node;
+        allocated++;
+    }
+    CHECK(allocated > 0 && allocated < (1 << 20) / sizeof(graph_node_t));
+    CHECK(mm_cref_decode_near(last, last->other) != NULL);
+
+    mm_cref_t head_ref = mm_cref_encode(head);
+    mm_detach_shared();
+    CHECK(mm_cref_decode(head_ref) == NULL);
+}
+
+typedef struct tree_node
+{
+    uint64_t key;
+    uint32_t left;
+    uint32_t right;
+    char label[24];
+} tree_node_t;
+
+typedef struct tree_leaf
+{
+    uint64_t key;
+    uint64_t value;
+} tree_leaf_t;
+
+/* start of the VM page holding an object */
+static uintptr_t page_of(const void *app_data)
+{
+    return (uintptr_t)app_data & ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+}
+
+static void test_near_allocation(void)
+{
+    printf("\n******************** TEST 24: allocation near a hint ********************");
+
+    CHECK(MM_REG_STRUCT(tree_node_t) == 0);
+    CHECK(xcalloc_near("tree_node_t_unknown", 1, NULL) == NULL);
+
+    /* fill three data VM pages; the third one is left mostly empty */
+    tree_node_t *nodes[512];
+    uintptr_t pages[3] = {0};
+    uint32_t page_count = 0;
+    uint32_t node_count = 0;
+    while (page_count < 3 && node_count < 512)
+    {
+        nodes[node_count] = xcalloc_near("tree_node_t", 1, NULL);
+        CHECK(nodes[node_count] != NULL);
+        if (page_count == 0 || pages[page_count - 1] != page_of(nodes[node_count]))
+        {
+            pages[page_count++] = page_of(nodes[node_count]);
+        }
+        node_count++;
+    }
+    CHECK(page_count == 3);
+
+    /* the first page is full, so an object near one of its objects goes to the neighbouring second page even though
+     * the third one has more room */
+    uint32_t second_page_node = 0;
+    while (page_of(nodes[second_page_node]) != pages[1])
+    {
+        second_page_node++;
+    }
+    xfree(nodes[second_page_node]);
+    tree_node_t *near = xcalloc_near("tree_node_t", 1, nodes[0]);
+    CHECK(near != NULL && page_of(near) == pages[1]);
+    nodes[second_page_node] = near;
+
+    /* room on the page of the hint is used first */
+    xfree(nodes[2]);
+    mm_record_t *record = mm_get_struct_record("tree_node_t");
+    near = mm_record_alloc_near(record, 1, nodes[0]);
+    CHECK(near != NULL && page_of(near) == pages[0]);
+    nodes[2] = near;
+
+    /* a hint of another record is ignored */
+    CHECK(MM_REG_STRUCT(tree_leaf_t) == 0);
+    tree_leaf_t *leaf = xcalloc("tree_leaf_t", 1);
+    near = xcalloc_near("tree_node_t", 1, leaf);
+    CHECK(near != NULL && page_of(near) != page_of(leaf));
+    xfree(near);
+    xfree(leaf);
+
+    /* out-of-band records take a free slot of the page of the hint */
+    session_t *session = xcalloc("session_t", 1);
+    session_t *next_session = xcalloc_near("session_t", 1, session);
+    CHECK(next_session != NULL && page_of(next_session) == page_of(session));
+    xfree(next_session);
+    xfree(session);
+
+    for (uint32_t i = 0; i < node_count; i++)
+    {
+        xfree(nodes[i]);
+    }
+    CHECK(live_objects("tree_node_t") == 0);
+}
+
+typedef struct control_sample
+{
+    uint64_t timestamp;
+    double setpoint;
+    double measured;
+} control_sample_t;
+
+typedef struct moved_job
+{
+    uint64_t id;
+    char payload[120];
+} moved_job_t;
+
+/* state shared with the thread allocating from the real-time pool while another thread holds the heap lock */
+typedef struct rt_probe
+{
+    mm_record_t *record;
+    bool done;
+    bool checked;
+} rt_probe_t;
+
+static void *allocate_real_time_sample(void *arg)
+{
+    rt_probe_t *probe = arg;
+    control_sample_t *sample = mm_record_alloc(probe->record, 1);
+    xfree(sample);
+    __atomic_store_n(&probe->done, sample != NULL, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+/* runs with the heap lock held and waits up to a second for another thread to use the real-time pool */
+static void probe_real_time_pool(void *old_app_data, void *new_app_data, uint32_t size, void *arg)
+{
+    rt_probe_t *probe = arg;
+    if (probe->checked)
+    {
+        return;
+    }
+    probe->checked = true;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, allocate_real_time_sample, probe);
+    for (uint32_t i = 0; i < 1000 && !__atomic_load_n(&probe->done, __ATOMIC_ACQUIRE); i++)
+    {
+        usleep(1000);
+    }
+    CHECK(__atomic_load_n(&probe->done, __ATOMIC_ACQUIRE));
+    pthread_detach(thread);
+}
+
+static void test_real_time_pool(void)
+{
+    printf("\n******************** TEST 25: real-time pool ********************");
+
+    CHECK(MM_REG_STRUCT_WITH_FLAGS(control_sample_t, MM_RECORD_REALTIME) == 0);
+    mm_record_t *record = mm_get_struct_record("control_sample_t");
+    CHECK(mm_record_alloc(record, 1) == NULL);
+    CHECK(mm_init_realtime(0) == -1);
+    CHECK(mm_init_realtime(SIZE_MAX / 2) == -1);
+    CHECK(mm_init_realtime(64 * 1024) == 0);
+    CHECK(mm_init_realtime(64 * 1024) == -1);
+
+    /* the pool fails fast once it is full and merges its blocks again when they are freed */
+    control_sample_t *samples[4096];
+    uint32_t sample_count = 0;
+    while (sample_count < 4096 && (samples[sample_count] = mm_record_alloc(record, 1)) != NULL)
+    {
+        samples[sample_count]->timestamp = sample_count;
+        sample_count++;
+    }
+    CHECK(sample_count > 0 && sample_count < 4096);
+    CHECK(mm_budget_usage("control_sample_t") > sample_count * sizeof(control_sample_t));
+    for (uint32_t i = 0; i < sample_count; i++)
+    {
+        CHECK(samples[i]->timestamp == i);
+        xfree(samples[i]);
+    }
+    CHECK(mm_budget_usage("control_sample_t") == 0);
+    uint32_t max_units = mm_record_max_units(record);
+    CHECK(max_units >= sample_count - 1);
+    control_sample_t *all = mm_record_alloc(record, max_units);
+    CHECK(all != NULL && mm_usable_size(all) >= max_units * sizeof(control_sample_t));
+    xfree(all);
+    CHECK(mm_record_alloc(record, max_units + 1) == NULL);
+    CHECK(mm_record_alloc(record, 0) == NULL);
+
+    /* xcalloc serves real-time records from the pool too, and zeroes them */
+    control_sample_t *zeroed = xcalloc("control_sample_t", 2);
+    CHECK(zeroed != NULL && zeroed[1].measured == 0.0);
+    xfree(zeroed);
+
+    /* a real-time record of a compressed heap is served from the pool, outside of the heap, and has no reference */
+    CHECK(mm_init_compressed(1 << 20) == 0);
+    CHECK(MM_REG_STRUCT_WITH_FLAGS(control_sample_t, MM_RECORD_REALTIME) == 0);
+    CHECK(MM_REG_STRUCT(graph_node_t) == 0);
+    control_sample_t *pooled = xcalloc("control_sample_t", 1);
+    graph_node_t *compressed = xcalloc("graph_node_t", 1);
+    CHECK(pooled != NULL && mm_cref_encode(pooled) == MM_CREF_NULL);
+    CHECK(compressed != NULL && mm_cref_decode(mm_cref_encode(compressed)) == compressed);
+    xfree(pooled);
+    xfree(compressed);
+    mm_detach_shared();
+
+    /* the pool has a lock of its own, so it serves a thread while another one holds the heap lock */
+    static rt_probe_t probe;
+    probe.record = record;
+    CHECK(MM_REG_STRUCT(moved_job_t) == 0);
+    moved_job_t *jobs[90];
+    for (uint32_t i = 0; i < 90; i++)
+    {
+        jobs[i] = xcalloc("moved_job_t", 1);
+    }
+    for (uint32_t i = 0; i < 90; i++)
+    {
+        if (i % 3 != 0)
+        {
+            xfree(jobs[i]);
+            jobs[i] = NULL;
+        }
+    }
+    CHECK(mm_set_relocation_callback("moved_job_t", probe_real_time_pool, &probe) == 0);
+    mm_compact("moved_job_t", 0);
+    CHECK(probe.checked && probe.done);
+}
+
+typedef struct sample_row
+{
+    uint64_t id;
+    double values[125];
+} sample_row_t;
+
+typedef struct sample_row_copy
+{
+    uint64_t id;
+    double values[125];
+} sample_row_copy_t;
+
+/* sums the ids of the first rows of the arrays visited, the rest of a run is not initialized */
+static int8_t sum_row_ids(void *app_data, uint32_t size, void *arg)
+{
+    *(uint64_t *)arg += ((sample_row_t *)app_data)->id;
+    return 0;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static void test_buddy_runs(void)
+{
+    printf("\n******************** TEST 26: buddy runs ********************");
+
+    /* 20 rows of 1008 bytes take a run of 8 pages */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    CHECK(MM_REG_STRUCT(sample_row_t) == 0);
+    CHECK(MM_REG_STRUCT(sample_row_copy_t) == 0);
+    sample_row_t *single = xcalloc("sample_row_t", 1);
+    sample_row_t *rows = xcalloc("sample_row_t", 20);
+    CHECK(single != NULL && rows != NULL);
+    CHECK(mm_usable_size(rows) >= 20 * sizeof(sample_row_t));
+    CHECK(mm_budget_usage("sample_row_t") == page_size + 8 * page_size);
+    single->id = 1000;
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        rows[i].id = i + 1;
+        rows[i].values[124] = i;
+    }
+
+    /* a multi-page request with a hint gets a run too */
+    sample_row_t *near_rows = xcalloc_near("sample_row_t", 10, single);
+    CHECK(near_rows != NULL && mm_usable_size(near_rows) >= 10 * sizeof(sample_row_t));
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        near_rows[i].id = 100;
+    }
+
+    /* walks visit the arrays in runs after the objects of the data VM pages */
+    uint64_t id_sum = 0;
+    CHECK(mm_for_each_object("sample_row_t", sum_row_ids, &id_sum) == 3);
+    CHECK(id_sum == 1000 + 1 + 100);
+    mm_object_cursor_t cursors[4];
+    CHECK(mm_object_cursor_partition("sample_row_t", cursors, 4) == 3);
+    uint32_t visited = 0;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        while (mm_object_cursor_next(&cursors[i], NULL) != NULL)
+        {
+            visited++;
+        }
+    }
+    CHECK(visited == 3);
+
+    /* the object stream carries the arrays, whole pages cannot */
+    int fd = memfd_create("test_app_rows", 0);
+    CHECK(mm_export_objects("sample_row_t", fd, MM_EXPORT_PAGES) == -1);
+    CHECK(lseek(fd, 0, SEEK_CUR) == 0);
+    CHECK(mm_export_objects("sample_row_t", fd, 0) == 3);
+    lseek(fd, 0, SEEK_SET);
+    CHECK(mm_import_objects("sample_row_copy_t", fd) == 3);
+    close(fd);
+    uint64_t copy_id_sum = 0;
+    CHECK(mm_for_each_object("sample_row_copy_t", sum_row_ids, &copy_id_sum) == 3);
+    CHECK(copy_id_sum == id_sum);
+    sample_row_copy_t *copied_rows = NULL;
+    mm_object_cursor_t cursor;
+    CHECK(mm_object_cursor_init(&cursor, "sample_row_copy_t") == 0);
+    while ((copied_rows = mm_object_cursor_next(&cursor, NULL)) != NULL && copied_rows->id != 1)
+    {
+    }
+    CHECK(copied_rows != NULL && copied_rows[19].id == 20 && copied_rows[19].values[124] == 19);
+
+    /* compaction leaves runs in place */
+    CHECK(mm_compact("sample_row_t", 0) >= 0);
+    CHECK(rows[19].id == 20 && rows[19].values[124] == 19);
+
+    /* the largest run is half a chunk */
+    mm_record_t *record = mm_get_struct_record("sample_row_t");
+    uint32_t max_units = mm_record_max_units(record);
+    CHECK(max_units * sizeof(sample_row_t) > 256 * page_size);
+    sample_row_t *largest = mm_record_alloc(record, max_units);
+    CHECK(largest != NULL);
+    CHECK(mm_record_alloc(record, max_units + 1) == NULL);
+    xfree(largest);
+
+    xfree(near_rows);
+    xfree(rows);
+    xfree(single);
+    CHECK(mm_budget_usage("sample_row_t") == 0);
+    CHECK(live_objects("sample_row_t") == 0);
+    /* the cursor reads the block after the one it returns, so the copies are freed after the walk */
+    void *copies[3];
+    uint32_t copy_count = 0;
+    CHECK(mm_object_cursor_init(&cursor, "sample_row_copy_t") == 0);
+    while (copy_count < 3 && (copies[copy_count] = mm_object_cursor_next(&cursor, NULL)) != NULL)
+    {
+        copy_count++;
+    }
+    for (uint32_t i = 0; i < copy_count; i++)
+    {
+        xfree(copies[i]);
+    }
+    CHECK(live_objects("sample_row_copy_t") == 0);
+
+    /* freeing and allocating a run again, against mapping and unmapping the same pages */
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        xfree(mm_record_alloc(record, 64));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double run_ns = elapsed_ns(&start, &end) / 10000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        void *mapping =
+            mmap(NULL, 64 * sizeof(sample_row_t), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        munmap(mapping, 64 * sizeof(sample_row_t));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double mmap_ns = elapsed_ns(&start, &end) / 10000;
+    printf("\n%-15s mmap/munmap %8.1f ns, buddy run %8.1f ns per alloc and free", "64 KiB arrays", mmap_ns, run_ns);
+}
+
+typedef struct hot_row
+{
+    uint64_t counter;
+    char payload[992];
+} hot_row_t;
+
+typedef struct cold_row
+{
+    uint64_t counter;
+    char payload[992];
+} cold_row_t;
+
+typedef struct hot_row_copy
+{
+    uint64_t counter;
+    char payload[992];
+} hot_row_copy_t;
+
+/* number of pages the coloring benchmark reads an object of */
+#define COLOR_BENCH_PAGES 256
+
+/**
+ * @brief Allocates objects until a record has `COLOR_BENCH_PAGES` data VM pages.
+ *
+ * @param struct_name The name of the struct, registered with 1000-byte objects.
+ * @param objects Filled with every allocated object.
+ * @param first_objects Filled with the first object of every page.
+ * @return Number of objects allocated.
+ */
+static uint32_t fill_color_bench_pages(const char *struct_name, void **objects, void **first_objects)
+{
+    uint32_t object_count = 0;
+    uint32_t page_count = 0;
+    while (page_count < COLOR_BENCH_PAGES ||
+           page_of(objects[object_count - 1]) == page_of(first_objects[page_count - 1]))
+    {
+        objects[object_count] = xcalloc(struct_name, 1);
+        if (page_count == 0 || page_of(objects[object_count]) != page_of(first_objects[page_count - 1]))
+        {
+            if (page_count == COLOR_BENCH_PAGES)
+            {
+                xfree(objects[object_count]);
+                break;
+            }
+            first_objects[page_count++] = objects[object_count];
+        }
+        object_count++;
+    }
+
+    return object_count;
+}
+
+/* increments the first field of one object per page over and over, returning ns per access */
+static double bench_first_fields(void **first_objects)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t round = 0; round < 2000; round++)
+    {
+        for (uint32_t i = 0; i < COLOR_BENCH_PAGES; i++)
+        {
+            ((hot_row_t *)first_objects[i])->counter++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return elapsed_ns(&start, &end) / (2000.0 * COLOR_BENCH_PAGES);
+}
+
+/* number of different cache line offsets within their page the objects start at */
+static uint32_t count_page_offsets(void **first_objects)
+{
+    bool seen[64] = {false};
+    uint32_t offsets = 0;
+    for (uint32_t i = 0; i < COLOR_BENCH_PAGES; i++)
+    {
+        uint32_t line = (uint32_t)(((uintptr_t)first_objects[i] % (uintptr_t)sysconf(_SC_PAGESIZE)) / 64);
+        offsets += !seen[line];
+        seen[line] = true;
+    }
+
+    return offsets;
+}
+
+static void test_cache_coloring(void)
+{
+    printf("\n******************** TEST 27: cache coloring ********************");
+
+    static void *hot_objects[COLOR_BENCH_PAGES * 4];
+    static void *cold_objects[COLOR_BENCH_PAGES * 4];
+    void *hot_first[COLOR_BENCH_PAGES];
+    void *cold_first[COLOR_BENCH_PAGES];
+    CHECK(MM_REG_STRUCT(hot_row_t) == 0);
+    CHECK(MM_REG_STRUCT(cold_row_t) == 0);
+    CHECK(MM_REG_STRUCT(hot_row_copy_t) == 0);
+
+    /* without coloring the first objects of all pages share a cache line offset, with it they spread */
+    CHECK(mm_configure("coloring:false") == 0);
+    uint32_t cold_count = fill_color_bench_pages("cold_row_t", cold_objects, cold_first);
+    CHECK(mm_configure("coloring:true") == 0);
+    uint32_t hot_count = fill_color_bench_pages("hot_row_t", hot_objects, hot_first);
+    CHECK(cold_count == hot_count);
+    CHECK(count_page_offsets(cold_first) == 1 && count_page_offsets(hot_first) > 1);
+    CHECK(live_objects("hot_row_t") == hot_count);
+    CHECK(mm_budget_usage("hot_row_t") == COLOR_BENCH_PAGES * (size_t)sysconf(_SC_PAGESIZE));
+
+    double cold_ns = bench_first_fields(cold_first);
+    double hot_ns = bench_first_fields(hot_first);
+    printf("\n%-15s uncolored %6.2f ns, colored %6.2f ns per object over %u pages", "first fields", cold_ns, hot_ns,
+           COLOR_BENCH_PAGES);
+
+    /* colored page images survive a page stream round trip */
+    int fd = memfd_create("test_app_colored", 0);
+    CHECK(mm_export_objects("hot_row_t", fd, MM_EXPORT_PAGES) == hot_count);
+    lseek(fd, 0, SEEK_SET);
+    CHECK(mm_import_objects("hot_row_copy_t", fd) == hot_count);
+    close(fd);
+    CHECK(live_objects("hot_row_copy_t") == hot_count);
+
+    /* compaction moves objects between colored pages and releases the emptied ones */
+    for (uint32_t i = 0; i < hot_count; i++)
+    {
+        if (i % 4 != 0)
+        {
+            xfree(hot_objects[i]);
+            hot_objects[i] = NULL;
+        }
+    }
+    static route_table_t moved;
+    CHECK(mm_set_relocation_callback("hot_row_t", track_moved_route, &moved) == 0);
+    CHECK(mm_compact("hot_row_t", 0) > 0);
+    CHECK(live_objects("hot_row_t") == (hot_count + 3) / 4);
+
+    /* every page is released with its last object, its padding block included */
+    mm_object_cursor_t cursor;
+    const char *names[] = {"hot_row_t", "cold_row_t", "hot_row_copy_t"};
+    for (uint32_t name = 0; name < 3; name++)
+    {
+        CHECK(mm_object_cursor_init(&cursor, names[name]) == 0);
+        uint32_t count = 0;
+        void *object = NULL;
+        while ((object = mm_object_cursor_next(&cursor, NULL)) != NULL)
+        {
+            cold_objects[count++] = object;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            xfree(cold_objects[i]);
+        }
+        CHECK(live_objects(names[name]) == 0 && mm_budget_usage(names[name]) == 0);
+    }
+}
+
+typedef struct placed_item
+{
+    uint64_t key;
+    char value[120];
+} placed_item_t;
+
+typedef struct local_item
+{
+    uint64_t key;
+    char value[120];
+} local_item_t;
+
+/**
+ * @brief Runs mm_print_numa_usage() with stdout redirected to a pipe.
+ *
+ * @param output Filled with the report.
+ * @param size Size of `output`.
+ */
+static void capture_numa_usage(char *output, size_t size)
+{
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    mm_print_numa_usage();
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(fds[1]);
+    size_t length = 0;
+    ssize_t chunk = 0;
+    while (length < size - 1 && (chunk = read(fds[0], output + length, size - 1 - length)) > 0)
+    {
+        length += (size_t)chunk;
+    }
+    output[length] = '\0';
+    close(fds[0]);
+}
+
+/**
+ * @brief Adds up the pages the NUMA report lists for a record.
+ *
+ * @param report Output of mm_print_numa_usage().
+ * @param struct_name The name of the struct.
+ * @param node_count Number of NUMA nodes of the report.
+ * @return Number of pages over all nodes and unknown, or -1 if the record is not listed.
+ */
+static int64_t numa_report_pages(const char *report, const char *struct_name, uint32_t node_count)
+{
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "\n%s", struct_name);
+    const char *line = strstr(report, prefix);
+    if (line == NULL)
+    {
+        return -1;
+    }
+
+    int64_t pages = 0;
+    const char *field = line + strlen(prefix);
+    for (uint32_t node = 0; node <= node_count; node++)
+    {
+        field = strchr(field, ':');
+        if (field == NULL)
+        {
+            return -1;
+        }
+        field++;
+        pages += strtol(field, NULL, 10);
+    }
+
+    return pages;
+}
+
+static void test_numa_placement(void)
+{
+    printf("\n******************** TEST 28: NUMA placement ********************");
+
+    static char report[65536];
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    CHECK(MM_REG_STRUCT(placed_item_t) == 0);
+    CHECK(MM_REG_STRUCT(local_item_t) == 0);
+    capture_numa_usage(report, sizeof(report));
+    uint32_t node_count = 0;
+    CHECK(sscanf(strstr(report, "NUMA nodes:"), "NUMA nodes: %u", &node_count) == 1 && node_count >= 1);
+
+    /* node 0 exists on every machine, nodes past the last one and negative nodes other than "any" do not */
+    CHECK(mm_set_numa_node("placed_item_t", 0) == 0);
+    CHECK(mm_set_numa_node("placed_item_t", (int32_t)node_count) == -1);
+    CHECK(mm_set_numa_node("placed_item_t", -2) == -1);
+    CHECK(mm_set_numa_node("no_such_t", 0) == -1);
+    CHECK(mm_thread_set_numa_node(0) == 0);
+    CHECK(mm_thread_set_numa_node((int32_t)node_count) == -1);
+    CHECK(mm_thread_set_numa_node(-2) == -1);
+
+    /* placed pages work like any other, and the report lists each of them once */
+    placed_item_t *placed[100];
+    local_item_t *local[100];
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        placed[i] = xcalloc("placed_item_t", 1);
+        local[i] = xcalloc("local_item_t", 1);
+        CHECK(placed[i] != NULL && local[i] != NULL);
+        placed[i]->key = i;
+        local[i]->key = i;
+    }
+    capture_numa_usage(report, sizeof(report));
+    CHECK(numa_report_pages(report, "placed_item_t", node_count) ==
+          (int64_t)(mm_budget_usage("placed_item_t") / page_size));
+    CHECK(numa_report_pages(report, "local_item_t", node_count) ==
+          (int64_t)(mm_budget_usage("local_item_t") / page_size));
+    CHECK(strstr(report, "\npage cache") != NULL);
+
+    /* a buddy run is listed page by page with its record */
+    placed_item_t *array = xcalloc("placed_item_t", 200);
+    CHECK(array != NULL);
+    capture_numa_usage(report, sizeof(report));
+    CHECK(numa_report_pages(report, "placed_item_t", node_count) ==
+          (int64_t)(mm_budget_usage("placed_item_t") / page_size));
+    xfree(array);
+
+    CHECK(mm_thread_set_numa_node(MM_NUMA_NODE_ANY) == 0);
+    CHECK(mm_set_numa_node("placed_item_t", MM_NUMA_NODE_ANY) == 0);
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        CHECK(placed[i]->key == i && local[i]->key == i);
+        xfree(placed[i]);
+        xfree(local[i]);
+    }
+    capture_numa_usage(report, sizeof(report));
+    CHECK(numa_report_pages(report, "placed_item_t", node_count) == 0);
+}
+
+typedef struct budget_item
+{
+    uint64_t key;
+    char value[248];
+} budget_item_t;
+
+typedef struct budget_probe
+{
+    uint32_t calls;
+    size_t used_bytes;
+    size_t limit_bytes;
+    bool name_matches;
+} budget_probe_t;
+
+static void note_budget_pressure(const char *struct_name, size_t used_bytes, size_t limit_bytes, void *arg)
+{
+    budget_probe_t *probe = arg;
+    probe->calls++;
+    probe->used_bytes = used_bytes;
+    probe->limit_bytes = limit_bytes;
+    probe->name_matches = (strcmp(struct_name, "budget_item_t") == 0);
+}
+
+/**
+ * @brief Allocates budget items until the record runs into its cap.
+ *
+ * @param items Filled with the items allocated.
+ * @param max_items Size of `items`.
+ * @return Number of items allocated before xcalloc returned NULL, or `max_items` if it never did.
+ */
+static uint32_t fill_budget(budget_item_t **items, uint32_t max_items)
+{
+    uint32_t count = 0;
+    while (count < max_items && (items[count] = xcalloc("budget_item_t", 1)) != NULL)
+    {
+        items[count]->key = count;
+        count++;
+    }
+
+    return count;
+}
+
+static void free_budget_items(budget_item_t **items, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        CHECK(items[i]->key == i);
+        xfree(items[i]);
+    }
+}
+
+static void test_memory_budgets(void)
+{
+    printf("\n******************** TEST 29: memory budgets ********************");
+
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    static budget_item_t *items[1024];
+    static budget_probe_t probe;
+    CHECK(MM_REG_STRUCT(budget_item_t) == 0);
+    CHECK(mm_set_budget("budget_item_t", 4, 0x80, NULL, NULL) == -1);
+    CHECK(mm_set_budget("budget_item_t", SIZE_MAX, MM_BUDGET_PAGES, NULL, NULL) == -1);
+    CHECK(mm_set_budget("no_such_t", 4, MM_BUDGET_PAGES, NULL, NULL) == -1);
+    CHECK(mm_budget_usage("no_such_t") == 0);
+
+    /* real-time records take a cap, but no callback that their allocations would have to run */
+    CHECK(mm_set_budget("control_sample_t", 1024, 0, note_budget_pressure, &probe) == -1);
+    CHECK(mm_set_budget("control_sample_t", 1024, 0, NULL, NULL) == 0);
+    mm_record_t *rt_record = mm_get_struct_record("control_sample_t");
+    control_sample_t *samples[64];
+    uint32_t sample_count = 0;
+    while (sample_count < 64 && (samples[sample_count] = mm_record_alloc(rt_record, 1)) != NULL)
+    {
+        sample_count++;
+    }
+    CHECK(sample_count > 0 && sample_count < 64 && mm_budget_usage("control_sample_t") <= 1024);
+    for (uint32_t i = 0; i < sample_count; i++)
+    {
+        xfree(samples[i]);
+    }
+    CHECK(mm_set_budget("control_sample_t", 0, 0, NULL, NULL) == 0);
+
+    /* a cap in pages stops the record at that many pages, and the callback fires once on the way */
+    CHECK(mm_set_budget("budget_item_t", 4, MM_BUDGET_PAGES, note_budget_pressure, &probe) == 0);
+    CHECK(probe.calls == 0);
+    uint32_t count = fill_budget(items, 1024);
+    CHECK(count > 0 && count < 1024);
+    CHECK(mm_budget_usage("budget_item_t") == 4 * page_size);
+    CHECK(probe.calls == 1 && probe.name_matches);
+    CHECK(probe.used_bytes == 4 * page_size && probe.limit_bytes == 4 * page_size);
+    CHECK(xcalloc("budget_item_t", 1) == NULL);
+    CHECK(probe.calls == 1);
+
+    /* a child of fork() is not the process that set the callback, so it runs into the cap without a call */
+    pid_t child = fork();
+    if (child == 0)
+    {
+        free_budget_items(items, count);
+        uint32_t child_count = fill_budget(items, 1024);
+        _exit(child_count == count && probe.calls == 1 ? 0 : 1);
+    }
+    int status = 0;
+    CHECK(child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* freeing the record below the mark arms the callback again */
+    free_budget_items(items, count);
+    CHECK(mm_budget_usage("budget_item_t") == 0);
+    CHECK(fill_budget(items, 1024) == count);
+    CHECK(probe.calls == 2);
+
+    /* a cap below what the record holds calls back right away and only stops the record from growing */
+    CHECK(mm_set_budget("budget_item_t", page_size, 0, note_budget_pressure, &probe) == 0);
+    CHECK(probe.calls == 3 && probe.limit_bytes == page_size);
+    CHECK(mm_budget_usage("budget_item_t") == 4 * page_size);
+    CHECK(xcalloc("budget_item_t", 1) == NULL);
+    free_budget_items(items, count);
+
+    /* a cap in bytes that is not a whole number of pages stops the record at the last page that fits */
+    CHECK(mm_set_budget("budget_item_t", 2 * page_size + page_size / 2, 0, NULL, NULL) == 0);
+    count = fill_budget(items, 1024);
+    CHECK(count > 0 && mm_budget_usage("budget_item_t") == 2 * page_size);
+    free_budget_items(items, count);
+
+    /* without a cap the record grows past it again */
+    CHECK(mm_set_budget("budget_item_t", 0, 0, NULL, NULL) == 0);
+    count = fill_budget(items, 1024);
+    CHECK(count == 1024 && mm_budget_usage("budget_item_t") > 4 * page_size);
+    free_budget_items(items, count);
+    CHECK(mm_budget_usage("budget_item_t") == 0 && probe.calls == 3);
+}
+
+/* argument test_app runs itself with to check the malloc family of libmm_preload.so */
+static char preload_child_arg[] = "--preload-child";
+
+/**
+ * @brief Checks the malloc family in a copy of test_app started with libmm_preload.so in LD_PRELOAD.
+ *
+ * @return Number of failed checks, used as the exit status.
+ */
+static int run_preload_child(void)
+{
+    /* small requests come from the size classes, large ones from mappings 16 bytes into a page */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    char *small = malloc(20);
+    CHECK(small != NULL && ((uintptr_t)small & 15) == 0);
+    CHECK(malloc_usable_size(small) == 32);
+    strcpy(small, "interposed");
+    char *large = malloc(1 << 20);
+    CHECK(large != NULL && ((uintptr_t)large & (page_size - 1)) == 16);
+    CHECK(malloc_usable_size(large) >= (1 << 20));
+    memset(large, 0xab, 1 << 20);
+
+    /* realloc keeps the contents when an object moves between size classes and mappings */
+    small = realloc(small, 3000);
+    CHECK(small != NULL && strcmp(small, "interposed") == 0);
+    small = realloc(small, 100);
+    CHECK(small != NULL && strcmp(small, "interposed") == 0);
+    large = realloc(large, 4 << 20);
+    CHECK(large != NULL && (uint8_t)large[(1 << 20) - 1] == 0xab);
+    CHECK(realloc(large, 0) == NULL);
+    free(small);
+
+    uint32_t *zeroed = calloc(64, sizeof(uint32_t));
+    CHECK(zeroed != NULL && zeroed[0] == 0 && zeroed[63] == 0);
+    free(zeroed);
+
+    void *aligned = NULL;
+    CHECK(posix_memalign(&aligned, 64, 100) == 0 && ((uintptr_t)aligned & 63) == 0);
+    free(aligned);
+    aligned = aligned_alloc(8192, 10);
+    CHECK(aligned != NULL && ((uintptr_t)aligned & 8191) == 0);
+    free(aligned);
+
+    /* failures are reported the way the C library reports them */
+    volatile size_t huge = SIZE_MAX;
+    errno = 0;
+    CHECK(malloc(huge) == NULL && errno == ENOMEM);
+    errno = 0;
+    CHECK(calloc(huge, 2) == NULL && errno == ENOMEM);
+    CHECK(posix_memalign(&aligned, 3, 16) == EINVAL);
+    errno = 0;
+    CHECK(aligned_alloc(24, 16) == NULL && errno == EINVAL);
+    CHECK(malloc_usable_size(NULL) == 0);
+
+    /* the fork handlers leave the allocator usable in the child */
+    pid_t child = fork();
+    if (child == 0)
+    {
+        void *in_child = malloc(48);
+        free(in_child);
+        _exit(in_child != NULL ? 0 : 1);
+    }
+    int status = 0;
+    CHECK(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    return failed_checks == 0 ? 0 : 1;
+}
+
+static void test_preload(void)
+{
+    printf("\n******************** TEST 21: malloc interposition ********************");
+
+    /* the library is installed next to the directory of this binary */
+    char self[4096];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    CHECK(length > 0);
+    if (length <= 0)
+    {
+        return;
+    }
+    self[length] = '\0';
+    char exe[4096];
+    strcpy(exe, self);
+    char preload[4200];
+    snprintf(preload, sizeof(preload), "LD_PRELOAD=%s/../libs/libmm_preload.so", dirname(self));
+    CHECK(access(preload + strlen("LD_PRELOAD="), R_OK) == 0);
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        char *child_argv[] = {exe, preload_child_arg, NULL};
+        char *child_envp[] = {preload, NULL};
+        execve(exe, child_argv, child_envp);
+        _exit(127);
+    }
+    int status = 0;
+    CHECK(waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
 int main(int argc, char **argv)
 {
+    if (argc > 1 && strcmp(argv[1], preload_child_arg) == 0)
+    {
+        return run_preload_child();
+    }
+
     mm_init();
     MM_REG_STRUCT(empt_t);
     MM_REG_STRUCT(student_t);
@@ -45,5 +2060,34 @@ int main(int argc, char **argv)
     mm_print_mem_usage(NULL);
     mm_print_block_usage();
 
-    return 0;
+    test_shared_heap();
+    test_persistent_heap();
+    test_out_of_band_records();
+    test_object_cursors();
+    test_export_import();
+    test_struct_of_arrays();
+    test_handles();
+    test_compaction();
+    test_object_cache();
+    test_reference_counts();
+    test_typed_allocator();
+    test_memory_resource();
+    test_static_records();
+    test_pool();
+    test_pooled_class();
+    test_page_release();
+    test_coroutine_frames();
+    test_preload();
+    test_configuration();
+    test_compressed_heap();
+    test_near_allocation();
+    test_real_time_pool();
+    test_buddy_runs();
+    test_cache_coloring();
+    test_numa_placement();
+    test_memory_budgets();
+
+    printf("\n\n%s: %u failed checks\n", failed_checks == 0 ? "PASSED" : "FAILED", failed_checks);
+
+    return failed_checks == 0 ? 0 : 1;
 }
@@ -0,0 +1,36 @@
+#ifndef _TEST_APP_
+#define _TEST_APP_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* number of failed checks of the whole run, test_app exits non-zero unless it is 0 */
+extern uint32_t failed_checks;
+
+/* reports a failed expectation and carries on, so that one run lists every failure */
+#define CHECK(condition)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(condition))                                                                                              \
+        {                                                                                                              \
+            printf("\nCHECK FAILED %s:%d: %s", __FILE__, __LINE__, #condition);                                        \
+            failed_checks++;                                                                                           \
+        }                                                                                                              \
+    } while (0)
+
+/* tests of the C++ headers, in test_app_cpp.cpp */
+void test_typed_allocator(void);
+void test_memory_resource(void);
+void test_pool(void);
+void test_pooled_class(void);
+void test_coroutine_frames(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TEST_APP_ */
@@ -0,0 +1,551 @@
+#include "mm_allocator.hpp"
+#include "mm_coroutine.hpp"
+#include "mm_memory_resource.hpp"
+#include "mm_pool.hpp"
+#include "test_app.h"
+#include <coroutine>
+#include <ctime>
+#include <list>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+struct alignas(64) cache_line
+{
+    char bytes[64];
+};
+
+struct journal_line
+{
+    uint64_t sequence = 0;
+    char text[24] = {};
+};
+
+int8_t count_objects(void *app_data, uint32_t size, void *arg)
+{
+    (*static_cast<uint32_t *>(arg))++;
+    return 0;
+}
+
+/* live objects of the record mm::type_record<T, Flags> registers for T */
+template <typename T, uint32_t Flags = 0> uint32_t live_objects_of_type()
+{
+    char name[mm::detail::record_name_size];
+    mm::detail::record_name(typeid(T), Flags, name);
+    uint32_t count = 0;
+    mm_for_each_object(name, count_objects, &count);
+    return count;
+}
+
+/* upstream resource counting the requests the size classes pass on */
+class counting_resource : public std::pmr::memory_resource
+{
+  public:
+    std::size_t allocations = 0;
+
+  private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        allocations++;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) override
+    {
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+struct small_order
+{
+    uint64_t id;
+    double price;
+
+    explicit small_order(uint64_t order_id) : id(order_id), price(1.5)
+    {
+    }
+};
+
+struct large_order
+{
+    uint64_t id;
+    char lines[1500];
+
+    explicit large_order(uint64_t order_id) : id(order_id), lines()
+    {
+    }
+};
+
+struct alignas(128) aligned_order
+{
+    uint64_t id;
+
+    explicit aligned_order(uint64_t order_id) : id(order_id)
+    {
+    }
+};
+
+struct throwing_order
+{
+    uint64_t id;
+
+    explicit throwing_order(uint64_t order_id) : id(order_id)
+    {
+        throw std::runtime_error("rejected");
+    }
+};
+
+struct shape : public mm::pooled<shape>
+{
+    uint64_t id;
+
+    explicit shape(uint64_t shape_id = 0) : id(shape_id)
+    {
+    }
+
+    virtual ~shape() = default;
+};
+
+struct labelled_shape : public shape
+{
+    char label[40];
+
+    explicit labelled_shape(uint64_t shape_id) : shape(shape_id), label("labelled")
+    {
+    }
+};
+
+struct alignas(64) aligned_shape : public shape
+{
+    explicit aligned_shape(uint64_t shape_id) : shape(shape_id)
+    {
+    }
+};
+
+/* coroutine suspended at its start that yields one value when resumed, with its frame allocated by FrameBase */
+template <typename FrameBase> struct counter_task
+{
+    struct promise_type : public FrameBase
+    {
+        uint64_t value = 0;
+
+        counter_task get_return_object()
+        {
+            return counter_task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_always yield_value(uint64_t yielded) noexcept
+        {
+            value = yielded;
+            return {};
+        }
+
+        void return_void() noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    uint64_t next()
+    {
+        handle.resume();
+        return handle.promise().value;
+    }
+
+    void *frame() const
+    {
+        return handle.address();
+    }
+};
+
+struct global_frame
+{
+};
+
+template <typename FrameBase> counter_task<FrameBase> count_from(uint64_t start)
+{
+    char scratch[96] = {};
+    scratch[start % sizeof(scratch)] = 1;
+    co_yield start + scratch[start % sizeof(scratch)];
+}
+
+double now_ns()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/* replaces random members of a set of live objects, with new/delete, with the record alone by trimming the list of the
+ * thread after every free, and with the pool, and prints ns per replace */
+template <typename T> void bench_pool(const char *label)
+{
+    constexpr uint32_t live = 1000;
+    constexpr uint32_t replaces = 200000;
+    static T *objects[live];
+    uint32_t seed = 1;
+
+    for (uint32_t i = 0; i < live; i++)
+    {
+        objects[i] = new T(i);
+    }
+    double start = now_ns();
+    for (uint32_t i = 0; i < replaces; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint32_t slot = (seed >> 8) % live;
+        delete objects[slot];
+        objects[slot] = new T(i);
+    }
+    double new_delete_ns = (now_ns() - start) / replaces;
+    for (uint32_t i = 0; i < live; i++)
+    {
+        delete objects[i];
+        objects[i] = mm::pool<T>::create(i);
+    }
+    start = now_ns();
+    for (uint32_t i = 0; i < replaces; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint32_t slot = (seed >> 8) % live;
+        mm::pool<T>::destroy(objects[slot]);
+        mm::pool<T>::trim();
+        objects[slot] = mm::pool<T>::create(i);
+    }
+    double record_ns = (now_ns() - start) / replaces;
+    start = now_ns();
+    for (uint32_t i = 0; i < replaces; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint32_t slot = (seed >> 8) % live;
+        mm::pool<T>::destroy(objects[slot]);
+        objects[slot] = mm::pool<T>::create(i);
+    }
+    double pool_ns = (now_ns() - start) / replaces;
+    for (uint32_t i = 0; i < live; i++)
+    {
+        mm::pool<T>::destroy(objects[i]);
+    }
+    mm::pool<T>::trim();
+
+    printf("\n%-15s new/delete %6.1f ns, record %6.1f ns, mm::pool %6.1f ns per replace", label, new_delete_ns,
+           record_ns, pool_ns);
+}
+
+} // namespace
+
+void test_typed_allocator(void)
+{
+    printf("\n******************** TEST 14: typed allocator ********************");
+
+    /* the storage of a container of T comes from the record of T, one allocation per call */
+    {
+        std::vector<uint64_t, mm::allocator<uint64_t>> numbers(10, 7);
+        CHECK(live_objects_of_type<uint64_t>() == 1);
+        CHECK(mm_usable_size(numbers.data()) >= 10 * sizeof(uint64_t));
+        numbers.push_back(8);
+        CHECK(live_objects_of_type<uint64_t>() == 1 && numbers[10] == 8 && numbers[3] == 7);
+    }
+    CHECK(live_objects_of_type<uint64_t>() == 0);
+
+    /* node containers rebind the allocator, so their nodes get a record of their own */
+    {
+        std::list<int, mm::allocator<int>> values;
+        for (int i = 0; i < 100; i++)
+        {
+            values.push_back(i);
+        }
+        CHECK(values.size() == 100 && values.back() == 99);
+        CHECK(live_objects_of_type<int>() == 0);
+    }
+
+    /* requests the record cannot serve, too large or over-aligned, go to std::allocator */
+    mm::allocator<uint64_t> allocator;
+    std::size_t too_many = mm::type_record<uint64_t>::max_units() + 1;
+    uint64_t *large = allocator.allocate(too_many);
+    CHECK(large != nullptr && live_objects_of_type<uint64_t>() == 0);
+    allocator.deallocate(large, too_many);
+    mm::allocator<cache_line> aligned_allocator;
+    cache_line *line = aligned_allocator.allocate(1);
+    CHECK(reinterpret_cast<uintptr_t>(line) % alignof(cache_line) == 0 && live_objects_of_type<cache_line>() == 0);
+    aligned_allocator.deallocate(line, 1);
+    CHECK(allocator == aligned_allocator);
+
+    /* records are found again in whichever heap is attached, so a closed persistent heap leaves none behind */
+    char path[64];
+    std::snprintf(path, sizeof(path), "/tmp/test_app_typed_%d.img", static_cast<int>(getpid()));
+    unlink(path);
+    {
+        std::vector<uint64_t, mm::allocator<uint64_t>> before(4, 1);
+        CHECK(mm_init_persistent(path, 1 << 20) == 0);
+        {
+            std::vector<uint64_t, mm::allocator<uint64_t>> numbers(10, 7);
+            CHECK(mm_shared_offset(numbers.data()) != 0 && live_objects_of_type<uint64_t>() == 1);
+            mm::pool<journal_line>::unique_ptr pooled = mm::pool<journal_line>::make_unique();
+            CHECK(mm_shared_offset(pooled.get()) != 0);
+        }
+        CHECK(mm_close_persistent() == 0);
+        std::vector<uint64_t, mm::allocator<uint64_t>> after(10, 7);
+        CHECK(mm_shared_offset(after.data()) == 0 && live_objects_of_type<uint64_t>() == 2);
+        mm::pool<journal_line>::unique_ptr pooled = mm::pool<journal_line>::make_unique();
+        CHECK(pooled != nullptr && pooled->sequence == 0 && mm_shared_offset(pooled.get()) == 0);
+    }
+    mm::pool<journal_line>::trim();
+    CHECK(live_objects_of_type<uint64_t>() == 0 && live_objects_of_type<journal_line>() == 0);
+    unlink(path);
+}
+
+void test_memory_resource(void)
+{
+    printf("\n******************** TEST 15: size classes and memory resource ********************");
+
+    /* requests are rounded up to a size class, aligned as asked */
+    void *small = mm_size_class_alloc(40, 16);
+    CHECK(small != nullptr && reinterpret_cast<uintptr_t>(small) % 16 == 0 && mm_usable_size(small) >= 48);
+    void *largest = mm_size_class_alloc(MM_SIZE_CLASS_MAX_BYTES, 8);
+    CHECK(largest != nullptr && mm_usable_size(largest) >= MM_SIZE_CLASS_MAX_BYTES);
+    CHECK(mm_size_class_alloc(MM_SIZE_CLASS_MAX_BYTES + 1, 8) == nullptr);
+    CHECK(mm_size_class_alloc(64, 2 * MM_SIZE_CLASS_ALIGNMENT) == nullptr);
+    xfree(small);
+    xfree(largest);
+
+    /* pmr containers draw from the size classes and pass larger or over-aligned requests upstream */
+    counting_resource upstream;
+    mm::memory_resource resource(&upstream);
+    {
+        std::pmr::vector<std::pmr::string> names(&resource);
+        for (int i = 0; i < 25; i++)
+        {
+            names.emplace_back(std::to_string(i) + " is a string too long for the small string buffer");
+        }
+        CHECK(names.size() == 25 && names[24].compare(0, 3, "24 ") == 0);
+        CHECK(upstream.allocations == 0);
+
+        void *large = resource.allocate(MM_SIZE_CLASS_MAX_BYTES + 1, 8);
+        void *aligned = resource.allocate(64, 64);
+        CHECK(upstream.allocations == 2 && reinterpret_cast<uintptr_t>(aligned) % 64 == 0);
+        resource.deallocate(large, MM_SIZE_CLASS_MAX_BYTES + 1, 8);
+        resource.deallocate(aligned, 64, 64);
+    }
+
+    mm::memory_resource other(&upstream);
+    CHECK(resource.is_equal(other) && !resource.is_equal(*std::pmr::new_delete_resource()));
+    CHECK(mm::size_class_resource()->upstream_resource() == std::pmr::new_delete_resource());
+}
+
+void test_pool(void)
+{
+    printf("\n******************** TEST 17: object pool ********************");
+
+    static_assert(mm::pool<small_order>::storage == mm::pool_storage::slots);
+    static_assert(mm::pool<large_order>::storage == mm::pool_storage::blocks);
+    static_assert(mm::pool<aligned_order>::storage == mm::pool_storage::system);
+    static_assert(sizeof(mm::pool<small_order>::unique_ptr) == sizeof(small_order *));
+
+    /* slots and blocks come from records of their own, the flags telling them apart */
+    small_order *small = mm::pool<small_order>::create(1);
+    CHECK(small->id == 1 && small->price == 1.5);
+    CHECK((live_objects_of_type<small_order, MM_RECORD_OUT_OF_BAND_META>() == 1));
+    {
+        mm::pool<large_order>::unique_ptr large = mm::pool<large_order>::make_unique(2);
+        CHECK(large->id == 2 && live_objects_of_type<large_order>() == 1);
+    }
+    mm::pool<large_order>::trim();
+    CHECK(live_objects_of_type<large_order>() == 0);
+    mm::pool<small_order>::destroy(small);
+    mm::pool<small_order>::destroy(nullptr);
+    mm::pool<small_order>::trim();
+    CHECK((live_objects_of_type<small_order, MM_RECORD_OUT_OF_BAND_META>() == 0));
+
+    /* freed objects stay with the thread up to the depth of its list, and the next one created takes the last freed */
+    static_assert(mm::pool<small_order>::cached && !mm::pool<aligned_order>::cached);
+    small_order *orders[100];
+    for (small_order *&order : orders)
+    {
+        order = mm::pool<small_order>::create(5);
+    }
+    for (small_order *order : orders)
+    {
+        mm::pool<small_order>::destroy(order);
+    }
+    CHECK((live_objects_of_type<small_order, MM_RECORD_OUT_OF_BAND_META>() == mm::detail::pool_cache_depth));
+    small_order *reused = mm::pool<small_order>::create(6);
+    CHECK(reused == orders[mm::detail::pool_cache_depth - 1] && reused->id == 6);
+    mm::pool<small_order>::destroy(reused);
+    mm::pool<small_order>::trim();
+    CHECK((live_objects_of_type<small_order, MM_RECORD_OUT_OF_BAND_META>() == 0));
+
+    /* a thread gives the objects it kept back to the record when it exits */
+    std::thread worker([] {
+        for (uint32_t i = 0; i < 10; i++)
+        {
+            mm::pool<large_order>::destroy(mm::pool<large_order>::create(i));
+        }
+    });
+    worker.join();
+    CHECK(live_objects_of_type<large_order>() == 0);
+
+    /* over-aligned types keep their alignment through the global operator new */
+    aligned_order *aligned = mm::pool<aligned_order>::create(3);
+    CHECK(reinterpret_cast<uintptr_t>(aligned) % 128 == 0 && aligned->id == 3);
+    mm::pool<aligned_order>::destroy(aligned);
+
+    /* a throwing constructor gives its storage back */
+    bool thrown = false;
+    try
+    {
+        mm::pool<throwing_order>::create(4);
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    mm::pool<throwing_order>::trim();
+    CHECK(thrown && (live_objects_of_type<throwing_order, MM_RECORD_OUT_OF_BAND_META>() == 0));
+
+    /* array storage spans consecutive objects of the record, or the global operator new past a single allocation */
+    void *array = mm::pool<large_order>::allocate_bytes(2 * sizeof(large_order));
+    CHECK(array != nullptr && live_objects_of_type<large_order>() == 1);
+    mm::pool<large_order>::deallocate_bytes(array, 2 * sizeof(large_order));
+    CHECK(live_objects_of_type<large_order>() == 0);
+
+    /* replaces are served by the list of the thread, without the heap lock: the numbers are printed, not checked */
+    bench_pool<small_order>("16 B slots");
+    bench_pool<large_order>("1.5 KiB blocks");
+}
+
+void test_pooled_class(void)
+{
+    printf("\n******************** TEST 18: pooled classes ********************");
+
+    constexpr uint32_t record_flags = (mm::pool<shape>::storage == mm::pool_storage::slots ? MM_RECORD_OUT_OF_BAND_META
+                                                                                            : 0U);
+
+    /* plain new and delete go to the pool of the class, for arrays and derived classes too */
+    shape *circle = new shape(1);
+    shape *shapes = new shape[8];
+    shape *labelled = new labelled_shape(2);
+    CHECK((live_objects_of_type<shape, record_flags>() == 3));
+    CHECK(circle->id == 1 && shapes[7].id == 0 && labelled->id == 2);
+    CHECK(mm_usable_size(labelled) >= sizeof(labelled_shape));
+    delete labelled;
+    delete[] shapes;
+    delete circle;
+    mm::pool<shape>::trim();
+    CHECK((live_objects_of_type<shape, record_flags>() == 0));
+
+    /* over-aligned derived classes go to the aligned global operator new, placement new stays in place */
+    shape *aligned = new aligned_shape(3);
+    CHECK(reinterpret_cast<uintptr_t>(aligned) % 64 == 0 && (live_objects_of_type<shape, record_flags>() == 0));
+    delete aligned;
+    alignas(shape) unsigned char buffer[sizeof(shape)];
+    shape *placed = new (buffer) shape(4);
+    CHECK(static_cast<void *>(placed) == buffer && placed->id == 4);
+    placed->~shape();
+}
+
+/* creates, resumes and destroys a coroutine over and over, returning ns per coroutine */
+template <typename FrameBase> double bench_coroutine(uint32_t rounds)
+{
+    uint64_t sum = 0;
+    double start = now_ns();
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        counter_task<FrameBase> task = count_from<FrameBase>(i);
+        sum += task.next();
+        task.handle.destroy();
+    }
+    double elapsed = now_ns() - start;
+    CHECK(sum == static_cast<uint64_t>(rounds) * (rounds - 1) / 2 + rounds);
+
+    return elapsed / rounds;
+}
+
+void test_coroutine_frames(void)
+{
+    printf("\n******************** TEST 20: coroutine frames ********************");
+
+    /* a freed frame is handed out again by the next call on the same thread */
+    counter_task<mm::pooled_frame> first = count_from<mm::pooled_frame>(5);
+    CHECK(first.next() == 6);
+    void *frame = first.frame();
+    CHECK(mm_usable_size(frame) != 0);
+    first.handle.destroy();
+    counter_task<mm::pooled_frame> second = count_from<mm::pooled_frame>(7);
+    CHECK(second.frame() == frame && second.next() == 8);
+    second.handle.destroy();
+
+    /* frames cached by a thread go back to their size class record when the thread exits */
+    std::size_t bucket_bytes = 160;
+    char name[32];
+    snprintf(name, sizeof(name), "mm_size_class_%zu", bucket_bytes);
+    void *kept = mm::frame_allocate(bucket_bytes);
+    uint32_t before = 0;
+    mm_for_each_object(name, count_objects, &before);
+    std::thread worker([bucket_bytes] {
+        void *frames[100];
+        for (void *&worker_frame : frames)
+        {
+            worker_frame = mm::frame_allocate(bucket_bytes);
+        }
+        for (void *worker_frame : frames)
+        {
+            mm::frame_deallocate(worker_frame, bucket_bytes);
+        }
+    });
+    worker.join();
+    uint32_t after = 0;
+    mm_for_each_object(name, count_objects, &after);
+    CHECK(after == before);
+    mm::frame_deallocate(kept, bucket_bytes);
+
+    /* frames cached in one heap are not handed out once another heap is attached */
+    char path[64];
+    std::snprintf(path, sizeof(path), "/tmp/test_app_frames_%d.img", static_cast<int>(getpid()));
+    unlink(path);
+    mm::frame_deallocate(mm::frame_allocate(bucket_bytes), bucket_bytes);
+    CHECK(mm_init_persistent(path, 1 << 20) == 0);
+    void *persistent = mm::frame_allocate(bucket_bytes);
+    CHECK(mm_shared_offset(persistent) != 0);
+    mm::frame_deallocate(persistent, bucket_bytes);
+    CHECK(mm_close_persistent() == 0);
+    void *private_frame = mm::frame_allocate(bucket_bytes);
+    CHECK(private_frame != persistent && mm_shared_offset(private_frame) == 0);
+    mm::frame_deallocate(private_frame, bucket_bytes);
+    unlink(path);
+
+    /* frames larger than the size classes come from the global operator new */
+    void *large = mm::frame_allocate(MM_SIZE_CLASS_MAX_BYTES + 1);
+    CHECK(large != nullptr);
+    mm::frame_deallocate(large, MM_SIZE_CLASS_MAX_BYTES + 1);
+
+    double global_ns = bench_coroutine<global_frame>(200000);
+    double pooled_ns = bench_coroutine<mm::pooled_frame>(200000);
+    printf("\n%-15s global new %6.1f ns, mm::pooled_frame %6.1f ns per coroutine", "coroutines", global_ns, pooled_ns);
+}